@@ -0,0 +1,378 @@
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <thread>
+
+#include <spawn.h>
+#include <sys/wait.h>
+
+#include "alert_rules.hpp"
+#include "cli_commands.hpp"
+#include "report.hpp"
+
+extern char **environ;
+
+AlertEngine g_alerts;
+
+static constexpr struct
+{
+    const char *text;
+    int op;
+} OPERATORS[] = {
+    {"<=", AlertOp::LessEqual},
+    {">=", AlertOp::GreaterEqual},
+    {"==", AlertOp::Equal},
+    {"!=", AlertOp::NotEqual},
+    {"<", AlertOp::Less},
+    {">", AlertOp::Greater},
+};
+
+static const char *const OPERATOR_TEXT[] = {"<", "<=", ">", ">=", "==", "!="};
+static const char *const STATE_TEXT[] = {"normal", "pending", "firing"};
+
+static std::string_view trim(std::string_view text)
+{
+    while (!text.empty() && isspace(static_cast<unsigned char>(text.front())))
+        text.remove_prefix(1);
+    while (!text.empty() && isspace(static_cast<unsigned char>(text.back())))
+        text.remove_suffix(1);
+    return text;
+}
+
+// Position of " word " in `text` at or after `from`, npos when it is not there
+static size_t find_keyword(std::string_view text, std::string_view word, size_t from)
+{
+    for (size_t pos = text.find(word, from); pos != std::string_view::npos; pos = text.find(word, pos + 1))
+    {
+        bool before = pos > 0 && isspace(static_cast<unsigned char>(text[pos - 1]));
+        bool after = pos + word.size() < text.size() && isspace(static_cast<unsigned char>(text[pos + word.size()]));
+        if (before && after)
+            return pos;
+    }
+    return std::string_view::npos;
+}
+
+// 30, 30s, 2m, 1.5h
+static bool parse_duration(std::string_view token, double &seconds)
+{
+    auto [ptr, ec] = std::from_chars(token.data(), token.data() + token.size(), seconds);
+    if (ec != std::errc() || seconds < 0)
+        return false;
+
+    std::string_view unit(ptr, token.data() + token.size() - ptr);
+    if (unit == "m")
+        seconds *= 60;
+    else if (unit == "h")
+        seconds *= 3600;
+    else if (!unit.empty() && unit != "s")
+        return false;
+    return true;
+}
+
+static bool compare(int op, double value, double threshold)
+{
+    switch (op)
+    {
+    case AlertOp::Less:
+        return value < threshold;
+    case AlertOp::LessEqual:
+        return value <= threshold;
+    case AlertOp::Greater:
+        return value > threshold;
+    case AlertOp::GreaterEqual:
+        return value >= threshold;
+    case AlertOp::Equal:
+        return value == threshold;
+    }
+    return value != threshold;
+}
+
+// A firing rule clears once the value is back by the hysteresis, equality rules as soon as it does not hold
+static bool cleared(int op, double value, double threshold, double hysteresis)
+{
+    switch (op)
+    {
+    case AlertOp::Less:
+        return value >= threshold + hysteresis;
+    case AlertOp::LessEqual:
+        return value > threshold + hysteresis;
+    case AlertOp::Greater:
+        return value <= threshold - hysteresis;
+    case AlertOp::GreaterEqual:
+        return value < threshold - hysteresis;
+    }
+    return !compare(op, value, threshold);
+}
+
+// Runs `command` through /bin/sh with the transition in its environment. A
+// detached thread reaps it, the sampling thread never waits for a hook.
+static void run_hook(const AlertRule &rule)
+{
+    std::string variables[] = {
+        "ALERT_NAME=" + rule.name,
+        std::string("ALERT_STATE=") + (rule.state == AlertState::Firing ? "firing" : "cleared"),
+        "ALERT_VALUE=" + std::to_string(rule.last_value),
+        "ALERT_THRESHOLD=" + std::to_string(rule.last_threshold),
+    };
+    std::vector<char *> envp;
+    for (char **env = environ; *env; env++)
+        envp.push_back(*env);
+    for (auto &variable : variables)
+        envp.push_back(variable.data());
+    envp.push_back(nullptr);
+
+    const char *argv[] = {"/bin/sh", "-c", rule.exec.c_str(), nullptr};
+    pid_t pid;
+    int rc = posix_spawn(&pid, "/bin/sh", nullptr, nullptr, const_cast<char *const *>(argv), envp.data());
+    if (rc != 0)
+    {
+        fprintf(stderr, "Unable to run the hook of alert %s: %s\n", rule.name.c_str(), strerror(rc));
+        return;
+    }
+    std::thread([pid]
+                { int status;
+                  waitpid(pid, &status, 0); })
+        .detach();
+}
+
+int AlertEngine::add(std::string_view line)
+{
+    line = trim(line);
+    size_t space = line.find_first_of(" \t");
+    if (space == std::string_view::npos)
+    {
+        printf("Usage: NAME EXPRESSION OP VALUE [for DURATION] [hysteresis H] [exec COMMAND (rest of the line)], e.g. t5_hot t5 > 95 for 30s\n");
+        return -1;
+    }
+
+    AlertRule rule;
+    rule.name = line.substr(0, space);
+    std::string_view body = trim(line.substr(space));
+
+    size_t op_pos = body.find_first_of("<>=!");
+    size_t op_length = 0;
+    for (const auto &candidate : OPERATORS)
+    {
+        if (op_pos != std::string_view::npos && body.substr(op_pos).starts_with(candidate.text))
+        {
+            rule.op = candidate.op;
+            op_length = strlen(candidate.text);
+            break;
+        }
+    }
+    if (op_length == 0)
+    {
+        printf("Comparison expected: < <= > >= == !=\n");
+        return -1;
+    }
+
+    // exec takes the rest of the line, for and hysteresis in any order before it
+    size_t option_from = op_pos + op_length;
+    if (size_t pos = find_keyword(body, "exec", option_from); pos != std::string_view::npos)
+    {
+        rule.exec = trim(body.substr(pos + 4));
+        body = body.substr(0, pos);
+    }
+    size_t for_pos = find_keyword(body, "for", option_from);
+    size_t hysteresis_pos = find_keyword(body, "hysteresis", option_from);
+    auto option_value = [&](size_t pos, size_t length)
+    {
+        size_t end = body.size();
+        for (size_t other : {for_pos, hysteresis_pos})
+        {
+            if (other != std::string_view::npos && other > pos)
+                end = std::min(end, other);
+        }
+        return trim(body.substr(pos + length, end - pos - length));
+    };
+
+    if (hysteresis_pos != std::string_view::npos)
+    {
+        std::string_view token = option_value(hysteresis_pos, 10);
+        auto [ptr, ec] = std::from_chars(token.data(), token.data() + token.size(), rule.hysteresis);
+        if (ec != std::errc() || ptr != token.data() + token.size() || rule.hysteresis < 0)
+        {
+            printf("hysteresis \"%.*s\": expected a number in the value's units\n", static_cast<int>(token.size()), token.data());
+            return -1;
+        }
+    }
+    if (for_pos != std::string_view::npos)
+    {
+        std::string_view token = option_value(for_pos, 3);
+        if (!parse_duration(token, rule.for_s))
+        {
+            printf("for \"%.*s\": expected a duration like 30, 30s, 5m or 1h\n", static_cast<int>(token.size()), token.data());
+            return -1;
+        }
+    }
+    body = body.substr(0, std::min(for_pos, hysteresis_pos));
+
+    std::string error;
+    if (rule.value.compile(body.substr(0, op_pos), error) == -1 || rule.threshold.compile(body.substr(option_from), error) == -1)
+    {
+        printf("%s\n", error.c_str());
+        return -1;
+    }
+
+    uint16_t first, last;
+    if (rule.value.range(rule.first, rule.last))
+        rule.reads_input = true;
+    if (rule.threshold.range(first, last))
+    {
+        rule.first = rule.reads_input ? std::min(rule.first, first) : first;
+        rule.last = rule.reads_input ? std::max(rule.last, last) : last;
+        rule.reads_input = true;
+    }
+
+    std::unique_lock lk(mutex_);
+    auto it = std::find_if(rules_.begin(), rules_.end(), [&](const AlertRule &r)
+                           { return r.name == rule.name; });
+    printf("%s alert %s: %s %s %s\n", it == rules_.end() ? "Added" : "Replaced", rule.name.c_str(), rule.value.text().c_str(), OPERATOR_TEXT[rule.op], rule.threshold.text().c_str());
+    if (it == rules_.end())
+        rules_.push_back(std::move(rule));
+    else
+        *it = std::move(rule);
+    return 0;
+}
+
+int AlertEngine::remove(std::string_view name)
+{
+    name = trim(name);
+    std::unique_lock lk(mutex_);
+    auto it = std::find_if(rules_.begin(), rules_.end(), [&](const AlertRule &r)
+                           { return r.name == name; });
+    if (it == rules_.end())
+    {
+        printf("No such alert (%.*s)\n", static_cast<int>(name.size()), name.data());
+        return -1;
+    }
+    rules_.erase(it);
+    return 0;
+}
+
+void AlertEngine::show(void) const
+{
+    std::unique_lock lk(mutex_);
+    Report report;
+    if (rules_.empty())
+    {
+        report.message("alerts", "No alert rules");
+        return;
+    }
+
+    for (const auto &rule : rules_)
+    {
+        std::string text = rule.value.text() + " " + OPERATOR_TEXT[rule.op] + " " + rule.threshold.text();
+        if (rule.for_s > 0)
+            text += " for " + to_string_with_precision(rule.for_s, 0) + "s";
+        if (rule.hysteresis > 0)
+            text += " hysteresis " + to_string_with_precision(rule.hysteresis, 2);
+        if (!rule.exec.empty())
+            text += " exec " + rule.exec;
+
+        report.text(rule.name + "_rule", rule.name, text);
+        report.text(rule.name + "_state", rule.name + " state", STATE_TEXT[rule.state]);
+        report.number(rule.name + "_value", rule.name + " value", rule.last_value, 2);
+    }
+}
+
+void AlertEngine::evaluate(const uint16_t *input, const uint16_t *holding, uint16_t from, uint16_t to, Clock::time_point now)
+{
+    std::unique_lock lk(mutex_);
+    for (auto &rule : rules_)
+    {
+        if (rule.reads_input && (rule.first < from || rule.last > to))
+            continue;
+
+        rule.last_value = rule.value.evaluate(input, holding, now);
+        rule.last_threshold = rule.threshold.evaluate(input, holding, now);
+        if (std::isnan(rule.last_value) || std::isnan(rule.last_threshold))
+            continue; // e.g. rate() before its second sample, nothing is known either way
+
+        bool holds = compare(rule.op, rule.last_value, rule.last_threshold);
+        switch (rule.state)
+        {
+        case AlertState::Normal:
+            if (holds && rule.for_s <= 0)
+            {
+                transition(rule, AlertState::Firing, now);
+            }
+            else if (holds)
+            {
+                rule.state = AlertState::Pending;
+                rule.since = now;
+            }
+            break;
+
+        case AlertState::Pending:
+            if (!holds)
+            {
+                rule.state = AlertState::Normal;
+                rule.since = now;
+            }
+            else if (std::chrono::duration<double>(now - rule.since).count() >= rule.for_s)
+                transition(rule, AlertState::Firing, now);
+            break;
+
+        case AlertState::Firing:
+            if (cleared(rule.op, rule.last_value, rule.last_threshold, rule.hysteresis))
+                transition(rule, AlertState::Normal, now);
+            break;
+        }
+    }
+}
+
+bool AlertEngine::range(uint16_t &first, uint16_t &last) const
+{
+    std::unique_lock lk(mutex_);
+    bool any = false;
+    for (const auto &rule : rules_)
+    {
+        if (!rule.reads_input)
+            continue;
+        first = any ? std::min(first, rule.first) : rule.first;
+        last = any ? std::max(last, rule.last) : rule.last;
+        any = true;
+    }
+    return any;
+}
+
+void AlertEngine::set_log(const std::filesystem::path &path)
+{
+    std::unique_lock lk(mutex_);
+    log_ = path;
+}
+
+// Called with mutex_ held
+void AlertEngine::transition(AlertRule &rule, int state, Clock::time_point now)
+{
+    rule.state = state;
+    rule.since = now;
+
+    char stamp[32];
+    time_t t = time(nullptr);
+    tm local;
+    localtime_r(&t, &local);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+
+    char line[512];
+    snprintf(line, sizeof(line), "%s %s %s: %s = %.2f, %s %s (%.2f)", stamp, state == AlertState::Firing ? "FIRING" : "CLEARED", rule.name.c_str(),
+             rule.value.text().c_str(), rule.last_value, OPERATOR_TEXT[rule.op], rule.threshold.text().c_str(), rule.last_threshold);
+    printf("\r%s\n", line);
+
+    if (!log_.empty())
+    {
+        if (FILE *file = fopen(log_.c_str(), "a"))
+        {
+            fprintf(file, "%s\n", line);
+            fclose(file);
+        }
+    }
+
+    if (!rule.exec.empty())
+        run_hook(rule);
+}
@@ -0,0 +1,90 @@
+#ifndef ALERT_RULES_HPP
+#define ALERT_RULES_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "monitor_expr.hpp"
+
+namespace AlertState
+{
+    enum state_t
+    {
+        Normal = 0,
+        Pending, // condition holds, waiting for the "for" duration
+        Firing,
+    };
+}
+
+namespace AlertOp
+{
+    enum op_t
+    {
+        Less = 0,
+        LessEqual,
+        Greater,
+        GreaterEqual,
+        Equal,
+        NotEqual,
+    };
+}
+
+struct AlertRule
+{
+    std::string name;
+    MonitorExpression value;
+    int op; // AlertOp::op_t
+    MonitorExpression threshold;
+    double for_s{0};      // how long the condition must hold before firing
+    double hysteresis{0}; // a firing < or > rule clears only this far on the other side of the threshold
+    std::string exec;     // run through /bin/sh on every transition, empty - none
+    uint16_t first{0};    // input registers read by both expressions
+    uint16_t last{0};
+    bool reads_input{false};
+
+    int state{AlertState::Normal};
+    MonitorExpression::Clock::time_point since{}; // of the current state
+    double last_value{0};
+    double last_threshold{0};
+};
+
+// Threshold rules evaluated on every read of the input registers they use.
+// Each rule is a small state machine: the condition has to hold for the "for"
+// duration before it fires, and a firing rule clears once the value is back past
+// the threshold by the hysteresis. Transitions are printed, appended to the log
+// file and passed to the rule's hook command, which runs without being waited for.
+class AlertEngine
+{
+public:
+    using Clock = MonitorExpression::Clock;
+
+    // "name expr op value [for duration] [hysteresis h] [exec command]",
+    // prints what is wrong and returns -1 on bad input
+    int add(std::string_view line);
+    int remove(std::string_view name);
+    void show(void) const;
+
+    // After input registers [from, to] were read, runs every rule all of whose registers were
+    void evaluate(const uint16_t *input, const uint16_t *holding, uint16_t from, uint16_t to, Clock::time_point now = Clock::now());
+
+    // Input registers all rules together read, false when there are none
+    bool range(uint16_t &first, uint16_t &last) const;
+
+    // Transitions are appended here, e.g. cache_file(device_key, ".alerts.log")
+    void set_log(const std::filesystem::path &path);
+
+private:
+    void transition(AlertRule &rule, int state, Clock::time_point now);
+
+    mutable std::mutex mutex_;
+    std::vector<AlertRule> rules_;
+    std::filesystem::path log_;
+};
+
+extern AlertEngine g_alerts;
+
+#endif // ALERT_RULES_HPP
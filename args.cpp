@@ -0,0 +1,150 @@
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+
+#include "args.hpp"
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+ArgTokens::ArgTokens(std::string_view input)
+{
+    size_t pos = 0;
+    while (pos < input.size())
+    {
+        while (pos < input.size() && is_space(input[pos]))
+            pos++;
+        size_t start = pos;
+        while (pos < input.size() && !is_space(input[pos]))
+            pos++;
+        if (pos == start)
+            break;
+
+        if (count_ == MAX_ARGS)
+        {
+            overflow_ = true;
+            break;
+        }
+        tokens_[count_++] = input.substr(start, pos - start);
+    }
+}
+
+int parse_arg(std::string_view token, const ArgSpec &spec, int32_t &value, const char *&error)
+{
+    const char *first = token.data();
+    const char *last = token.data() + token.size();
+    if (!token.empty() && *first == '+')
+        first++;
+
+    switch (spec.type)
+    {
+    case Arg::Int:
+    {
+        int64_t number;
+        auto [ptr, ec] = std::from_chars(first, last, number);
+        if (ec != std::errc() || ptr != last)
+        {
+            error = "not a whole number";
+            return -1;
+        }
+        if (number < INT32_MIN / spec.scale || number > INT32_MAX / spec.scale)
+        {
+            error = "out of range";
+            return -1;
+        }
+        number *= spec.scale;
+        value = static_cast<int32_t>(number);
+        break;
+    }
+
+    case Arg::Float:
+    {
+        double number;
+        auto [ptr, ec] = std::from_chars(first, last, number);
+        if (ec != std::errc() || ptr != last || !std::isfinite(number))
+        {
+            error = "not a number";
+            return -1;
+        }
+        number = std::round(number * spec.scale);
+        if (number < INT32_MIN || number > INT32_MAX)
+        {
+            error = "out of range";
+            return -1;
+        }
+        value = static_cast<int32_t>(number);
+        break;
+    }
+
+    case Arg::Enum:
+        for (int32_t i = 0; spec.choices && spec.choices[i]; i++)
+        {
+            if (token == spec.choices[i])
+            {
+                value = i;
+                return 0;
+            }
+        }
+        error = "unknown choice";
+        return -1;
+
+    default:
+        error = "unsupported argument type";
+        return -1;
+    }
+
+    if (value < spec.min || value > spec.max)
+    {
+        error = "out of range";
+        return -1;
+    }
+    return 0;
+}
+
+static void print_expected(const ArgSpec &spec)
+{
+    if (spec.type == Arg::Enum)
+    {
+        printf("%s must be one of:", spec.name);
+        for (size_t i = 0; spec.choices && spec.choices[i]; i++)
+            printf(" %s", spec.choices[i]);
+        printf("\n");
+    }
+    else if (spec.scale == 1)
+    {
+        printf("%s must be within %ld..%ld\n", spec.name, static_cast<long>(spec.min), static_cast<long>(spec.max));
+    }
+    else
+    {
+        printf("%s must be within %g..%g\n", spec.name, static_cast<double>(spec.min) / spec.scale, static_cast<double>(spec.max) / spec.scale);
+    }
+}
+
+int parse_args(std::string_view input, std::span<const ArgSpec> specs, int32_t *values)
+{
+    ArgTokens tokens(input);
+    if (tokens.size() < specs.size())
+    {
+        printf("Too few parameters.\n");
+        return -1;
+    }
+    if (tokens.size() > specs.size() || tokens.overflow())
+    {
+        printf("Too many parameters.\n");
+        return -1;
+    }
+
+    for (size_t i = 0; i < specs.size(); i++)
+    {
+        const char *error{nullptr};
+        if (parse_arg(tokens[i], specs[i], values[i], error) == -1)
+        {
+            printf("%s \"%.*s\": %s\n", specs[i].name, static_cast<int>(tokens[i].size()), tokens[i].data(), error);
+            print_expected(specs[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+#ifndef ARGS_HPP
+#define ARGS_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+inline constexpr size_t MAX_ARGS = 8;
+
+// Whitespace separated words of a command line. The views point into the
+// parsed string, nothing is allocated.
+class ArgTokens
+{
+public:
+    explicit ArgTokens(std::string_view input);
+
+    size_t size(void) const { return count_; }
+    bool empty(void) const { return count_ == 0; }
+    bool overflow(void) const { return overflow_; } // more than MAX_ARGS words given
+    std::string_view operator[](size_t i) const { return tokens_[i]; }
+    const std::string_view *begin(void) const { return tokens_.data(); }
+    const std::string_view *end(void) const { return tokens_.data() + count_; }
+
+private:
+    std::array<std::string_view, MAX_ARGS> tokens_;
+    size_t count_{0};
+    bool overflow_{false};
+};
+
+namespace Arg
+{
+    enum arg_t
+    {
+        Int = 0, // whole number
+        Float,   // decimal number, e.g. 21.5
+        Enum,    // one of `choices`, the value is its index
+    };
+}
+
+// How one argument is turned into a register value. Numbers are multiplied by
+// `scale` (10 for 0.1 'C resolution, 100 for gains) and rounded, `min`/`max`
+// are checked afterwards, i.e. in register units.
+struct ArgSpec
+{
+    const char *name; // used in error messages
+    int type;         // Arg::arg_t
+    int32_t min;
+    int32_t max;
+    int32_t scale{1};
+    const char *const *choices{nullptr}; // Arg::Enum, nullptr terminated
+};
+
+inline constexpr ArgSpec ARG_UINT{"value", Arg::Int, 0, UINT16_MAX};
+inline constexpr ArgSpec ARG_INT{"value", Arg::Int, INT16_MIN, INT16_MAX};
+
+// Parses one token, on failure `error` says why and -1 is returned
+int parse_arg(std::string_view token, const ArgSpec &spec, int32_t &value, const char *&error);
+
+// Parses a whole command line against `specs`, one value per spec.
+// Prints what is wrong and returns -1 on any error.
+int parse_args(std::string_view input, std::span<const ArgSpec> specs, int32_t *values);
+
+#endif // ARGS_HPP
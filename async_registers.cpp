@@ -0,0 +1,247 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "async_registers.hpp"
+#include "frame_capture.hpp"
+#include "modbus_registers.h"
+#include "single_flight.hpp"
+#include "transport_stats.hpp"
+
+extern int updateHoldingRegister(uint16_t from, uint16_t to);
+extern int updateInputRegister(uint16_t from, uint16_t to);
+extern int writeRegister(uint16_t reg, uint16_t value);
+extern int admitHoldingWrite(uint16_t addr, uint16_t *values, uint16_t count);
+extern void inputRegistersLoaded(uint16_t from, uint16_t to);
+extern SingleFlight input_flights;
+extern std::mutex modbus_mutex; // guards the register model against the prompt thread
+
+AsyncRegisters::AsyncRegisters(Scheduler &sched, const std::string &host, uint16_t port, uint8_t unit_id, int timeout_ms)
+    : sched_(sched), host_(host), port_(port), unit_id_(unit_id), timeout_ms_(timeout_ms)
+{
+}
+
+AsyncRegisters::AsyncRegisters(Scheduler &sched)
+    : sched_(sched), blocking_(true)
+{
+}
+
+AsyncRegisters::~AsyncRegisters()
+{
+    close();
+}
+
+Task<int> AsyncRegisters::read_input(uint16_t from, uint16_t to)
+{
+    if (blocking_)
+        co_return updateInputRegister(from, to);
+
+    // a covering read is already on its way, from the prompt or another task
+    if (auto joined = input_flights.join(from, to))
+    {
+        int fd = input_flights.done_fd(*joined);
+        while (!joined->done && !sched_.stopping())
+        {
+            if (fd >= 0)
+                co_await sched_.readable(fd, Scheduler::Clock::time_point::max());
+            else
+                co_await sched_.sleep_for(std::chrono::milliseconds(10));
+        }
+        co_return joined->done ? joined->rc : -1;
+    }
+
+    // received into a buffer of its own, the model changes only under modbus_mutex like with the blocking reads
+    auto flight = input_flights.lead(from, to);
+    auto led = leading_.insert(leading_.end(), flight);
+    std::vector<uint16_t> values(to - from + 1);
+    int rc = co_await transact({unit_id_, Function_code::ReadInput, from, static_cast<uint16_t>(values.size()), values.data(), 0});
+    if (rc == 0)
+    {
+        {
+            std::unique_lock lk(modbus_mutex);
+            std::copy(values.begin(), values.end(), &inputRegisters[from]);
+        }
+        inputRegistersLoaded(from, to);
+    }
+    leading_.erase(led);
+    input_flights.finish(flight, rc);
+    co_return rc;
+}
+
+Task<int> AsyncRegisters::read_holding(uint16_t from, uint16_t to)
+{
+    if (blocking_)
+        co_return updateHoldingRegister(from, to);
+
+    std::vector<uint16_t> values(to - from + 1);
+    int rc = co_await transact({unit_id_, Function_code::ReadHolding, from, static_cast<uint16_t>(values.size()), values.data(), 0});
+    if (rc == 0)
+    {
+        std::unique_lock lk(modbus_mutex);
+        std::copy(values.begin(), values.end(), &holdingRegisters[from]);
+    }
+    co_return rc;
+}
+
+Task<int> AsyncRegisters::write(uint16_t reg, uint16_t value)
+{
+    if (blocking_)
+        co_return writeRegister(reg, value);
+
+    // checked (and clamped) like the blocking writes before anything is sent
+    if (int admitted = admitHoldingWrite(reg, &value, 1); admitted != 0)
+        co_return admitted == -1 ? -1 : 0;
+    co_return co_await transact({unit_id_, Function_code::WriteSingle, reg, 1, &value, 0});
+}
+
+void AsyncRegisters::cancel_all(void)
+{
+    while (!waiting_.empty())
+    {
+        waiting_.begin()->second->request->rc = -1;
+        complete(waiting_.begin());
+    }
+}
+
+void AsyncRegisters::abandon(void)
+{
+    cancel_all();
+    for (const auto &flight : leading_)
+        input_flights.finish(flight, -1);
+    leading_.clear();
+}
+
+void AsyncRegisters::ResponseAwaiter::await_suspend(std::coroutine_handle<> h)
+{
+    waiter.handle = h;
+    regs.waiting_[tid] = &waiter;
+    if (!regs.receiving_)
+    {
+        regs.receiving_ = true;
+        regs.sched_.spawn(regs.receiver());
+    }
+}
+
+Task<int> AsyncRegisters::transact(ModbusRequest request)
+{
+    if (connect() == -1)
+        co_return -1;
+
+    uint16_t tid = next_tid_++;
+    uint8_t frame[MBAP_MAX_ADU_LENGTH];
+    size_t length = encode_request(Framing::Tcp, request, tid, frame);
+    if (length == 0)
+        co_return -1;
+
+    if (::send(fd_, frame, length, MSG_NOSIGNAL) != static_cast<ssize_t>(length))
+    {
+        close();
+        co_return -1;
+    }
+    g_capture.record(Framing::Tcp, Capture::TxRequest, frame, length);
+
+    request.rc = -1;
+    g_transport_stats.transactions++;
+    co_await ResponseAwaiter{*this, tid, {&request, Scheduler::Clock::now() + std::chrono::milliseconds(timeout_ms_), {}}};
+    if (request.rc != 0)
+        g_transport_stats.errors++;
+    co_return request.rc;
+}
+
+// Reads responses for as long as anybody waits for one
+Task<> AsyncRegisters::receiver(void)
+{
+    uint8_t rx[MBAP_MAX_ADU_LENGTH * 4];
+    size_t rx_length = 0;
+
+    while (!waiting_.empty() && fd_ >= 0)
+    {
+        auto deadline = Scheduler::Clock::time_point::max();
+        for (const auto &[tid, waiter] : waiting_)
+            deadline = std::min(deadline, waiter->deadline);
+
+        if (!co_await sched_.readable(fd_, deadline))
+        {
+            auto now = Scheduler::Clock::now();
+            for (auto it = waiting_.begin(); it != waiting_.end();)
+            {
+                auto current = it++;
+                if (current->second->deadline <= now)
+                {
+                    g_capture.record_timeout(Framing::Tcp, unit_id_, current->second->request->function);
+                    complete(current);
+                }
+            }
+            continue;
+        }
+
+        ssize_t n = ::recv(fd_, &rx[rx_length], sizeof(rx) - rx_length, 0);
+        if (n < 0 && (errno == EAGAIN || errno == EINTR))
+            continue;
+        if (n <= 0)
+        {
+            close();
+            break;
+        }
+        rx_length += n;
+
+        // Decode every complete frame where it lies, then move the partial rest to the front once
+        size_t consumed = 0;
+        int frame_length;
+        while ((frame_length = mbap_frame_length(&rx[consumed], rx_length - consumed)) > 0)
+        {
+            const uint8_t *frame = &rx[consumed];
+            g_capture.record(Framing::Tcp, Capture::RxResponse, frame, frame_length);
+            auto it = waiting_.find(mbap_tid(frame));
+            if (it != waiting_.end())
+            {
+                decode_response(*it->second->request, &frame[MBAP_HEADER_LENGTH], frame_length - MBAP_HEADER_LENGTH);
+                complete(it);
+            }
+            consumed += frame_length;
+        }
+        if (frame_length == -1)
+        {
+            close();
+            break;
+        }
+        memmove(rx, &rx[consumed], rx_length - consumed);
+        rx_length -= consumed;
+    }
+
+    receiving_ = false;
+}
+
+int AsyncRegisters::connect(void)
+{
+    if (fd_ >= 0)
+        return 0;
+
+    fd_ = tcp_connect(host_, port_);
+    if (fd_ < 0)
+        return -1;
+
+    fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_NONBLOCK);
+    return 0;
+}
+
+void AsyncRegisters::close(void)
+{
+    if (fd_ >= 0)
+        ::close(fd_);
+    fd_ = -1;
+    cancel_all();
+}
+
+void AsyncRegisters::complete(std::map<uint16_t, Waiter *>::iterator it)
+{
+    auto handle = it->second->handle;
+    waiting_.erase(it);
+    sched_.post(handle);
+}
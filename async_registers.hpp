@@ -0,0 +1,82 @@
+#ifndef ASYNC_REGISTERS_HPP
+#define ASYNC_REGISTERS_HPP
+
+#include <coroutine>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "modbus_pipeline.hpp"
+#include "scheduler.hpp"
+#include "single_flight.hpp"
+
+// Awaitable register operations, e.g.
+//     int rc = co_await regs.read_input(from, to);
+// Results land in inputRegisters/holdingRegisters under modbus_mutex like with the blocking helpers.
+// Every operation resolves to 0 on success, -1 on transport error, timeout or a refused write
+// and a positive modbus exception code otherwise.
+//
+// With a TCP endpoint all operations share one non-blocking connection and
+// any number of them may be in flight. Without one (RTU) the blocking helpers
+// are called instead and operations complete before they suspend.
+class AsyncRegisters
+{
+public:
+    AsyncRegisters(Scheduler &sched, const std::string &host, uint16_t port, uint8_t unit_id, int timeout_ms = 2000);
+    explicit AsyncRegisters(Scheduler &sched);
+    ~AsyncRegisters();
+
+    AsyncRegisters(const AsyncRegisters &) = delete;
+    AsyncRegisters &operator=(const AsyncRegisters &) = delete;
+
+    Task<int> read_input(uint16_t from, uint16_t to);
+    Task<int> read_holding(uint16_t from, uint16_t to);
+    Task<int> write(uint16_t reg, uint16_t value);
+
+    // Completes every outstanding operation with -1
+    void cancel_all(void);
+    // After the scheduler stopped for good: fails the input flights read_input()
+    // leads, threads sharing them would wait forever for coroutines which never resume
+    void abandon(void);
+
+private:
+    struct Waiter
+    {
+        ModbusRequest *request;
+        Scheduler::Clock::time_point deadline;
+        std::coroutine_handle<> handle;
+    };
+
+    struct ResponseAwaiter
+    {
+        AsyncRegisters &regs;
+        uint16_t tid;
+        Waiter waiter;
+
+        bool await_ready(void) const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h);
+        void await_resume(void) const noexcept {}
+    };
+
+    Task<int> transact(ModbusRequest request);
+    Task<> receiver(void);
+    int connect(void);
+    void close(void);
+    void complete(std::map<uint16_t, Waiter *>::iterator it);
+
+    Scheduler &sched_;
+    std::string host_;
+    uint16_t port_{0};
+    uint8_t unit_id_{0};
+    int timeout_ms_{0};
+    bool blocking_{false};
+    int fd_{-1};
+    uint16_t next_tid_{0};
+    bool receiving_{false};
+    std::map<uint16_t, Waiter *> waiting_;
+    std::list<std::shared_ptr<SingleFlight::Flight>> leading_; // input_flights led by read_input()
+};
+
+#endif // ASYNC_REGISTERS_HPP
@@ -4,19 +4,24 @@
 #include <vector>
 #include <vector>
 #include <set>
-#include <sstream>
-#include <iomanip>
+#include <charconv>
 
 #include "cli_commands.hpp"
 #include "lookup_table.hpp"
 #include "struct.h"
 #include "modbus_registers.h"
+#include "register_table.hpp"
+#include "report.hpp"
+#include "args.hpp"
 
 #if defined PICO_ON_DEVICE
 #include "settings.hpp"
 #include "pico/unique_id.h"
 #include "stopwatch.hpp"
 #include "lns.h"
+#else
+#include "device_caps.hpp"
+#include "countdown.hpp"
 #endif
 
 #include "nanomodbus.h"
@@ -26,7 +31,6 @@ using namespace std::literals;
 #ifdef WIRELESS
 #include "wireless.hpp"
 #endif
-using Tokens = std::vector<std::string>;
 uint32_t git_hash{0};
 
 #if !defined PICO_ON_DEVICE // linux
@@ -47,67 +51,54 @@ extern size_t getHash(const std::string &unique_id_str, size_t depth);
 
 extern uint8_t g_operationMode;
 
-void holding_registers_show_all(void)
+// Seconds left on a countdown register. On Linux the model extrapolates it
+// between reads, on the device the register table is always current.
+static uint16_t countdown(uint16_t reg)
 {
-    for (size_t reg = 0; reg < e_holding_last_item; reg++)
-    {
-        printf("register[%zu] = %d \t[ %s ]\n", reg, (int16_t)holdingRegisters[reg], holdingRegToStr(reg));
-    }
+#if defined PICO_ON_DEVICE
+    return inputRegisters[reg];
+#else
+    return g_countdowns.remaining(reg, inputRegisters[reg]);
+#endif
 }
 
-std::set<uint16_t> registers_to_show(std::vector<std::string> &tokens, size_t max)
+// "all", single numbers and ranges like 5-10, empty set on bad input
+std::set<uint16_t> registers_to_show(const ArgTokens &tokens, size_t max)
 {
     std::set<uint16_t> registers;
-    uint16_t num1 = 0, num2 = 0;
-    for (auto &token : tokens)
+    const ArgSpec spec{"register", Arg::Int, 0, static_cast<int32_t>(max)};
+    for (auto token : tokens)
     {
-        int count = -1;
-        count = sscanf(token.c_str(), "%hu-%hu", &num1, &num2);
-
-        if (num2 > max) // check against malicious input
+        if (token == "all")
         {
-            printf("Number %u (or %d) is out of available register range\n", num2, (int16_t)num2);
-            registers.clear();
-            return registers;
+            for (uint16_t i = 0; i <= max; i++)
+                registers.insert(i);
+            continue;
         }
 
-        if (num1 > max) // check against malicious input
+        auto dash = token.find('-', 1);
+        int32_t num1, num2;
+        const char *error;
+        if (parse_arg(token.substr(0, dash), spec, num1, error) == -1 ||
+            (dash != std::string_view::npos && parse_arg(token.substr(dash + 1), spec, num2, error) == -1))
         {
-            printf("Number %u (or %d) is out of available register range\n", num1, (int16_t)num1);
+            printf("%.*s: %s (0..%zu)\n", static_cast<int>(token.size()), token.data(), error, max);
             registers.clear();
             return registers;
         }
-        if (0 == count)
-        {
-            printf("Incorrect syntax.\n");
-            return registers;
-        }
-
-        if (1 == count)
-        {
-            registers.insert(num1);
-        }
 
-        if (2 == count)
-        {
-            for (uint16_t i = num1; i <= num2; i++)
-            {
-                registers.insert(i);
-            }
-        }
+        if (dash == std::string_view::npos)
+            num2 = num1;
+        for (int32_t i = num1; i <= num2; i++)
+            registers.insert(static_cast<uint16_t>(i));
     }
 
     return registers;
 }
 
 // Show registers function
-void show_holding_registers(std::vector<std::string> &tokens)
+void show_holding_registers(const ArgTokens &tokens)
 {
-    if (!tokens.empty() && tokens[0] == "all")
-    {
-        tokens[0] = "0-" + std::to_string(e_holding_last_item - 1);
-    }
-
     std::set<uint16_t> registers = registers_to_show(tokens, e_holding_last_item - 1);
 
     if (tokens.size() == 0)
@@ -115,67 +106,51 @@ void show_holding_registers(std::vector<std::string> &tokens)
         printf("Example usage : %s 1 2 5-10 15 16\n", __func__);
         return;
     }
-    printf("Showing %2zu registers:\n", registers.size());
-
 #if !defined PICO_ON_DEVICE
     if (!registers.empty())
         updateHoldingRegister(*registers.begin(), *registers.rbegin());
 #endif
 
+    Report report;
+    char heading[32];
+    snprintf(heading, sizeof(heading), "Showing %2zu registers:", registers.size());
+    report.heading(heading);
     for (auto &reg : registers)
     {
         if (reg < e_holding_last_item)
-            printf("register[%u] = %u\t(%s)\n", reg, holdingRegisters[reg], holdingRegToStr(reg));
+            report.indexed("holding", reg, holdingRegToStr(reg), holdingRegisters[reg]);
         else
             printf("%u is too big!\n", reg);
     }
 }
 
-void show_input_registers(std::vector<std::string> &tokens)
+void show_input_registers(const ArgTokens &tokens)
 {
-    if (!tokens.empty() && tokens[0] == "all")
-    {
-        tokens[0] = "0-" + std::to_string(e_input_last_item - 1);
-    }
-
-    std::set<uint16_t> registers = registers_to_show(tokens, e_input_last_item);
+    std::set<uint16_t> registers = registers_to_show(tokens, e_input_last_item - 1);
 
     if (tokens.size() == 0)
     {
         printf("Example usage : %s 1 2 5-10 15 16\n", __func__);
         return;
     }
-    printf("Showing %2zu registers:\n", registers.size());
-
 #if !defined PICO_ON_DEVICE
     if (!registers.empty())
         updateInputRegister(*registers.begin(), *registers.rbegin());
 #endif
 
+    Report report;
+    char heading[32];
+    snprintf(heading, sizeof(heading), "Showing %2zu registers:", registers.size());
+    report.heading(heading);
     for (auto &reg : registers)
     {
         if (reg < e_input_last_item)
-            printf("register[%u] = %u\t(%s)\n", reg, inputRegisters[reg], inputRegToStr(reg));
+            report.indexed("input", reg, inputRegToStr(reg), inputRegisters[reg]);
         else
             printf("%u is too big!\n", reg);
     }
 }
 
-std::vector<std::string> tokenize(const std::string &input)
-{
-    std::vector<std::string> retval;
-    std::stringstream ss(input);
-    std::string token;
-    retval.reserve(4);
-    while (ss.good())
-    {
-        ss >> token;
-        if (!token.empty())
-            retval.emplace_back(std::move(token));
-    }
-    return retval;
-}
-
 // Set register function
 void set_register(unsigned int reg_number, int value)
 {
@@ -192,7 +167,7 @@ void callback(int id, const std::string &str)
 {
     if (str.empty())
         return;
-    Tokens tokens = tokenize(str);
+    ArgTokens tokens(str);
 
     switch (id)
     {
@@ -205,54 +180,55 @@ void callback(int id, const std::string &str)
         return;
 
     case 2:
-        if (tokens.size() < 2)
-        {
-            printf("Too few parameters.\n");
-            return;
-        }
-        else if (tokens.size() > 2)
-        {
-            printf("Too many parameters.\n");
-            return;
-        }
-
-        set_register(std::stoi(tokens[0]), std::stoi(tokens[1]));
+    {
+        static constexpr ArgSpec specs[] = {
+            {"register", Arg::Int, 0, e_holding_last_item - 1},
+            {"value", Arg::Int, INT16_MIN, UINT16_MAX},
+        };
+        int32_t values[std::size(specs)];
+        if (parse_args(str, specs, values) == 0)
+            set_register(values[0], values[1]);
         return;
+    }
 
     default:
         printf("Received : id=%d arg=[%s]\n ", id, str.c_str());
     }
 }
 
+// Holding register in engineering units, scale and unit from the register table
+static void setting(Report &report, std::string_view key, std::string_view label, uint16_t reg)
+{
+    const auto &desc = holding_register(reg);
+    report.number(key, label, desc.to_engineering(holdingRegisters[reg]), desc.precision(), desc.unit);
+}
+
 void show_defrost(void)
 {
+    Report report;
     if (g_defrost_request) // TODO print which condition is met
     {
-        printf("Defrost already pending.\n");
+        report.message("defrost_state", "Defrost already pending.");
 #if defined PICO_ON_DEVICE
-        printf("Time remaining to finish : %lu s\n", holdingRegisters[e_defrost_max_duration] * 60 - g_defrost_timer.getSec());
+        report.integer("defrost_remaining", "Time remaining to finish", holdingRegisters[e_defrost_max_duration] * 60 - g_defrost_timer.getSec(), "s");
 #endif
-        printf("Temperature delta to finish : ");
-        if ((int16_t)inputRegisters[e_condenser_temp] >= 0)
-            printf("%2.1f-%2.1f=%2.1f ['C]\n", holdingRegisters[e_defrost_end_t3_target] / 10.0, (int16_t)inputRegisters[e_condenser_temp] / 10.0, (holdingRegisters[e_defrost_end_t3_target] - (int16_t)inputRegisters[e_condenser_temp]) / 10.0);
-        else
-            printf("%2.1f+%2.1f=%2.1f ['C]\n", holdingRegisters[e_defrost_end_t3_target] / 10.0, -(int16_t)inputRegisters[e_condenser_temp] / 10.0, (holdingRegisters[e_defrost_end_t3_target] - (int16_t)inputRegisters[e_condenser_temp]) / 10.0);
+        report.number("defrost_t3_delta", "Temperature delta to finish", (holdingRegisters[e_defrost_end_t3_target] - (int16_t)inputRegisters[e_condenser_temp]) / 10.0, 1, "'C");
     }
     else if (g_operationMode == Operation::Heating)
     {
-        printf("%u s till defrost\n", inputRegisters[e_till_defrost]);
+        report.integer("till_defrost", "Time till defrost", countdown(e_till_defrost), "s");
     }
     else
     {
-        printf("No pending defrost, and it's not going to happen.\n");
+        report.message("defrost_state", "No pending defrost, and it's not going to happen.");
     }
 
-    printf("pre-defrost min interval                    %u [min]\n", holdingRegisters[e_defrost_min_interval]);
-    printf("pre-defrost max odu t4-t3 delta           %4.1f ['K]\n", holdingRegisters[e_defrost_max_odu_delta] / 10.0);
-    printf("pre-defrost max t30-t3 drop               %4.1f ['K]\n", holdingRegisters[e_defrost_max_t3_drop] / 10.0);
-    printf("Defrost target T3 temperature             %4.1f ['C]\n", holdingRegisters[e_defrost_end_t3_target] / 10.0);
-    printf("Defrost compressor max speed                %u [Hz]\n", holdingRegisters[e_defrost_max_frequency]);
-    printf("Defrost max duration                        %u [min]\n", holdingRegisters[e_defrost_max_duration]);
+    setting(report, "defrost_min_interval", "pre-defrost min interval", e_defrost_min_interval);
+    setting(report, "defrost_max_odu_delta", "pre-defrost max odu t4-t3 delta", e_defrost_max_odu_delta);
+    setting(report, "defrost_max_t3_drop", "pre-defrost max t30-t3 drop", e_defrost_max_t3_drop);
+    setting(report, "defrost_t3_target", "Defrost target T3 temperature", e_defrost_end_t3_target);
+    setting(report, "defrost_max_frequency", "Defrost compressor max speed", e_defrost_max_frequency);
+    setting(report, "defrost_max_duration", "Defrost max duration", e_defrost_max_duration);
 }
 
 void show_settings()
@@ -277,9 +253,10 @@ void show_settings()
         break;
     }
 
-    printf("Current settings:\n");
-    printf("Type of power control                       %s\n", tempStr.c_str());
-    printf("Type of temperature control                 %s\n", holdingRegisters[e_curve_active] == 0 ? "Static" : "Dynamic");
+    Report report;
+    report.heading("Current settings:");
+    report.text("power_control", "Type of power control", tempStr);
+    report.text("temperature_control", "Type of temperature control", holdingRegisters[e_curve_active] == 0 ? "Static" : "Dynamic");
     show_pid();
     show_temperature();
     show_bivalent();
@@ -287,22 +264,21 @@ void show_settings()
     show_defrost();
 #endif
 
-    printf("T2_low temperature alarm value            %2.1f ['C]\n", (((int16_t)holdingRegisters[e_t2_low_alarm_value]) / 10.0));
-    printf("Flow_low alarm value                       %u [Hz]\n", (holdingRegisters[e_minimal_flow]));
+    setting(report, "t2_low_alarm", "T2_low temperature alarm value", e_t2_low_alarm_value);
+    setting(report, "flow_low_alarm", "Flow_low alarm value", e_minimal_flow);
 #ifndef MULTISPLIT
     show_oil();
 #endif
-    printf("DHW heating level                          %2u [%%]\n", (holdingRegisters[e_dhw_level]));
 
     show_relay_functions();
     show_input_functions();
 
 #ifdef WIRELESS
-    printf("Wifi SSID name :                           %s\n", wifi_ssid.c_str());
-    printf("Wifi PASSWORD  :                           %s\n", hidden_password(wifi_pass).c_str());
+    report.text("wifi_ssid", "Wifi SSID name", wifi_ssid);
+    report.text("wifi_password", "Wifi PASSWORD", hidden_password(wifi_pass));
 #endif
 #ifdef MULTISPLIT
-    printf("Multisplit power selector position     (%01X)%u\n", holdingRegisters[e_multisplit_power_option], holdingRegisters[e_multisplit_power_option]);
+    setting(report, "multisplit_power_option", "Multisplit power selector position", e_multisplit_power_option);
 #endif
     // TODO: function parsing power selector to horse-power notation
 }
@@ -319,82 +295,58 @@ void set_relay_polarity(uint8_t relay_no, const std::string &str)
 
 void show_relay_functions()
 {
-    printf("ALARM relay function                       %s\n", getRelayModeStr(holdingRegisters[e_alarm_relay_function]).c_str());
-    printf("ALARM relay polarity                       %s\n", bis(holdingRegisters[e_relay_polarity], 0) ? "N.C." : "N.O.");
-    printf("DEFROST relay function                     %s\n", getRelayModeStr(holdingRegisters[e_defrost_relay_function]).c_str());
-    printf("DEFROST relay polarity                     %s\n", bis(holdingRegisters[e_relay_polarity], 1) ? "N.C." : "N.O.");
+    Report report;
+    report.text("alarm_relay_function", "ALARM relay function", getRelayModeStr(holdingRegisters[e_alarm_relay_function]));
+    report.text("alarm_relay_polarity", "ALARM relay polarity", bis(holdingRegisters[e_relay_polarity], 0) ? "N.C." : "N.O.");
+    report.text("defrost_relay_function", "DEFROST relay function", getRelayModeStr(holdingRegisters[e_defrost_relay_function]));
+    report.text("defrost_relay_polarity", "DEFROST relay polarity", bis(holdingRegisters[e_relay_polarity], 1) ? "N.C." : "N.O.");
 }
 
 void show_control(void)
 {
-    printf("Control set to %s\n", controlToSv(holdingRegisters[e_control_mode]).data());
+    Report report;
+    report.text("control", "Control set to", controlToSv(holdingRegisters[e_control_mode]));
 }
 
 void show_dhw(void)
 {
-    const char *prefix = "DHW";
-    printf("%s Mode                                    %s\n", prefix, getDHWModeStr(holdingRegisters[e_dhw_mode]));
-    printf("%s Target temeprature                   %4.1f ['C]\n", prefix, holdingRegisters[e_dhw_target_temperature] / 10.0);
-    printf("%s Target level                         %4u [%%]\n", prefix, holdingRegisters[e_dhw_level]);
+    Report report;
+    report.text("dhw_mode", "DHW Mode", getDHWModeStr(holdingRegisters[e_dhw_mode]));
+    setting(report, "dhw_target_temperature", "DHW Target temperature", e_dhw_target_temperature);
+    setting(report, "dhw_level", "DHW Target level", e_dhw_level);
 }
 
 void show_bivalent(void)
 {
-    const char *prefix = "Bivalent";
-    printf("%s0 temeprature                        %4.1f ['C]\n", prefix, ((int16_t)holdingRegisters[e_bivalent0_temp]) / 10.0);
-    printf("%s0 hysteresis                          %4.1f ['K]\n", prefix, ((int16_t)holdingRegisters[e_bivalent0_hysteresis]) / 10.0);
-    printf("%s0 level                               %4u [%%]\n", prefix, holdingRegisters[e_bivalent0_level]);
-    printf("%s1 temeprature                        %4.1f ['C]\n", prefix, ((int16_t)holdingRegisters[e_bivalent1_temp]) / 10.0);
-    printf("%s1 hysteresis                          %4.1f ['K]\n", prefix, ((int16_t)holdingRegisters[e_bivalent1_hysteresis]) / 10.0);
-
+    Report report;
+    setting(report, "bivalent0_temperature", "Bivalent0 temperature", e_bivalent0_temp);
+    setting(report, "bivalent0_hysteresis", "Bivalent0 hysteresis", e_bivalent0_hysteresis);
+    setting(report, "bivalent0_level", "Bivalent0 level", e_bivalent0_level);
+    setting(report, "bivalent1_temperature", "Bivalent1 temperature", e_bivalent1_temp);
+    setting(report, "bivalent1_hysteresis", "Bivalent1 hysteresis", e_bivalent1_hysteresis);
 }
 
 void show_temperature(void)
 {
-    printf("Actual temperature target                %4.1f ['C]\n", inputRegisters[e_temp_setpoint_ro] / 10.0);
-    printf("Set temperature target                   %4.1f ['C]\n", holdingRegisters[e_temp_setpoint] / 10.0);
-    printf("Upper delta treshold                    +%4.1f ['K]\n", holdingRegisters[e_high_delta] / 10.0);
-    printf("Lower delta treshold                    -%4.1f ['K]\n", holdingRegisters[e_low_delta] / 10.0);
-    printf("Dynamic temperature gain factor          %4.2f\n", holdingRegisters[e_curve_gain] / 100.0);
-    printf("Dynamic temperature offset value         %4.1f ['K]\n", ((int16_t)holdingRegisters[e_curve_offset]) / 10.0);
-    printf("Auto-OFF delay time                      %4u [min]\n", holdingRegisters[e_off_delay]);
-    printf("Minimum OFF -> ON interval               %4u [min]\n", holdingRegisters[e_on_off_interval]);
-    printf("Remaining time until next start          %4u [s]\n", inputRegisters[e_interval_on_off_remaining]);
-    printf("Ambient temperature range scope          %4u [h]\n", holdingRegisters[e_ambient_temp_scope]);
+    Report report;
+    report.number("temperature_target_actual", "Actual temperature target", inputRegisters[e_temp_setpoint_ro] / 10.0, 1, "'C");
+    setting(report, "temperature_target", "Set temperature target", e_temp_setpoint);
+    setting(report, "high_delta", "Upper delta treshold", e_high_delta);
+    setting(report, "low_delta", "Lower delta treshold (target -)", e_low_delta); // stored positive, as the setter takes it
+    setting(report, "curve_gain", "Dynamic temperature gain factor", e_curve_gain);
+    setting(report, "curve_offset", "Dynamic temperature offset value", e_curve_offset);
+    setting(report, "off_delay", "Auto-OFF delay time", e_off_delay);
+    setting(report, "on_off_interval", "Minimum OFF -> ON interval", e_on_off_interval);
+    report.integer("on_off_remaining", "Remaining time until next start", countdown(e_interval_on_off_remaining), "s");
+    setting(report, "ambient_temp_scope", "Ambient temperature range scope", e_ambient_temp_scope);
     show_dhw();
 }
 
 std::string to_string_with_precision(float value, int precision = 1)
 {
-    std::ostringstream out;
-    out << std::fixed << std::setprecision(precision) << value;
-    return out.str();
-}
-
-int8_t getInputRegScaleFactor(uint16_t reg)
-{
-    switch (reg)
-    {
-    case e_discharge_temp:
-    case e_condenser_temp:
-    case e_ambient_temp:
-    case e_indoor_temp:
-    case e_evaporator_temp:
-    case e_curve_offset_ro:
-    case e_water_in_ro:
-    case e_refrigerant_in:
-    case e_refrigerant_out:
-    case e_COP:
-    case e_pid_p_component:
-    case e_pid_i_component:
-    case e_pid_d_component:
-        return -1;
-
-    default:
-        return 0;
-    }
-
-    return 0;
+    char digits[32];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::fixed, precision);
+    return std::string(digits, result.ec == std::errc() ? result.ptr : digits);
 }
 
 #if defined PICO_ON_DEVICE
@@ -430,48 +382,75 @@ void system_info(void)
         printf("License invalid :(\n");
         figlarz = 0;
     }
+#else
+    Report report;
+    print_capabilities(g_caps);
+    report.integer("compressor_min_frequency", "Compressor min frequency", inputRegisters[e_compressor_min_frequency], "Hz");
+    report.integer("compressor_max_frequency", "Compressor max frequency", inputRegisters[e_compressor_max_frequency], "Hz");
 #endif
 }
 
 void show_input_functions()
 {
-    const char *suffix = " input function                        ";
-    printf("HEAT%s%s\n", suffix, getInputModeStr(holdingRegisters[e_heat_input_function]).c_str());
-    printf("COOL%s%s\n", suffix, getInputModeStr(holdingRegisters[e_cool_input_function]).c_str());
+    Report report;
+    report.text("heat_input_function", "HEAT input function", getInputModeStr(holdingRegisters[e_heat_input_function]));
+    report.text("cool_input_function", "COOL input function", getInputModeStr(holdingRegisters[e_cool_input_function]));
 }
 
 void show_pid(void)
 {
-    const char *prefix = "PID ";
-    printf("%sK_p                                  %4.1f\n", prefix, (holdingRegisters[e_Kp_factor] / 10.0));
-    printf("%sK_i                                  %4.2f\n", prefix, (holdingRegisters[e_Ki_factor] / 100.0));
-    printf("%sK_d                                  %4.1f\n", prefix, (holdingRegisters[e_Kd_factor] / 10.0));
-    printf("%ssampling time                        %4u [s]\n", prefix, (holdingRegisters[e_pid_sampling_time]));
-    printf("%shysteresis                           %4.1f ['K]\n", prefix, (holdingRegisters[e_pid_hysteresis] / 10.0));
-    printf("%sC_p                                  %4.1f\n", prefix, ((int16_t)inputRegisters[e_pid_p_component]) / 10.0);
-    printf("%sC_i                                  %4.1f\n", prefix, ((int16_t)inputRegisters[e_pid_i_component]) / 10.0);
-    printf("%sC_d                                  %4.1f\n", prefix, ((int16_t)inputRegisters[e_pid_d_component]) / 10.0);
+    Report report;
+    setting(report, "pid_kp", "PID K_p", e_Kp_factor);
+    setting(report, "pid_ki", "PID K_i", e_Ki_factor);
+    setting(report, "pid_kd", "PID K_d", e_Kd_factor);
+    setting(report, "pid_sampling_time", "PID sampling time", e_pid_sampling_time);
+    setting(report, "pid_hysteresis", "PID hysteresis", e_pid_hysteresis);
+    report.number("pid_cp", "PID C_p", ((int16_t)inputRegisters[e_pid_p_component]) / 10.0, 1);
+    report.number("pid_ci", "PID C_i", ((int16_t)inputRegisters[e_pid_i_component]) / 10.0, 1);
+    report.number("pid_cd", "PID C_d", ((int16_t)inputRegisters[e_pid_d_component]) / 10.0, 1);
 }
 
 void show_softstart(void)
 {
-    printf("Pre-heat temperature limit            %4.1f ['C]\n", (holdingRegisters[e_preheat_temp] / 10.0));
-    printf("Pre-cool temperature limit            %4.1f ['C]\n", (holdingRegisters[e_precool_temp] / 10.0));
-    printf("Pre hysteresis                        %4.1f ['K]\n", (holdingRegisters[e_pre_hysteresis] / 10.0));
-    printf("T2 temperature                        %4.1f\n", ((int16_t)inputRegisters[e_evaporator_temp]) / 10.0);
-    printf("Pre-heat state                        %u\n", g_preheat_request);
+    Report report;
+    setting(report, "preheat_temperature", "Pre-heat temperature limit", e_preheat_temp);
+    setting(report, "precool_temperature", "Pre-cool temperature limit", e_precool_temp);
+    setting(report, "pre_hysteresis", "Pre hysteresis", e_pre_hysteresis);
+    report.number("t2", "T2 temperature", ((int16_t)inputRegisters[e_evaporator_temp]) / 10.0, 1, "'C");
+    report.integer("preheat_state", "Pre-heat state", g_preheat_request);
 }
 
 #ifndef MULTISPLIT
 void show_oil(void)
 {
-    const char *prefix = "Oil recovery ";
-    printf("%slower comp limit            %4u [Hz]\n", prefix, (holdingRegisters[e_oil_recovery_low_freq]));
-    printf("%stime below limit            %4u [min]\n", prefix, (holdingRegisters[e_oil_recovery_low_time]));
-    printf("%sLVL restore.                %4u [Hz]\n", prefix, (holdingRegisters[e_oil_recovery_restore_freq]));
-    printf("Next oil recovery in                     %4u [s]\n", inputRegisters[e_time_to_oil_recovery]);
+    Report report;
+    setting(report, "oil_low_frequency", "Oil recovery lower comp limit", e_oil_recovery_low_freq);
+    setting(report, "oil_low_time", "Oil recovery time below limit", e_oil_recovery_low_time);
+    setting(report, "oil_restore_frequency", "Oil recovery LVL restore.", e_oil_recovery_restore_freq);
+    report.integer("oil_next_recovery", "Next oil recovery in", countdown(e_time_to_oil_recovery), "s");
 }
 #endif
+void show_operation(void)
+{
+    Report report;
+    report.text("operation_mode", "Set operation mode", operationToString(holdingRegisters[e_mode]));
+    report.text("operation_mode_actual", "Actual operation mode", operationToString(inputRegisters[e_operation_mode_ro]));
+}
+
+void show_level(void)
+{
+    Report report;
+    setting(report, "level", "Power level set", e_level);
+    report.integer("level_actual", "Power level actual", inputRegisters[e_powerLevel_100], "%");
+}
+
+void show_temperature_target(void)
+{
+    Report report;
+    setting(report, "temperature_target", "Temperature static setpoint", e_temp_setpoint);
+    report.number("temperature_target_actual", "Temperature actual setpoint", inputRegisters[e_temp_setpoint_ro] / 10.0, 1, "'C");
+}
+
 const char *operationToString(uint16_t num)
 {
 
@@ -490,17 +469,37 @@ const char *operationToString(uint16_t num)
     return "?";
 }
 
+// Rebuilt only when the flow calibration registers (e_flow_x1..e_flow_y3) change
+static const LookupTable<int32_t, 4> &flow_table(void)
+{
+    static constexpr size_t CALIBRATION_REGISTERS = e_flow_y3 - e_flow_x1 + 1;
+    static LookupTable<int32_t, 4> table;
+    static uint16_t calibration[CALIBRATION_REGISTERS];
+    static bool built{false};
+
+    const uint16_t *current = &holdingRegisters[e_flow_x1];
+    if (!built || memcmp(calibration, current, sizeof(calibration)) != 0)
+    {
+        table = LookupTable<int32_t, 4>({
+            {0, 0},
+            {holdingRegisters[e_flow_x1], holdingRegisters[e_flow_y1]},
+            {holdingRegisters[e_flow_x2], holdingRegisters[e_flow_y2]},
+            {holdingRegisters[e_flow_x3], holdingRegisters[e_flow_y3]},
+        });
+        memcpy(calibration, current, sizeof(calibration));
+        built = true;
+    }
+    return table;
+}
+
 uint16_t hz_to_ltr_hr(uint16_t freq)
 {
-    LookupTable<int32_t> ltr_table({
-        // Think how this could be optimized
-        {0, 0},
-        {holdingRegisters[e_flow_x1], holdingRegisters[e_flow_y1]},
-        {holdingRegisters[e_flow_x2], holdingRegisters[e_flow_y2]},
-        {holdingRegisters[e_flow_x3], holdingRegisters[e_flow_y3]},
-    });
+    return flow_table().get(freq);
+}
 
-    return ltr_table.get(freq);
+void hz_to_ltr_hr(std::span<const uint16_t> freq, std::span<uint16_t> ltr_hr)
+{
+    flow_table().get(freq, ltr_hr);
 }
 
 void calculate_curve(float x1, float y1, float x2, float y2)
@@ -515,25 +514,26 @@ void calculate_curve(float x1, float y1, float x2, float y2)
 
 void calculate_curve(const std::string &str)
 {
-    Tokens tokens = tokenize(str);
-    if (tokens.size() != 4)
+    static constexpr ArgSpec specs[] = {
+        {"T_ambient1", Arg::Float, -1000, 1000, 10},
+        {"T_supply1", Arg::Float, -1000, 1000, 10},
+        {"T_ambient2", Arg::Float, -1000, 1000, 10},
+        {"T_supply2", Arg::Float, -1000, 1000, 10},
+    };
+    int32_t t[std::size(specs)];
+    if (parse_args(str, specs, t) == -1)
     {
         printf("Usage : give 4 parameters, T_ambient1, T_supply1, T_ambient2, T_supply2\n");
         return;
     }
 
-    float x1, x2, y1, y2;
-    if (tokens[0] == tokens[2] || tokens[1] == tokens[3])
+    if (t[0] == t[2] || t[1] == t[3])
     {
         printf("Temperatures must not be the same.\n");
         return;
     }
-    x1 = std::stof(tokens[0]);
-    y1 = std::stof(tokens[1]);
-    x2 = std::stof(tokens[2]);
-    y2 = std::stof(tokens[3]);
 
-    calculate_curve(x1, y1, x2, y2);
+    calculate_curve(t[0] / 10.0f, t[1] / 10.0f, t[2] / 10.0f, t[3] / 10.0f);
 }
 
 void test_flow_value(int16_t val)
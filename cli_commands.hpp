@@ -3,6 +3,7 @@
 
 #include <string>
 #include <cstdint>
+#include <span>
 #include <vector>
 
 void show_settings(void);
@@ -15,24 +16,25 @@ void show_relay_functions();
 void show_input_functions();
 void system_info(void);
 void test_flow_value(int16_t val);
+uint16_t hz_to_ltr_hr(uint16_t freq);
+// Whole recordings at once, min(freq.size(), ltr_hr.size()) samples
+void hz_to_ltr_hr(std::span<const uint16_t> freq, std::span<uint16_t> ltr_hr);
 void show_dhw(void);
 void show_bivalent(void);
 void test_equithermal_curve(int16_t ambient_temp);
 void callback(int id, const std::string &str);
-void holding_registers_show_all(void);
+void set_register(unsigned int reg_number, int value);
 const char *operationToString(uint16_t num);
 const char *getDHWModeStr(uint16_t mode);
 std::string_view controlToSv(uint16_t val);
 std::string getRelayModeStr(uint16_t mask);
 std::string getInputModeStr(uint16_t mask);
-std::vector<std::string> tokenize(const std::string &input);
 void monitor_add(const std::string &str);
 void monitor_remove(const std::string &str);
 void monitor_clear(void);
 void monitor_show(void);
 void show_defrost(void);
 std::string to_string_with_precision(float value, int precision);
-int8_t getInputRegScaleFactor(uint16_t reg);
 float curve(float t4, float A, float B);
 extern size_t getHash(const std::string &unique_id_str, size_t depth);
 void calculate_curve(const std::string &str);
@@ -40,6 +42,9 @@ void calculate_curve(float x1, float y1, float x2, float y2);
 void set_relay_polarity(uint8_t relay_no, const std::string &str);
 std::string get_unique_id_string();
 void show_softstart(void);
+void show_operation(void);
+void show_level(void);
+void show_temperature_target(void);
 
 extern bool g_preheat_request;
 #endif // CLI_COMMANDS
\ No newline at end of file
@@ -0,0 +1,95 @@
+#include <algorithm>
+
+#include "countdown.hpp"
+
+CountdownModel g_countdowns;
+
+uint16_t CountdownModel::predict(const Entry &entry, Clock::time_point now)
+{
+    if (!entry.running)
+        return entry.value;
+    auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - entry.stamp).count();
+    return elapsed >= entry.value ? 0 : static_cast<uint16_t>(entry.value - elapsed);
+}
+
+void CountdownModel::sampled(const uint16_t *input, uint16_t from, uint16_t to, Clock::time_point now)
+{
+    std::unique_lock lk(mutex_);
+    for (uint16_t reg = std::max(from, COUNTDOWN_FIRST_REGISTER); reg <= std::min(to, COUNTDOWN_LAST_REGISTER); reg++)
+    {
+        if (!(input_register(reg).flags & RegFlag::Countdown))
+            continue;
+
+        Entry &entry = entries_[reg - COUNTDOWN_FIRST_REGISTER];
+        uint16_t value = input[reg];
+        if (entry.stamp == Clock::time_point{})
+        {
+            entry = {value, now, value > 0};
+            continue;
+        }
+
+        int error = static_cast<int>(value) - predict(entry, now);
+        if (error > TOLERANCE_S || error < -TOLERANCE_S)
+            discontinuities_++;
+
+        // samples closer than the tolerance cannot tell a paused counter from a running one
+        if (now - entry.stamp >= std::chrono::seconds(TOLERANCE_S))
+            entry.running = value > 0 && value != entry.value;
+        else
+            entry.running = entry.running && value > 0;
+        entry.value = value;
+        entry.stamp = now;
+    }
+}
+
+uint16_t CountdownModel::remaining(uint16_t reg, uint16_t fallback, Clock::time_point now) const
+{
+    if (reg < COUNTDOWN_FIRST_REGISTER || reg > COUNTDOWN_LAST_REGISTER)
+        return fallback;
+
+    std::unique_lock lk(mutex_);
+    if (shown_at_ == Clock::time_point{} || now - shown_at_ >= WATCH_PERIOD)
+        shown_.notify();
+    shown_at_ = now;
+
+    const Entry &entry = entries_[reg - COUNTDOWN_FIRST_REGISTER];
+    return entry.stamp == Clock::time_point{} ? fallback : predict(entry, now);
+}
+
+CountdownModel::Clock::time_point CountdownModel::next_sync(void) const
+{
+    std::unique_lock lk(mutex_);
+    Clock::time_point next = Clock::time_point::max();
+    for (uint16_t reg = COUNTDOWN_FIRST_REGISTER; reg <= COUNTDOWN_LAST_REGISTER; reg++)
+    {
+        if (!(input_register(reg).flags & RegFlag::Countdown))
+            continue;
+
+        const Entry &entry = entries_[reg - COUNTDOWN_FIRST_REGISTER];
+        if (entry.stamp == Clock::time_point{})
+            return Clock::now();
+        next = std::min(next, entry.stamp + RESYNC_PERIOD);
+        // whatever the unit does at 0, the counter is reloaded or stops there
+        if (entry.running)
+            next = std::min(next, entry.stamp + std::chrono::seconds(entry.value + 1));
+    }
+    return next;
+}
+
+bool CountdownModel::watched(Clock::time_point now) const
+{
+    std::unique_lock lk(mutex_);
+    return shown_at_ != Clock::time_point{} && now - shown_at_ < WATCH_PERIOD;
+}
+
+CountdownModel::Clock::time_point CountdownModel::watch_end(void) const
+{
+    std::unique_lock lk(mutex_);
+    return shown_at_ + WATCH_PERIOD;
+}
+
+uint64_t CountdownModel::discontinuities(void) const
+{
+    std::unique_lock lk(mutex_);
+    return discontinuities_;
+}
@@ -0,0 +1,87 @@
+#ifndef COUNTDOWN_HPP
+#define COUNTDOWN_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+#include "modbus_registers.h"
+#include "register_table.hpp"
+#include "scheduler.hpp"
+
+namespace detail
+{
+    template <bool Last>
+    constexpr uint16_t countdown_bound(void)
+    {
+        uint16_t bound = Last ? 0 : UINT16_MAX;
+        for (const auto &desc : INPUT_REGISTERS)
+            if (desc.flags & RegFlag::Countdown)
+                bound = Last ? (desc.reg > bound ? desc.reg : bound) : (desc.reg < bound ? desc.reg : bound);
+        return bound;
+    }
+}
+
+// Input registers the countdown model re-reads in one request
+constexpr uint16_t COUNTDOWN_FIRST_REGISTER = detail::countdown_bound<false>();
+constexpr uint16_t COUNTDOWN_LAST_REGISTER = detail::countdown_bound<true>();
+static_assert(COUNTDOWN_FIRST_REGISTER <= COUNTDOWN_LAST_REGISTER, "no countdown registers");
+
+// Live values of the RegFlag::Countdown registers without reading them every second.
+// Each one is extrapolated from its last sample with the monotonic clock. A
+// countdown which stood still between two samples is taken as paused (e.g. no
+// defrost countdown while the unit is off) and shown as sampled until it moves.
+// A sample more than TOLERANCE_S away from the prediction is a discontinuity:
+// the unit reloaded or stopped the counter and the model starts over from it.
+// The registers are kept in sync only while something shows them: for
+// WATCH_PERIOD after the last remaining(), the first one after a pause wakes
+// the re-sync task through shown_fd().
+class CountdownModel
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    static constexpr auto RESYNC_PERIOD = std::chrono::seconds(60);
+    static constexpr int TOLERANCE_S = 2;
+    static constexpr auto WATCH_PERIOD = std::chrono::minutes(5);
+
+    // After input registers [from, to] were read
+    void sampled(const uint16_t *input, uint16_t from, uint16_t to, Clock::time_point now = Clock::now());
+
+    // Seconds left on countdown `reg`, `fallback` while it was never sampled
+    uint16_t remaining(uint16_t reg, uint16_t fallback, Clock::time_point now = Clock::now()) const;
+
+    // When the registers are worth reading again: RESYNC_PERIOD after the oldest
+    // sample, or right after a running countdown is predicted to reach 0
+    Clock::time_point next_sync(void) const;
+
+    // Whether a countdown was shown within WATCH_PERIOD, and when that ends
+    bool watched(Clock::time_point now = Clock::now()) const;
+    Clock::time_point watch_end(void) const;
+    // Readable after remaining() was called while nothing was watching
+    int shown_fd(void) const { return shown_.fd(); }
+    void drain_shown(void) { shown_.drain(); }
+
+    uint64_t discontinuities(void) const;
+
+private:
+    struct Entry
+    {
+        uint16_t value;
+        Clock::time_point stamp; // of the sample, epoch - never sampled
+        bool running;
+    };
+
+    static constexpr size_t COUNT = COUNTDOWN_LAST_REGISTER - COUNTDOWN_FIRST_REGISTER + 1;
+
+    static uint16_t predict(const Entry &entry, Clock::time_point now);
+
+    mutable std::mutex mutex_;
+    Entry entries_[COUNT]{};
+    uint64_t discontinuities_{0};
+    mutable Clock::time_point shown_at_{};
+    mutable Notifier shown_;
+};
+
+extern CountdownModel g_countdowns;
+
+#endif // COUNTDOWN_HPP
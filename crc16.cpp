@@ -0,0 +1,261 @@
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "crc16.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CRC16_HAVE_CLMUL
+#endif
+
+static constexpr uint16_t CRC16_POLY = 0xA001; // 0x8005 bit reversed
+static constexpr uint16_t CRC16_INIT = 0xFFFF;
+
+static uint16_t crc16_bitwise(uint16_t crc, const uint8_t *data, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 1) ? (crc >> 1) ^ CRC16_POLY : crc >> 1;
+    }
+    return crc;
+}
+
+// table[k][b] is the CRC contribution of byte b followed by k zero bytes
+static constexpr auto make_slice8_tables()
+{
+    std::array<std::array<uint16_t, 256>, 8> table{};
+    for (int b = 0; b < 256; b++)
+    {
+        uint16_t crc = b;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 1) ? (crc >> 1) ^ CRC16_POLY : crc >> 1;
+        table[0][b] = crc;
+    }
+    for (int k = 1; k < 8; k++)
+    {
+        for (int b = 0; b < 256; b++)
+            table[k][b] = (table[k - 1][b] >> 8) ^ table[0][table[k - 1][b] & 0xff];
+    }
+    return table;
+}
+
+static constexpr auto SLICE8 = make_slice8_tables();
+
+static uint16_t crc16_slice8(uint16_t crc, const uint8_t *data, size_t length)
+{
+    // The 16 bit register is fully absorbed by the first two bytes of each group
+    for (; length >= 8; data += 8, length -= 8)
+    {
+        crc = SLICE8[7][data[0] ^ (crc & 0xff)] ^ SLICE8[6][data[1] ^ (crc >> 8)] ^
+              SLICE8[5][data[2]] ^ SLICE8[4][data[3]] ^ SLICE8[3][data[4]] ^
+              SLICE8[2][data[5]] ^ SLICE8[1][data[6]] ^ SLICE8[0][data[7]];
+    }
+    for (; length > 0; data++, length--)
+        crc = (crc >> 8) ^ SLICE8[0][(crc ^ *data) & 0xff];
+    return crc;
+}
+
+#ifdef CRC16_HAVE_CLMUL
+// x^n mod P, bit reversed like the data, in the top 16 bits of a 64 bit lane
+static constexpr long long xpow_mod(unsigned n)
+{
+    uint16_t r = 0x8000; // x^0
+    for (unsigned i = 0; i < n; i++)
+        r = (r & 1) ? (r >> 1) ^ CRC16_POLY : r >> 1;
+    return static_cast<long long>(static_cast<uint64_t>(r) << 48);
+}
+
+// A 16 byte lane loaded little endian holds its first bit, the highest power
+// of x, in bit 0. Moving it `distance` bits further down the message splits it
+// into halves multiplied by x^(distance+64) and x^distance; the carry-less
+// product of two reversed operands comes out multiplied by x once more, hence
+// the -1 in the exponents. Products stay below x^80, so the folded lane is a
+// 128 bit value congruent to the original modulo P.
+__attribute__((target("pclmul"))) static inline __m128i fold(__m128i lane, __m128i k, __m128i next)
+{
+    return _mm_xor_si128(next, _mm_xor_si128(_mm_clmulepi64_si128(lane, k, 0x00), _mm_clmulepi64_si128(lane, k, 0x11)));
+}
+
+__attribute__((target("pclmul"))) static uint16_t crc16_clmul(uint16_t crc, const uint8_t *data, size_t length)
+{
+    if (length < 64)
+        return crc16_slice8(crc, data, length);
+
+    const __m128i fold512 = _mm_set_epi64x(xpow_mod(512 - 1), xpow_mod(512 + 63));
+    const __m128i fold128 = _mm_set_epi64x(xpow_mod(128 - 1), xpow_mod(128 + 63));
+    auto load = [](const uint8_t *p)
+    { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); };
+
+    // Four independent lanes keep the multiplier busy, the register goes into the first bytes
+    __m128i x0 = _mm_xor_si128(load(data), _mm_cvtsi32_si128(crc));
+    __m128i x1 = load(data + 16);
+    __m128i x2 = load(data + 32);
+    __m128i x3 = load(data + 48);
+    data += 64;
+    length -= 64;
+    for (; length >= 64; data += 64, length -= 64)
+    {
+        x0 = fold(x0, fold512, load(data));
+        x1 = fold(x1, fold512, load(data + 16));
+        x2 = fold(x2, fold512, load(data + 32));
+        x3 = fold(x3, fold512, load(data + 48));
+    }
+
+    __m128i x = fold(fold(fold(x0, fold128, x1), fold128, x2), fold128, x3);
+    for (; length >= 16; data += 16, length -= 16)
+        x = fold(x, fold128, load(data));
+
+    // What is left is an ordinary 16 byte message with a zero register
+    uint8_t rest[16];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(rest), x);
+    return crc16_slice8(crc16_slice8(0, rest, sizeof(rest)), data, length);
+}
+#endif
+
+bool crc16_supported(int kernel)
+{
+    switch (kernel)
+    {
+    case Crc16::Bitwise:
+    case Crc16::Slice8:
+        return true;
+#ifdef CRC16_HAVE_CLMUL
+    case Crc16::Clmul:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("pclmul");
+#endif
+    default:
+        return false;
+    }
+}
+
+const char *crc16_kernel_name(int kernel)
+{
+    static const char *const names[] = {"bitwise", "slice-by-8", "pclmul"};
+    return kernel >= 0 && kernel < Crc16::Count ? names[kernel] : "unknown";
+}
+
+int crc16_active_kernel(void)
+{
+    static const int kernel = crc16_supported(Crc16::Clmul) ? Crc16::Clmul : Crc16::Slice8;
+    return kernel;
+}
+
+uint16_t crc16(int kernel, const uint8_t *data, size_t length)
+{
+    switch (kernel)
+    {
+    case Crc16::Bitwise:
+        return crc16_bitwise(CRC16_INIT, data, length);
+#ifdef CRC16_HAVE_CLMUL
+    case Crc16::Clmul:
+        if (crc16_supported(Crc16::Clmul))
+            return crc16_clmul(CRC16_INIT, data, length);
+        [[fallthrough]];
+#endif
+    default:
+        return crc16_slice8(CRC16_INIT, data, length);
+    }
+}
+
+uint16_t crc16(const uint8_t *data, size_t length)
+{
+#ifdef CRC16_HAVE_CLMUL
+    if (crc16_active_kernel() == Crc16::Clmul)
+        return crc16_clmul(CRC16_INIT, data, length);
+#endif
+    return crc16_slice8(CRC16_INIT, data, length);
+}
+
+// Deterministic filler, the same bytes on every run
+static void fill(uint8_t *data, size_t length)
+{
+    uint32_t state = 0x12345678;
+    for (size_t i = 0; i < length; i++)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        data[i] = static_cast<uint8_t>(state);
+    }
+}
+
+int crc16_self_check(void)
+{
+    static const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    static constexpr uint16_t CHECK_VALUE = 0x4B37; // catalogued CRC-16/MODBUS of "123456789"
+
+    std::vector<uint8_t> buffer(1024 + 16);
+    fill(buffer.data(), buffer.size());
+
+    int rc = 0;
+    for (int kernel = 0; kernel < Crc16::Count; kernel++)
+    {
+        if (!crc16_supported(kernel))
+        {
+            printf("%-12s not supported on this CPU\n", crc16_kernel_name(kernel));
+            continue;
+        }
+
+        bool ok = crc16(kernel, check, sizeof(check)) == CHECK_VALUE;
+        if (!ok)
+            printf("%-12s check value %04X, expected %04X\n", crc16_kernel_name(kernel), crc16(kernel, check, sizeof(check)), CHECK_VALUE);
+
+        for (size_t offset = 0; ok && offset < 16; offset++)
+        {
+            for (size_t length = 0; ok && length <= 1024; length++)
+            {
+                const uint8_t *data = buffer.data() + offset;
+                uint16_t expected = crc16_bitwise(CRC16_INIT, data, length);
+                uint16_t got = crc16(kernel, data, length);
+                if (got != expected)
+                {
+                    printf("%-12s %04X instead of %04X for %zu bytes at offset %zu\n", crc16_kernel_name(kernel), got, expected, length, offset);
+                    ok = false;
+                }
+            }
+        }
+        printf("%-12s %s%s\n", crc16_kernel_name(kernel), ok ? "ok" : "FAILED", kernel == crc16_active_kernel() ? " (in use)" : "");
+        if (!ok)
+            rc = -1;
+    }
+    return rc;
+}
+
+static double throughput(int kernel, const uint8_t *data, size_t length, size_t bytes_total)
+{
+    using Clock = std::chrono::steady_clock;
+    volatile uint16_t sink = 0;
+    size_t rounds = bytes_total / length;
+    auto start = Clock::now();
+    for (size_t i = 0; i < rounds; i++)
+        sink = sink ^ crc16(kernel, data, length);
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+    return rounds * length / elapsed.count() / 1e6;
+}
+
+void crc16_benchmark(void)
+{
+    static constexpr size_t FRAME = 256; // largest RTU frame
+    static constexpr size_t LARGE = 1 << 20;
+
+    std::vector<uint8_t> buffer(LARGE);
+    fill(buffer.data(), buffer.size());
+
+    printf("%-12s %14s %14s\n", "kernel", "256 B MB/s", "1 MiB MB/s");
+    for (int kernel = 0; kernel < Crc16::Count; kernel++)
+    {
+        if (!crc16_supported(kernel))
+            continue;
+        // The reference is slow, give it less work
+        size_t total = kernel == Crc16::Bitwise ? 16 * LARGE : 256 * LARGE;
+        printf("%-12s %14.0f %14.0f%s\n", crc16_kernel_name(kernel),
+               throughput(kernel, buffer.data(), FRAME, total),
+               throughput(kernel, buffer.data(), LARGE, total),
+               kernel == crc16_active_kernel() ? "  (in use)" : "");
+    }
+}
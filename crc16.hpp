@@ -0,0 +1,38 @@
+#ifndef CRC16_HPP
+#define CRC16_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// CRC-16/MODBUS, the check field of RTU frames: polynomial 0x8005 reflected
+// (0xA001), initial value 0xFFFF, no final xor. Sent low byte first.
+
+namespace Crc16
+{
+    enum kernel_t
+    {
+        Bitwise = 0, // one bit per step, the reference
+        Slice8,      // eight table lookups per 8 bytes
+        Clmul,       // 64 byte folds with carry-less multiply (x86 PCLMULQDQ)
+        Count
+    };
+}
+
+// Uses the fastest kernel the CPU supports, chosen once at startup
+uint16_t crc16(const uint8_t *data, size_t length);
+
+// One particular kernel, falls back to Slice8 when `kernel` is not supported here
+uint16_t crc16(int kernel, const uint8_t *data, size_t length);
+
+bool crc16_supported(int kernel);
+const char *crc16_kernel_name(int kernel);
+int crc16_active_kernel(void);
+
+// Compares every supported kernel with the reference over all lengths and
+// alignments up to a few frames, prints the first mismatch. Returns -1 on any.
+int crc16_self_check(void);
+
+// Prints the throughput of every supported kernel on RTU sized frames and on a large buffer
+void crc16_benchmark(void);
+
+#endif // CRC16_HPP
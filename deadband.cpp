@@ -0,0 +1,55 @@
+#include <cmath>
+
+#include "deadband.hpp"
+#include "register_table.hpp"
+
+static int32_t raw_scale(uint16_t reg)
+{
+    return input_register(reg).scale;
+}
+
+static int64_t to_ms(DeadbandFilter::Clock::time_point t)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(t.time_since_epoch()).count();
+}
+
+void DeadbandFilter::set_deadband(uint16_t reg, float value)
+{
+    if (reg >= e_input_last_item)
+        return;
+    deadbands_ -= deadband_[reg] != 0;
+    deadband_[reg] = static_cast<int32_t>(std::lround(std::fabs(value) * raw_scale(reg)));
+    deadbands_ += deadband_[reg] != 0;
+}
+
+float DeadbandFilter::deadband(uint16_t reg) const
+{
+    return reg < e_input_last_item ? static_cast<float>(deadband_[reg]) / raw_scale(reg) : 0.0f;
+}
+
+void DeadbandFilter::evaluate(const uint16_t *registers, uint8_t *report, Clock::time_point now) const
+{
+    const int64_t now_ms = to_ms(now);
+    const int64_t silence_ms = std::chrono::duration_cast<std::chrono::milliseconds>(max_silence_).count();
+    const uint8_t forced = silence_ms > 0;
+
+    for (size_t i = 0; i < e_input_last_item; i++)
+    {
+        int32_t delta = input_register(i).to_int(registers[i]) - last_[i];
+        uint8_t moved = (delta > deadband_[i]) | (-delta > deadband_[i]);
+        uint8_t silent = (forced & ((now_ms - last_ms_[i]) >= silence_ms)) | (last_ms_[i] == 0); // or never reported
+        report[i] = moved | silent;
+    }
+}
+
+void DeadbandFilter::commit(const uint16_t *registers, const uint8_t *report, Clock::time_point now)
+{
+    const int64_t now_ms = to_ms(now);
+
+    for (size_t i = 0; i < e_input_last_item; i++)
+    {
+        int32_t mask = -static_cast<int32_t>(report[i]);
+        last_[i] = (input_register(i).to_int(registers[i]) & mask) | (last_[i] & ~mask);
+        last_ms_[i] = (now_ms & static_cast<int64_t>(mask)) | (last_ms_[i] & ~static_cast<int64_t>(mask));
+    }
+}
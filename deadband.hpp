@@ -0,0 +1,43 @@
+#ifndef DEADBAND_HPP
+#define DEADBAND_HPP
+
+#include <chrono>
+#include <cstdint>
+
+#include "modbus_registers.h"
+
+// Report-by-exception filter over the input register block. A channel is
+// reported when it moved beyond its deadband since it was last reported, or
+// when it has been silent for longer than the maximum silence interval.
+// The filter is on once any deadband or a maximum silence is set.
+class DeadbandFilter
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Deadband in engineering units (see RegisterDescriptor::scale)
+    void set_deadband(uint16_t reg, float value);
+    float deadband(uint16_t reg) const;
+
+    // 0 - a channel is reported only when it moves
+    void set_max_silence(std::chrono::seconds interval) { max_silence_ = interval; }
+    std::chrono::seconds max_silence(void) const { return max_silence_; }
+    // Otherwise every channel is reported on every sample
+    bool enabled(void) const { return deadbands_ > 0 || max_silence_.count() > 0; }
+
+    // Sets report[reg] to 1 for every register which should be reported.
+    // Runs without branches over the whole block so it vectorizes.
+    void evaluate(const uint16_t *registers, uint8_t *report, Clock::time_point now = Clock::now()) const;
+
+    // Remembers the values of the registers that were actually reported
+    void commit(const uint16_t *registers, const uint8_t *report, Clock::time_point now = Clock::now());
+
+private:
+    int32_t deadband_[e_input_last_item]{};    // raw units
+    int32_t last_[e_input_last_item]{};        // last reported value, RegisterDescriptor::to_int()
+    int64_t last_ms_[e_input_last_item]{};     // when it was reported
+    std::chrono::seconds max_silence_{0};
+    uint16_t deadbands_{0}; // registers with a deadband set
+};
+
+#endif // DEADBAND_HPP
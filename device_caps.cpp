@@ -0,0 +1,350 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "args.hpp"
+#include "device_caps.hpp"
+#include "frame_capture.hpp"
+#include "modbus_adu.hpp"
+#include "report.hpp"
+
+static constexpr int RESPONSE_TIMEOUT_MS = 2000;
+static constexpr int RTU_SILENCE_MS = 50; // gap ending an RTU frame, generous for 9600 baud
+static constexpr uint8_t EXCEPTION_ILLEGAL_FUNCTION = 0x01;
+static constexpr ArgSpec MAX_READ_ARG{"max_read_registers", Arg::Int, 1, MODBUS_MAX_READ_REGISTERS};
+static constexpr ArgSpec PROBED_ARG{"probed", Arg::Int, 1, INT32_MAX};
+
+DeviceCapabilities g_caps;
+static int g_probe_timeouts{0}; // since the probe started, the caller owns the bus
+
+static bool wait_readable(int fd, int timeout_ms)
+{
+    pollfd pfd{fd, POLLIN, 0};
+    int rc;
+    do
+        rc = poll(&pfd, 1, timeout_ms);
+    while (rc < 0 && errno == EINTR);
+    return rc > 0;
+}
+
+// Sends one request PDU on the connected `ctx` and copies the response PDU to `rsp`.
+// libmodbus cannot size responses of function codes it does not know (FC43),
+// so framing is done here for both TCP and RTU.
+// Returns the response PDU length, -1 when nothing came back, -2 on a malformed answer.
+static int raw_transaction(modbus_t *ctx, uint8_t unit_id, const uint8_t *pdu, size_t length, uint8_t *rsp)
+{
+    static uint16_t tid{0};
+    int fd = modbus_get_socket(ctx);
+    bool tcp = modbus_get_header_length(ctx) > 1;
+    int framing = tcp ? Framing::Tcp : Framing::Rtu;
+
+    uint8_t frame[MODBUS_MAX_ADU_LENGTH];
+    memcpy(&frame[pdu_offset(framing)], pdu, length);
+    size_t frame_length = wrap_pdu(framing, frame, length, unit_id, ++tid);
+    if (tcp)
+    {
+        if (::send(fd, frame, frame_length, MSG_NOSIGNAL) != static_cast<ssize_t>(frame_length))
+            return -1;
+    }
+    else
+    {
+        modbus_flush(ctx);
+        if (::write(fd, frame, frame_length) != static_cast<ssize_t>(frame_length))
+            return -1;
+    }
+    g_capture.record(framing, Capture::TxRequest, frame, frame_length);
+
+    size_t received = 0;
+    int timeout_ms = RESPONSE_TIMEOUT_MS;
+    while (received < sizeof(frame) && wait_readable(fd, timeout_ms))
+    {
+        ssize_t n = ::read(fd, &frame[received], sizeof(frame) - received);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        received += n;
+
+        if (tcp && mbap_frame_length(frame, received) != 0)
+            break;
+        if (!tcp)
+            timeout_ms = RTU_SILENCE_MS;
+    }
+
+    if (received == 0)
+    {
+        g_capture.record_timeout(framing, unit_id, pdu[0]);
+        return -1;
+    }
+
+    int pdu_length;
+    if (tcp)
+    {
+        int adu_length = mbap_frame_length(frame, received);
+        bool ours = adu_length > 0 && mbap_tid(frame) == tid && frame[6] == unit_id;
+        pdu_length = ours ? adu_length - static_cast<int>(MBAP_HEADER_LENGTH) : -1;
+    }
+    else
+    {
+        pdu_length = rtu_pdu_length(frame, received, unit_id);
+    }
+    if (pdu_length == -1)
+    {
+        g_capture.record(framing, Capture::RxResponse, frame, received, Capture::Malformed);
+        return -2;
+    }
+    g_capture.record(framing, Capture::RxResponse, frame, pdu_offset(framing) + pdu_length + (tcp ? 0 : 2));
+    memcpy(rsp, &frame[pdu_offset(framing)], pdu_length);
+    return pdu_length;
+}
+
+// 0 for a regular answer, the exception code for an exception, -1 when nothing usable came back
+static int request(modbus_t *ctx, uint8_t unit_id, const uint8_t *pdu, size_t length, uint8_t *rsp, int &rsp_length)
+{
+    rsp_length = raw_transaction(ctx, unit_id, pdu, length, rsp);
+    if (rsp_length == -1)
+        g_probe_timeouts++;
+    return rsp_length < 0 ? -1 : response_exception(pdu[0], rsp, rsp_length);
+}
+
+// Every probe is malformed on purpose (zero quantity, no-op mask on a nonexistent
+// address). A unit implementing the function rejects it with exception 02/03 and
+// nothing is written; one that does not answers 01, or stays silent.
+static bool implemented(modbus_t *ctx, uint8_t unit_id, const uint8_t *pdu, size_t length)
+{
+    uint8_t rsp[MODBUS_MAX_ADU_LENGTH];
+    int rsp_length;
+    int rc = request(ctx, unit_id, pdu, length, rsp, rsp_length);
+    return rc >= 0 && rc != EXCEPTION_ILLEGAL_FUNCTION;
+}
+
+static bool read_ok(modbus_t *ctx, uint8_t unit_id, uint8_t function, uint16_t count)
+{
+    uint8_t pdu[] = {function, 0, 0, static_cast<uint8_t>(count >> 8), static_cast<uint8_t>(count & 0xff)};
+    uint8_t rsp[MODBUS_MAX_ADU_LENGTH];
+    int rsp_length;
+    return request(ctx, unit_id, pdu, sizeof(pdu), rsp, rsp_length) == 0 && rsp_length == 2 + 2 * count;
+}
+
+// Largest block starting at register 0 the unit serves in one request (bisected), 0 when none
+static uint16_t largest_block(modbus_t *ctx, uint8_t unit_id, uint8_t function, uint16_t count)
+{
+    if (read_ok(ctx, unit_id, function, count))
+        return count;
+
+    uint16_t good = 0, bad = count;
+    while (bad - good > 1)
+    {
+        uint16_t middle = good + (bad - good) / 2;
+        if (read_ok(ctx, unit_id, function, middle))
+            good = middle;
+        else
+            bad = middle;
+    }
+    return good;
+}
+
+// FC43 / MEI 0x0E, basic category (vendor, product code, revision)
+static void read_identification(modbus_t *ctx, uint8_t unit_id, DeviceCapabilities &caps)
+{
+    uint8_t object_id = 0;
+    for (int page = 0; page < 4; page++)
+    {
+        uint8_t pdu[] = {0x2B, 0x0E, 0x01, object_id};
+        uint8_t rsp[MODBUS_MAX_ADU_LENGTH];
+        int rsp_length;
+        if (request(ctx, unit_id, pdu, sizeof(pdu), rsp, rsp_length) != 0 || rsp_length < 7)
+            return;
+
+        int pos = 7;
+        for (int i = 0; i < rsp[6] && pos + 2 <= rsp_length; i++)
+        {
+            uint8_t id = rsp[pos];
+            uint8_t length = rsp[pos + 1];
+            if (pos + 2 + length > rsp_length)
+                return;
+
+            std::string value(reinterpret_cast<const char *>(&rsp[pos + 2]), length);
+            if (id == 0)
+                caps.vendor = value;
+            else if (id == 1)
+                caps.product_code = value;
+            else if (id == 2)
+                caps.revision = value;
+            pos += 2 + length;
+        }
+
+        if (rsp[4] != 0xFF) // no more objects follow
+            return;
+        object_id = rsp[5];
+    }
+}
+
+int probe_capabilities(modbus_t *ctx, uint8_t unit_id, uint16_t input_count, uint16_t holding_count, DeviceCapabilities &caps)
+{
+    if (modbus_connect(ctx) == -1)
+    {
+        fprintf(stderr, "Connection failed: %s\n", modbus_strerror(errno));
+        return -1;
+    }
+
+    // Only probe a unit that answers at all, every silent probe costs a full timeout
+    if (!read_ok(ctx, unit_id, 0x04, 1))
+    {
+        modbus_close(ctx);
+        return -1;
+    }
+
+    g_probe_timeouts = 0;
+    DeviceCapabilities probed;
+    read_identification(ctx, unit_id, probed);
+
+    const uint8_t fc16[] = {0x10, 0x00, 0x00, 0x00, 0x00, 0x00};
+    const uint8_t fc22[] = {0x16, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00};
+    const uint8_t fc23[] = {0x17, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    probed.write_multiple = implemented(ctx, unit_id, fc16, sizeof(fc16));
+    probed.mask_write = implemented(ctx, unit_id, fc22, sizeof(fc22));
+    probed.read_write = implemented(ctx, unit_id, fc23, sizeof(fc23));
+
+    uint16_t input = largest_block(ctx, unit_id, 0x04, input_count);
+    uint16_t holding = largest_block(ctx, unit_id, 0x03, holding_count);
+    if (input < input_count || holding < holding_count)
+        probed.max_read_registers = std::max<uint16_t>(1, std::min(input, holding));
+
+    // Some units stay silent on function codes they lack; that is an answer as
+    // long as they still serve a plain read, otherwise they went away meanwhile
+    if (g_probe_timeouts != 0)
+        probed.settled = read_ok(ctx, unit_id, 0x04, 1);
+
+    modbus_close(ctx);
+    probed.probed = time(nullptr);
+    caps = probed;
+    return 0;
+}
+
+int read_identity(modbus_t *ctx, uint8_t unit_id, DeviceCapabilities &caps)
+{
+    if (modbus_connect(ctx) == -1)
+        return -1;
+
+    g_probe_timeouts = 0;
+    DeviceCapabilities identified;
+    read_identification(ctx, unit_id, identified);
+    modbus_close(ctx);
+    if (g_probe_timeouts != 0)
+        return -1;
+
+    caps.vendor = identified.vendor;
+    caps.product_code = identified.product_code;
+    caps.revision = identified.revision;
+    return 0;
+}
+
+std::string device_identity(const DeviceCapabilities &caps)
+{
+    if (caps.vendor.empty() && caps.product_code.empty() && caps.revision.empty())
+        return "";
+    return caps.vendor + "/" + caps.product_code + "/" + caps.revision;
+}
+
+int load_capabilities(const std::filesystem::path &file, DeviceCapabilities &caps)
+{
+    std::ifstream ifs(file);
+    if (!ifs)
+        return -1;
+
+    DeviceCapabilities loaded;
+    std::string line;
+    while (std::getline(ifs, line))
+    {
+        auto equal_pos = line.find('=');
+        if (equal_pos == std::string::npos)
+            continue;
+
+        std::string key = line.substr(0, equal_pos);
+        std::string value = line.substr(equal_pos + 1);
+        int32_t number;
+        const char *error{nullptr};
+        if (key == "vendor")
+            loaded.vendor = value;
+        else if (key == "product_code")
+            loaded.product_code = value;
+        else if (key == "revision")
+            loaded.revision = value;
+        else if (key == "fc16")
+            loaded.write_multiple = value == "1";
+        else if (key == "fc22")
+            loaded.mask_write = value == "1";
+        else if (key == "fc23")
+            loaded.read_write = value == "1";
+        else if (key == "max_read_registers" && parse_arg(value, MAX_READ_ARG, number, error) == 0)
+            loaded.max_read_registers = static_cast<uint16_t>(number);
+        else if (key == "probed" && parse_arg(value, PROBED_ARG, number, error) == 0)
+            loaded.probed = static_cast<time_t>(number);
+
+        if (error)
+        {
+            fprintf(stderr, "Ignoring capability cache %s: %s\n", file.string().c_str(), error);
+            return -1;
+        }
+    }
+
+    if (loaded.probed == 0)
+        return -1;
+    caps = loaded;
+    return 0;
+}
+
+// Same temporary file + rename scheme as the warm register cache
+int store_capabilities(const std::filesystem::path &file, const DeviceCapabilities &caps)
+{
+    std::filesystem::path tmp = file;
+    tmp += ".tmp";
+    {
+        std::ofstream ofs(tmp, std::ios::trunc);
+        ofs << "vendor=" << caps.vendor << '\n'
+            << "product_code=" << caps.product_code << '\n'
+            << "revision=" << caps.revision << '\n'
+            << "fc16=" << caps.write_multiple << '\n'
+            << "fc22=" << caps.mask_write << '\n'
+            << "fc23=" << caps.read_write << '\n'
+            << "max_read_registers=" << caps.max_read_registers << '\n'
+            << "probed=" << static_cast<long long>(caps.probed) << '\n';
+        if (!ofs)
+            return -1;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp, file, ec);
+    return ec ? -1 : 0;
+}
+
+void print_capabilities(const DeviceCapabilities &caps)
+{
+    Report report;
+    if (caps.probed == 0)
+    {
+        report.message("capabilities", "Device capabilities not probed yet");
+        return;
+    }
+
+    char when[32];
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M", localtime(&caps.probed));
+
+    report.text("vendor", "Vendor", caps.vendor.empty() ? "-" : caps.vendor);
+    report.text("product_code", "Product code", caps.product_code.empty() ? "-" : caps.product_code);
+    report.text("revision", "Revision", caps.revision.empty() ? "-" : caps.revision);
+    report.flag("fc16", "FC16 write multiple registers", caps.write_multiple);
+    report.flag("fc22", "FC22 mask write register", caps.mask_write);
+    report.flag("fc23", "FC23 read/write multiple registers", caps.read_write);
+    report.integer("max_read_registers", "Max registers per read", caps.max_read_registers);
+    report.text("probed", "Probed", when);
+    if (!caps.settled)
+        report.message("settled", "The device stopped answering during the probe, probing again on the next refresh");
+}
@@ -0,0 +1,46 @@
+#ifndef DEVICE_CAPS_HPP
+#define DEVICE_CAPS_HPP
+
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <string>
+
+#include <modbus/modbus.h>
+
+// What the connected unit identifies as and which function codes it implements.
+// Probed once per device and cached next to the warm register cache, so later
+// sessions know the fastest usable path without trial and error on the bus.
+struct DeviceCapabilities
+{
+    std::string vendor;       // FC43 basic identification objects, empty when FC43 is not implemented
+    std::string product_code;
+    std::string revision;
+    bool write_multiple{true}; // FC16
+    bool mask_write{false};    // FC22
+    bool read_write{false};    // FC23
+    uint16_t max_read_registers{MODBUS_MAX_READ_REGISTERS}; // largest FC03/FC04 block the unit serves
+    time_t probed{0};          // 0 - never probed, the defaults above are assumed
+    bool settled{true};        // false when the unit stopped answering during the probe, such a result is not cached
+};
+
+extern DeviceCapabilities g_caps;
+
+// Probes the unit behind an unconnected `ctx`, the caller owns the bus for the duration.
+// `input_count`/`holding_count` are the register block sizes the application reads.
+// Returns -1 when the unit does not answer at all. A probe which timed out
+// reads as "not implemented"; `caps.settled` is false only when the unit then
+// no longer answers a plain read either.
+int probe_capabilities(modbus_t *ctx, uint8_t unit_id, uint16_t input_count, uint16_t holding_count, DeviceCapabilities &caps);
+
+// Reads only the FC43 identification of the unit behind an unconnected `ctx`,
+// -1 when it timed out and nothing can be told about the unit
+int read_identity(modbus_t *ctx, uint8_t unit_id, DeviceCapabilities &caps);
+// "vendor/product_code/revision", empty when the unit did not identify itself
+std::string device_identity(const DeviceCapabilities &caps);
+
+int load_capabilities(const std::filesystem::path &file, DeviceCapabilities &caps);
+int store_capabilities(const std::filesystem::path &file, const DeviceCapabilities &caps);
+void print_capabilities(const DeviceCapabilities &caps);
+
+#endif // DEVICE_CAPS_HPP
@@ -0,0 +1,242 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <unistd.h>
+
+#include "energy_meter.hpp"
+#include "report.hpp"
+#include "struct.h"
+
+static constexpr uint32_t ENERGY_MAGIC = 0x454e4731; // "ENG1"
+static constexpr uint32_t ENERGY_VERSION = 1;
+
+EnergyMeter g_energy;
+
+static int32_t day_key(const tm &local)
+{
+    return (local.tm_year + 1900) * 10000 + (local.tm_mon + 1) * 100 + local.tm_mday;
+}
+
+int EnergyMeter::open(const std::filesystem::path &path)
+{
+    std::unique_lock lk(mutex_);
+    path_ = path;
+    state_ = {};
+
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+        return errno == ENOENT ? 0 : -1;
+
+    State loaded;
+    bool valid = fread(&loaded, sizeof(loaded), 1, file) == 1 && loaded.magic == ENERGY_MAGIC && loaded.version == ENERGY_VERSION &&
+                 loaded.last_mode >= 0 && loaded.last_mode < EnergyMode::Count;
+    fclose(file);
+    if (!valid)
+    {
+        fprintf(stderr, "Ignoring energy counters in %s, the file is damaged or of another version\n", path.c_str());
+        return -1;
+    }
+
+    state_ = loaded;
+    return 0;
+}
+
+int EnergyMeter::classify(const uint16_t *input)
+{
+    switch (input[e_outdoor_mode] & 0x7f) // +128 - auto mode / cycling
+    {
+    case Operation::Cooling:
+        return EnergyMode::Cooling;
+    case Operation::Heating:
+        return input[control_mode_ro] == Function::DHW ? EnergyMode::Dhw : EnergyMode::Heating;
+    case Operation::Defrost:
+        return EnergyMode::Defrost;
+    }
+    return EnergyMode::Standby;
+}
+
+// Starts new periods when the local date moved forward. A finished period becomes
+// the "last" one only when it is the one right before, otherwise that one had no samples.
+void EnergyMeter::roll_over(const tm &local)
+{
+    int32_t day = day_key(local);
+    int32_t month = day / 100;
+    int32_t year = day / 10000;
+    auto &period = state_.period;
+
+    if (day > state_.day)
+    {
+        tm before = local;
+        before.tm_mday--;
+        before.tm_hour = 12;
+        before.tm_isdst = -1;
+        mktime(&before);
+        period[EnergyPeriod::Yesterday] = state_.day == day_key(before) ? period[EnergyPeriod::Today] : EnergyCounters{};
+        period[EnergyPeriod::Today] = {};
+        state_.day = day;
+    }
+    if (month > state_.month)
+    {
+        int32_t previous = month % 100 == 1 ? (year - 1) * 100 + 12 : month - 1;
+        period[EnergyPeriod::LastMonth] = state_.month == previous ? period[EnergyPeriod::Month] : EnergyCounters{};
+        period[EnergyPeriod::Month] = {};
+        state_.month = month;
+    }
+    if (year > state_.year)
+    {
+        period[EnergyPeriod::LastYear] = state_.year == year - 1 ? period[EnergyPeriod::Year] : EnergyCounters{};
+        period[EnergyPeriod::Year] = {};
+        state_.year = year;
+    }
+}
+
+void EnergyMeter::sample(const uint16_t *input, uint64_t stamp_ns)
+{
+    std::unique_lock lk(mutex_);
+    if (path_.empty())
+        return;
+
+    time_t now = static_cast<time_t>(stamp_ns / 1000000000ull);
+    tm local;
+    localtime_r(&now, &local);
+    roll_over(local);
+
+    double in_w = input[e_pwr];
+    double out_w = input[e_heat_power];
+    double dt = state_.last_ns && stamp_ns > state_.last_ns ? (stamp_ns - state_.last_ns) / 1e9 : 0;
+
+    for (int p : {EnergyPeriod::Today, EnergyPeriod::Month, EnergyPeriod::Year, EnergyPeriod::Total})
+    {
+        EnergyCounters &counters = state_.period[p];
+        if (counters.since == 0)
+            counters.since = now;
+        if (dt > MAX_GAP_S)
+        {
+            counters.gap_seconds += dt;
+        }
+        else if (dt > 0)
+        {
+            counters.in_wh[state_.last_mode] += (state_.last_in_w + in_w) / 2 * dt / 3600;
+            counters.out_wh[state_.last_mode] += (state_.last_out_w + out_w) / 2 * dt / 3600;
+            counters.seconds[state_.last_mode] += dt;
+        }
+    }
+
+    // a clock stepped backwards only moves the starting point of the next interval
+    state_.last_ns = stamp_ns;
+    state_.last_in_w = in_w;
+    state_.last_out_w = out_w;
+    state_.last_mode = classify(input);
+
+    if (stamp_ns - stored_ns_ >= STORE_EVERY_S * 1000000000ull)
+    {
+        stored_ns_ = stamp_ns;
+        lk.unlock();
+        store();
+    }
+}
+
+int EnergyMeter::store(void)
+{
+    std::unique_lock lk(mutex_);
+    if (path_.empty())
+        return -1;
+
+    state_.magic = ENERGY_MAGIC;
+    state_.version = ENERGY_VERSION;
+
+    std::filesystem::path tmp = path_;
+    tmp += ".tmp";
+    FILE *file = fopen(tmp.c_str(), "wb");
+    if (!file)
+    {
+        fprintf(stderr, "Unable to store energy counters in %s: %s\n", tmp.c_str(), strerror(errno));
+        return -1;
+    }
+    // the data has to be on disk before the rename makes it the current file
+    bool written = fwrite(&state_, sizeof(state_), 1, file) == 1 && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    if (fclose(file) != 0 || !written)
+    {
+        fprintf(stderr, "Unable to store energy counters in %s: %s\n", tmp.c_str(), strerror(errno));
+        return -1;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp, path_, ec);
+    return ec ? -1 : 0;
+}
+
+void EnergyMeter::read(int period, EnergyCounters &out) const
+{
+    std::unique_lock lk(mutex_);
+    out = state_.period[period];
+}
+
+uint64_t EnergyMeter::last_sample_ns(void) const
+{
+    std::unique_lock lk(mutex_);
+    return state_.last_ns;
+}
+
+void print_energy(int period)
+{
+    static constexpr struct
+    {
+        const char *key;
+        const char *label;
+    } MODES[EnergyMode::Count] = {
+        {"standby", "Standby"},
+        {"heating", "Heating"},
+        {"cooling", "Cooling"},
+        {"dhw", "DHW"},
+        {"defrost", "Defrost"},
+    };
+
+    EnergyCounters counters;
+    g_energy.read(period, counters);
+
+    Report report;
+    report.text("period", "Period", ENERGY_PERIODS[period]);
+    if (counters.since == 0)
+    {
+        report.message("energy", "Nothing recorded in this period");
+        return;
+    }
+
+    char since[32];
+    time_t stamp = static_cast<time_t>(counters.since);
+    tm local;
+    localtime_r(&stamp, &local);
+    strftime(since, sizeof(since), "%Y-%m-%d %H:%M", &local);
+    report.text("since", "Recorded since", since);
+
+    double in_wh{0}, out_wh{0};
+    for (int mode = 0; mode < EnergyMode::Count; mode++)
+    {
+        in_wh += counters.in_wh[mode];
+        out_wh += counters.out_wh[mode];
+        if (counters.seconds[mode] == 0)
+            continue;
+
+        std::string key = MODES[mode].key;
+        std::string label = MODES[mode].label;
+        report.number(key + "_hours", label + " time", counters.seconds[mode] / 3600, 1, "h");
+        report.number(key + "_in_kwh", label + " energy used", counters.in_wh[mode] / 1000, 2, "kWh");
+        report.number(key + "_out_kwh", label + " energy delivered", counters.out_wh[mode] / 1000, 2, "kWh");
+        if (counters.in_wh[mode] > 0)
+            report.number(key + "_cop", label + " COP", counters.out_wh[mode] / counters.in_wh[mode], 2);
+    }
+
+    report.number("in_kwh", "Energy used", in_wh / 1000, 2, "kWh");
+    report.number("out_kwh", "Energy delivered", out_wh / 1000, 2, "kWh");
+    if (in_wh > 0)
+        report.number("cop", "COP", out_wh / in_wh, 2);
+
+    // heat delivered for the building and hot water over everything it took except cooling
+    double seasonal_in = in_wh - counters.in_wh[EnergyMode::Cooling];
+    if (seasonal_in > 0)
+        report.number("scop", "Seasonal COP (heating, DHW)", (counters.out_wh[EnergyMode::Heating] + counters.out_wh[EnergyMode::Dhw]) / seasonal_in, 2);
+    report.number("gap_hours", "Not recorded", counters.gap_seconds / 3600, 1, "h");
+}
@@ -0,0 +1,113 @@
+#ifndef ENERGY_METER_HPP
+#define ENERGY_METER_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <mutex>
+
+#include "modbus_registers.h"
+
+namespace EnergyMode
+{
+    enum mode_t
+    {
+        Standby = 0, // stopped, fan only or anything unknown
+        Heating,
+        Cooling,
+        Dhw,         // heating for domestic hot water
+        Defrost,
+        Count,
+    };
+}
+
+namespace EnergyPeriod
+{
+    enum period_t
+    {
+        Today = 0,
+        Yesterday,
+        Month,
+        LastMonth,
+        Year,
+        LastYear,
+        Total,
+        Count,
+    };
+}
+
+// Names of EnergyPeriod::period_t for the CLI, nullptr terminated (ArgSpec::choices)
+inline constexpr const char *ENERGY_PERIODS[] = {"today", "yesterday", "month", "last_month", "year", "last_year", "total", nullptr};
+
+// Input registers a sample needs, a read covering [first, last] feeds the meter
+inline constexpr uint16_t ENERGY_FIRST_REGISTER = std::min({control_mode_ro, e_pwr, e_outdoor_mode, e_heat_power});
+inline constexpr uint16_t ENERGY_LAST_REGISTER = std::max({control_mode_ro, e_pwr, e_outdoor_mode, e_heat_power});
+
+// Energy of one period, split by operation mode
+struct EnergyCounters
+{
+    double in_wh[EnergyMode::Count];  // electrical energy taken by the ODU (e_pwr)
+    double out_wh[EnergyMode::Count]; // heat or cold delivered (e_heat_power)
+    double seconds[EnergyMode::Count];
+    double gap_seconds;               // time between samples too far apart to integrate
+    int64_t since;                    // time_t of the first sample in this period, 0 - none
+};
+
+// Integrates the ODU power and the heating power over every input register poll
+// (trapezoidal rule). A poll interval is booked to the mode the unit was in when
+// it started and to the period it ends in. Intervals longer than MAX_GAP_S are
+// not integrated but counted as gap. Counters of today, this month and this year
+// roll over into "yesterday", "last month" and "last year" on the first sample
+// after midnight, so every period is answered from the counters as they are.
+class EnergyMeter
+{
+public:
+    static constexpr uint64_t MAX_GAP_S = 300;
+    static constexpr uint64_t STORE_EVERY_S = 300;
+
+    // Loads the counters of one device, e.g. cache_file(device_key, ".energy").
+    // Samples are ignored until a file is given.
+    int open(const std::filesystem::path &path);
+
+    // One poll of the input registers, taken at stamp_ns (CLOCK_REALTIME)
+    void sample(const uint16_t *input, uint64_t stamp_ns);
+
+    // Temporary file, fsync, rename: a crash leaves either the old or the new counters
+    int store(void);
+
+    void read(int period, EnergyCounters &out) const;
+    uint64_t last_sample_ns(void) const;
+
+    // EnergyMode::mode_t of the unit in one input register block
+    static int classify(const uint16_t *input);
+
+private:
+    struct State
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t last_ns; // previous sample, 0 - none
+        double last_in_w;
+        double last_out_w;
+        int32_t last_mode;
+        int32_t day;      // local date of Today, Month and Year: 20260419, 202604, 2026
+        int32_t month;
+        int32_t year;
+        EnergyCounters period[EnergyPeriod::Count];
+    };
+
+    void roll_over(const tm &local);
+
+    mutable std::mutex mutex_;
+    std::filesystem::path path_;
+    State state_{};
+    uint64_t stored_ns_{0};
+};
+
+extern EnergyMeter g_energy;
+
+// "energy show [period]"
+void print_energy(int period);
+
+#endif // ENERGY_METER_HPP
@@ -0,0 +1,340 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "frame_capture.hpp"
+#include "register_snapshot.hpp"
+
+CaptureRing g_capture;
+
+static constexpr uint32_t PCAPNG_SECTION_HEADER = 0x0A0D0D0A;
+static constexpr uint32_t PCAPNG_INTERFACE_DESCRIPTION = 0x00000001;
+static constexpr uint32_t PCAPNG_ENHANCED_PACKET = 0x00000006;
+static constexpr uint16_t LINKTYPE_IPV4 = 228;
+static constexpr uint16_t LINKTYPE_USER0 = 147;
+static constexpr size_t IP_TCP_HEADER_LENGTH = 40;
+
+void CaptureRing::write(int framing, int direction, uint8_t unit_id, uint8_t function, const uint8_t *adu, size_t length, int outcome, bool rebuilt)
+{
+    uint64_t sequence = head_.fetch_add(1, std::memory_order_relaxed);
+    Slot &slot = slots_[sequence % CAPTURE_FRAMES];
+    slot.seqlock.store(2 * sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    CapturedFrame &frame = slot.frame;
+    frame.stamp_ns = realtime_ns();
+    frame.framing = framing;
+    frame.direction = direction;
+    frame.outcome = outcome == Capture::Ok && (function & 0x80) ? Capture::Exception : outcome;
+    frame.unit_id = unit_id;
+    frame.function = function;
+    frame.rebuilt = rebuilt;
+    frame.length = std::min(length, sizeof(frame.adu));
+    if (frame.length)
+        memcpy(frame.adu, adu, frame.length);
+
+    slot.seqlock.store(2 * sequence + 2, std::memory_order_release);
+}
+
+void CaptureRing::record(int framing, int direction, const uint8_t *adu, size_t length, int outcome)
+{
+    size_t offset = pdu_offset(framing);
+    uint8_t unit_id = length > offset ? adu[offset - 1] : 0;
+    uint8_t function = length > offset ? adu[offset] : 0;
+    write(framing, direction, unit_id, function, adu, length, outcome, false);
+}
+
+void CaptureRing::record_timeout(int framing, uint8_t unit_id, uint8_t function)
+{
+    write(framing, Capture::RxResponse, unit_id, function, nullptr, 0, Capture::Timeout, false);
+}
+
+void CaptureRing::record_pdu(int framing, int direction, uint8_t unit_id, const uint8_t *pdu, size_t pdu_length)
+{
+    uint8_t adu[MBAP_MAX_ADU_LENGTH];
+    pdu_length = std::min(pdu_length, sizeof(adu) - MBAP_HEADER_LENGTH);
+    if (pdu_length == 0)
+        return;
+    memcpy(&adu[pdu_offset(framing)], pdu, pdu_length);
+
+    // Requests get a fresh transaction id, responses repeat the last one
+    uint16_t tid = direction == Capture::TxRequest ? rebuilt_tid_.fetch_add(1, std::memory_order_relaxed) + 1
+                                                   : rebuilt_tid_.load(std::memory_order_relaxed);
+    size_t length = wrap_pdu(framing, adu, pdu_length, unit_id, tid);
+    write(framing, direction, unit_id, pdu[0], adu, length, Capture::Ok, true);
+}
+
+void CaptureRing::record_request(int framing, const ModbusRequest &request)
+{
+    uint8_t pdu[MBAP_MAX_ADU_LENGTH];
+    size_t length = encode_pdu(request, pdu);
+    record_pdu(framing, Capture::TxRequest, request.unit_id, pdu, length);
+}
+
+void CaptureRing::record_result(int framing, const ModbusRequest &request, bool timeout)
+{
+    if (timeout)
+    {
+        record_timeout(framing, request.unit_id, request.function);
+        return;
+    }
+    if (request.rc == -1)
+    {
+        write(framing, Capture::RxResponse, request.unit_id, request.function, nullptr, 0, Capture::Malformed, true);
+        return;
+    }
+
+    uint8_t pdu[MBAP_MAX_ADU_LENGTH];
+    size_t length;
+    if (request.rc > 0)
+    {
+        pdu[0] = request.function | 0x80;
+        pdu[1] = request.rc;
+        length = 2;
+    }
+    else if (request.function == Function_code::ReadHolding || request.function == Function_code::ReadInput)
+    {
+        pdu[0] = request.function;
+        pdu[1] = request.count * 2;
+        store_registers(&pdu[2], request.registers, request.count);
+        length = 2 + request.count * 2;
+    }
+    else
+    {
+        // FC06 and FC22 echo the request, FC16 repeats address and quantity
+        length = encode_pdu(request, pdu);
+        if (request.function != Function_code::MaskWrite)
+            length = std::min<size_t>(length, 5);
+    }
+    record_pdu(framing, Capture::RxResponse, request.unit_id, pdu, length);
+}
+
+int captured_transact(modbus_t *ctx, ModbusRequest &request)
+{
+    int framing = modbus_get_header_length(ctx) > 1 ? Framing::Tcp : Framing::Rtu;
+    g_capture.record_request(framing, request);
+
+    int rc{-1};
+    errno = EINVAL;
+    switch (request.function)
+    {
+    case Function_code::ReadInput:
+        rc = modbus_read_input_registers(ctx, request.addr, request.count, request.registers);
+        break;
+    case Function_code::ReadHolding:
+        rc = modbus_read_registers(ctx, request.addr, request.count, request.registers);
+        break;
+    case Function_code::WriteSingle:
+        rc = modbus_write_register(ctx, request.addr, request.registers[0]);
+        break;
+    case Function_code::WriteMultiple:
+        rc = modbus_write_registers(ctx, request.addr, request.count, request.registers);
+        break;
+    case Function_code::MaskWrite:
+        rc = modbus_mask_write_register(ctx, request.addr, request.registers[0], request.registers[1]);
+        break;
+    }
+
+    int saved_errno = errno;
+    request.rc = 0;
+    if (rc == -1)
+        request.rc = saved_errno > MODBUS_ENOBASE && saved_errno <= EMBXGTAR ? saved_errno - MODBUS_ENOBASE : -1;
+    g_capture.record_result(framing, request, rc == -1 && saved_errno == ETIMEDOUT);
+    errno = saved_errno;
+    return rc == -1 ? -1 : 0;
+}
+
+void CaptureRing::copy(std::vector<CapturedFrame> &out) const
+{
+    uint64_t head = head_.load(std::memory_order_acquire);
+    uint64_t first = head > CAPTURE_FRAMES ? head - CAPTURE_FRAMES : 0;
+    out.clear();
+    out.reserve(head - first);
+
+    CapturedFrame frame;
+    for (uint64_t sequence = first; sequence < head; sequence++)
+    {
+        const Slot &slot = slots_[sequence % CAPTURE_FRAMES];
+        uint64_t before = slot.seqlock.load(std::memory_order_acquire);
+        if (before != 2 * sequence + 2)
+            continue; // still being written, or already overwritten by a newer frame
+
+        memcpy(&frame, &slot.frame, sizeof(frame));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seqlock.load(std::memory_order_relaxed) == before)
+            out.push_back(frame);
+    }
+}
+
+// pcapng blocks are built in host byte order, the packet contents in network order
+
+static void put(std::string &block, const void *data, size_t length)
+{
+    block.append(static_cast<const char *>(data), length);
+}
+
+static void put16(std::string &block, uint16_t value) { put(block, &value, sizeof(value)); }
+static void put32(std::string &block, uint32_t value) { put(block, &value, sizeof(value)); }
+
+static void pad(std::string &block)
+{
+    block.append((4 - block.size() % 4) % 4, '\0');
+}
+
+static void option(std::string &block, uint16_t code, const void *value, uint16_t length)
+{
+    put16(block, code);
+    put16(block, length);
+    put(block, value, length);
+    pad(block);
+}
+
+static void end_of_options(std::string &block)
+{
+    put32(block, 0);
+}
+
+static bool write_block(FILE *file, uint32_t type, const std::string &body)
+{
+    uint32_t total = 12 + body.size();
+    return fwrite(&type, 4, 1, file) == 1 && fwrite(&total, 4, 1, file) == 1 &&
+           fwrite(body.data(), 1, body.size(), file) == body.size() && fwrite(&total, 4, 1, file) == 1;
+}
+
+static bool write_interface(FILE *file, uint16_t linktype, const char *name)
+{
+    std::string body;
+    put16(body, linktype);
+    put16(body, 0);
+    put32(body, IP_TCP_HEADER_LENGTH + MBAP_MAX_ADU_LENGTH);
+    option(body, 2, name, strlen(name)); // if_name
+    uint8_t resolution = 9;              // if_tsresol, nanoseconds
+    option(body, 9, &resolution, 1);
+    end_of_options(body);
+    return write_block(file, PCAPNG_INTERFACE_DESCRIPTION, body);
+}
+
+static uint16_t ip_checksum(const uint8_t *header, size_t length)
+{
+    uint32_t sum = 0;
+    for (size_t i = 0; i < length; i += 2)
+        sum += (header[i] << 8) | header[i + 1];
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return ~sum;
+}
+
+// Modbus/TCP frames get IPv4 and TCP headers so Wireshark dissects them on port 502.
+// Our client side talks from 10.0.0.1 to the unit at 10.0.0.2, gateway clients
+// come from 10.0.0.3 to our port 502. Each direction is a stream of its own.
+static size_t ip_tcp_header(const CapturedFrame &frame, uint32_t *stream_seq, uint8_t *header)
+{
+    static const uint8_t us[] = {10, 0, 0, 1}, unit[] = {10, 0, 0, 2}, client[] = {10, 0, 0, 3};
+    bool server_side = frame.direction == Capture::RxRequest || frame.direction == Capture::TxResponse;
+    bool query = frame.direction == Capture::TxRequest || frame.direction == Capture::RxRequest;
+    bool sent = frame.direction == Capture::TxRequest || frame.direction == Capture::TxResponse;
+    const uint8_t *peer = server_side ? client : unit;
+    uint16_t client_port = server_side ? 50201 : 50200;
+
+    memset(header, 0, IP_TCP_HEADER_LENGTH);
+    uint16_t total = IP_TCP_HEADER_LENGTH + frame.length;
+    header[0] = 0x45;
+    header[2] = total >> 8;
+    header[3] = total & 0xff;
+    header[6] = 0x40; // don't fragment
+    header[8] = 64;   // TTL
+    header[9] = 6;    // TCP
+    memcpy(&header[12], sent ? us : peer, 4);
+    memcpy(&header[16], sent ? peer : us, 4);
+    uint16_t checksum = ip_checksum(header, 20);
+    header[10] = checksum >> 8;
+    header[11] = checksum & 0xff;
+
+    uint8_t *tcp = &header[20];
+    uint16_t source = query ? client_port : 502;
+    uint16_t destination = query ? 502 : client_port;
+    uint32_t seq = stream_seq[frame.direction];
+    uint32_t ack = stream_seq[frame.direction ^ 1]; // the opposite stream of the same connection
+    stream_seq[frame.direction] += frame.length;
+    tcp[0] = source >> 8, tcp[1] = source & 0xff;
+    tcp[2] = destination >> 8, tcp[3] = destination & 0xff;
+    for (int i = 0; i < 4; i++)
+    {
+        tcp[4 + i] = seq >> (24 - 8 * i);
+        tcp[8 + i] = ack >> (24 - 8 * i);
+    }
+    tcp[12] = 5 << 4; // header length in words
+    tcp[13] = 0x18;   // PSH, ACK
+    tcp[14] = tcp[15] = 0xff;
+    return IP_TCP_HEADER_LENGTH;
+}
+
+static std::string comment(const CapturedFrame &frame)
+{
+    std::string text;
+    if (frame.outcome == Capture::Timeout)
+        text = "no response (timeout)";
+    else if (frame.outcome == Capture::Malformed)
+        text = "malformed response (bad CRC, header or length)";
+    if (frame.rebuilt)
+        text += text.empty() ? "rebuilt from a libmodbus call" : ", rebuilt from a libmodbus call";
+    return text;
+}
+
+int CaptureRing::dump(const char *path) const
+{
+    std::vector<CapturedFrame> frames;
+    copy(frames);
+
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        fprintf(stderr, "Unable to create %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    std::string body;
+    put32(body, 0x1A2B3C4D); // byte order magic
+    put16(body, 1);          // version 1.0
+    put16(body, 0);
+    put32(body, 0xffffffff); // section length unknown
+    put32(body, 0xffffffff);
+    option(body, 4, "remote_cli", 10); // shb_userappl
+    end_of_options(body);
+    bool ok = write_block(file, PCAPNG_SECTION_HEADER, body) &&
+              write_interface(file, LINKTYPE_IPV4, "modbus-tcp") && // interface 0
+              write_interface(file, LINKTYPE_USER0, "modbus-rtu");  // interface 1
+
+    uint32_t stream_seq[4]{1, 1, 1, 1};
+    for (size_t i = 0; ok && i < frames.size(); i++)
+    {
+        const CapturedFrame &frame = frames[i];
+        uint8_t packet[IP_TCP_HEADER_LENGTH + MBAP_MAX_ADU_LENGTH];
+        size_t header = frame.framing == Framing::Tcp ? ip_tcp_header(frame, stream_seq, packet) : 0;
+        memcpy(&packet[header], frame.adu, frame.length);
+        uint32_t length = header + frame.length;
+
+        body.clear();
+        put32(body, frame.framing == Framing::Tcp ? 0 : 1);
+        put32(body, frame.stamp_ns >> 32);
+        put32(body, frame.stamp_ns & 0xffffffff);
+        put32(body, length);
+        put32(body, length);
+        put(body, packet, length);
+        pad(body);
+        std::string text = comment(frame);
+        if (!text.empty())
+            option(body, 1, text.data(), text.size()); // opt_comment
+        end_of_options(body);
+        ok = write_block(file, PCAPNG_ENHANCED_PACKET, body);
+    }
+
+    if (fclose(file) != 0 || !ok)
+    {
+        fprintf(stderr, "Unable to write %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    return static_cast<int>(frames.size());
+}
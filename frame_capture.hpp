@@ -0,0 +1,88 @@
+#ifndef FRAME_CAPTURE_HPP
+#define FRAME_CAPTURE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <modbus/modbus.h>
+
+#include "modbus_adu.hpp"
+
+inline constexpr size_t CAPTURE_FRAMES = 1024;
+
+namespace Capture
+{
+    enum direction_t
+    {
+        TxRequest = 0, // we asked a unit
+        RxResponse,    // and it answered
+        RxRequest,     // a gateway client asked us
+        TxResponse,    // and we answered
+    };
+
+    enum outcome_t
+    {
+        Ok = 0,
+        Exception, // exception response, set automatically from the function code
+        Timeout,   // nothing came back, the frame is empty
+        Malformed, // bad CRC, header or length
+    };
+}
+
+struct CapturedFrame
+{
+    uint64_t stamp_ns; // CLOCK_REALTIME
+    uint8_t framing;   // Framing::framing_t
+    uint8_t direction; // Capture::direction_t
+    uint8_t outcome;   // Capture::outcome_t
+    uint8_t unit_id;
+    uint8_t function;
+    bool rebuilt;      // reconstructed from a libmodbus call, not the bytes on the line
+    uint16_t length;   // bytes in `adu`
+    uint8_t adu[MBAP_MAX_ADU_LENGTH];
+};
+
+// The last CAPTURE_FRAMES ADUs of every transport, always on. Recording a
+// frame claims a slot with one fetch_add and brackets the copy with two
+// stores of the slot's seqlock, so it never blocks and never allocates.
+class CaptureRing
+{
+public:
+    void record(int framing, int direction, const uint8_t *adu, size_t length, int outcome = Capture::Ok);
+    void record_timeout(int framing, uint8_t unit_id, uint8_t function);
+
+    // libmodbus keeps its frames to itself, these rebuild them from the call and its result
+    void record_pdu(int framing, int direction, uint8_t unit_id, const uint8_t *pdu, size_t pdu_length);
+    void record_request(int framing, const ModbusRequest &request);
+    void record_result(int framing, const ModbusRequest &request, bool timeout);
+
+    // Consistent copies of the frames still in the ring, oldest first
+    void copy(std::vector<CapturedFrame> &out) const;
+
+    // Writes the ring as pcapng: Modbus/TCP on synthetic IPv4/TCP port 502, RTU as
+    // LINKTYPE_USER0 (Wireshark: DLT User, payload protocol mbrtu). Returns frames written or -1.
+    int dump(const char *path) const;
+
+private:
+    void write(int framing, int direction, uint8_t unit_id, uint8_t function, const uint8_t *adu, size_t length, int outcome, bool rebuilt);
+
+    struct Slot
+    {
+        std::atomic<uint64_t> seqlock{0}; // 2 * sequence + 1 while written, + 2 when complete
+        CapturedFrame frame;
+    };
+
+    std::atomic<uint64_t> head_{0};
+    std::atomic<uint16_t> rebuilt_tid_{0};
+    Slot slots_[CAPTURE_FRAMES];
+};
+
+extern CaptureRing g_capture;
+
+// Blocking libmodbus call for `request` on the connected `ctx`, recorded in g_capture.
+// Sets request.rc like the pipeline, returns -1 with errno set on failure.
+int captured_transact(modbus_t *ctx, ModbusRequest &request);
+
+#endif // FRAME_CAPTURE_HPP
@@ -1,62 +1,131 @@
 #ifndef LOOKUP_TABLE_H
 #define LOOKUP_TABLE_H
+#include <algorithm>
 #include <cinttypes>
-#include <map>
+#include <cstddef>
+#include <initializer_list>
+#include <span>
+#include <type_traits>
+#include <utility>
 
-template <typename T>
+// Piecewise linear function through up to N points: flat below the first point,
+// interpolated between points and extrapolated past the last one along the last
+// segment. Points are kept as hinges, y(x) = y0 + sum(d_i * max(0, x - x_i))
+// with d_i the change of slope at x_i, so evaluating needs neither a search nor
+// a branch and the batch get() vectorizes.
+template <typename T, size_t N>
 class LookupTable
 {
-private:
-    std::map<T, T> table;
+    static_assert(N >= 2, "a lookup table needs at least two points");
 
 public:
-    explicit LookupTable(std::map<T, T> input)
-        : table(std::move(input))
+    constexpr LookupTable() = default;
+
+    // Points in any order, the first one wins when x repeats, points beyond N are dropped
+    constexpr LookupTable(std::initializer_list<std::pair<T, T>> points)
     {
+        std::pair<T, T> sorted[N]{};
+        size_t count = 0;
+        for (const auto &point : points)
+        {
+            bool duplicate = false;
+            for (size_t i = 0; i < count; i++)
+                duplicate |= sorted[i].first == point.first;
+            if (duplicate || count == N)
+                continue;
+
+            size_t pos = count++;
+            for (; pos > 0 && sorted[pos - 1].first > point.first; pos--)
+                sorted[pos] = sorted[pos - 1];
+            sorted[pos] = point;
+        }
+
+        if (count == 0)
+            return;
+        y0_ = static_cast<float>(sorted[0].second);
+        float previous_slope = 0.0f;
+        for (size_t i = 0; i + 1 < count; i++)
+        {
+            float dx = static_cast<float>(sorted[i + 1].first) - static_cast<float>(sorted[i].first);
+            float dy = static_cast<float>(sorted[i + 1].second) - static_cast<float>(sorted[i].second);
+            float slope = dy / dx;
+            x_[i] = static_cast<float>(sorted[i].first);
+            d_[i] = slope - previous_slope;
+            previous_slope = slope;
+        }
     }
 
+    // An empty table maps everything to 0
     T get(T key) const
     {
-        if (table.empty())
-            return 0; // Or throw, depending on your error handling strategy
-
-        auto first = table.begin();
-        auto last = std::prev(table.end());
-
-        // Clamp low
-        if (key <= first->first)
-            return first->second;
+        return convert<T>(evaluate(static_cast<float>(key)));
+    }
 
-        if (key == last->first)
-            return last->second;
+    // Converts min(keys.size(), out.size()) values. Works in fixed size blocks,
+    // one hinge at a time, so every inner loop is a plain array operation with
+    // a constant trip count which the compiler vectorizes even at -O2.
+    template <typename In, typename Out>
+    void get(std::span<const In> keys, std::span<Out> out) const
+    {
+        const size_t count = std::min(keys.size(), out.size());
+        size_t base = 0;
+        for (; base + BLOCK <= count; base += BLOCK)
+            get_block(&keys[base], &out[base]);
 
-        // Extrapolation
-        if (key > last->first)
+        if (base < count)
         {
-            auto upper = last;
-            auto lower = std::prev(upper);
-            // printf("lower = %ld upper = %ld\n", lower->first, upper->first);
-            return extrapolate(key, lower->first, lower->second, upper->first, upper->second);
+            In tail_keys[BLOCK]{};
+            Out tail_out[BLOCK];
+            std::copy(keys.begin() + base, keys.begin() + count, tail_keys);
+            get_block(tail_keys, tail_out);
+            std::copy(tail_out, tail_out + (count - base), out.begin() + base);
         }
+    }
 
-        // Interpolation: find first element greater than key
-        auto upper = table.upper_bound(key);
-        auto lower = std::prev(upper);
+private:
+    static constexpr size_t BLOCK = 256;
 
-        return interpolate(key, lower->first, lower->second, upper->first, upper->second);
+    template <typename In, typename Out>
+    void get_block(const In *keys, Out *out) const
+    {
+        float x[BLOCK];
+        float y[BLOCK];
+        for (size_t k = 0; k < BLOCK; k++)
+        {
+            x[k] = static_cast<float>(keys[k]);
+            y[k] = y0_;
+        }
+        for (size_t i = 0; i < N - 1; i++)
+        {
+            const float xi = x_[i];
+            const float di = d_[i];
+            for (size_t k = 0; k < BLOCK; k++)
+                y[k] += di * std::max(0.0f, x[k] - xi);
+        }
+        for (size_t k = 0; k < BLOCK; k++)
+            out[k] = convert<Out>(y[k]);
     }
 
-private:
-    static T interpolate(T x, T x0, T y0, T x1, T y1)
+    float evaluate(float x) const
     {
-        float ratio = static_cast<float>(x - x0) / (x1 - x0);
-        return static_cast<T>(y0 + ratio * (y1 - y0));
+        float y = y0_;
+        for (size_t i = 0; i < N - 1; i++) // unused hinges have d_i = 0
+            y += d_[i] * std::max(0.0f, x - x_[i]);
+        return y;
     }
 
-    static T extrapolate(T x, T x0, T y0, T x1, T y1)
+    // Integers are rounded to nearest, not truncated, so points map onto their own y
+    template <typename Out>
+    static Out convert(float y)
     {
-        float slope = static_cast<float>(y1 - y0) / (x1 - x0);
-        return static_cast<T>(y1 + slope * (x - x1));
+        if constexpr (std::is_integral_v<Out>)
+            return static_cast<Out>(y + (y < 0.0f ? -0.5f : 0.5f));
+        else
+            return static_cast<Out>(y);
     }
+
+    float y0_{0.0f};
+    float x_[N - 1]{};
+    float d_[N - 1]{};
 };
-#endif
\ No newline at end of file
+#endif
@@ -1,4 +1,5 @@
 #include <atomic>
+#include <cinttypes>
 #include <cstdio>
 #include <cstring>
 #include <fstream>
@@ -11,7 +12,6 @@
 #include <limits>
 #include <thread>
 #include <set>
-#include <regex>
 #include <string>
 #include <vector>
 
@@ -21,12 +21,34 @@
 #include "modbus_registers.h"
 #include "struct.h"
 #include "cli_commands.hpp"
+#include "modbus_pipeline.hpp"
+#include "async_registers.hpp"
+#include "modbus_gateway.hpp"
+#include "single_flight.hpp"
+#include "register_snapshot.hpp"
+#include "metrics_server.hpp"
+#include "transport_stats.hpp"
+#include "deadband.hpp"
+#include "warm_cache.hpp"
+#include "device_caps.hpp"
+#include "report.hpp"
+#include "args.hpp"
+#include "register_table.hpp"
+#include "settings_push.hpp"
+#include "crc16.hpp"
+#include "frame_capture.hpp"
+#include "traffic_replay.hpp"
+#include "energy_meter.hpp"
+#include "monitor_expr.hpp"
+#include "alert_rules.hpp"
+#include "countdown.hpp"
+#include "poll_planner.hpp"
 #include "Prompt.hpp"
 
 using namespace cli;
 
 void write_settings_to_file(const std::filesystem::path &file);
-void read_registers_from_file(const std::filesystem::path &file);
+int read_registers_from_file(const std::filesystem::path &file);
 
 int writeMultipleRegisters(uint16_t *registers, uint16_t addr, uint16_t count);
 int updateHoldingRegister(uint16_t from, uint16_t to);
@@ -34,8 +56,23 @@ int updateHoldingRegister(uint16_t reg);
 int updateInputRegister(uint16_t from, uint16_t to);
 int updateInputRegister(uint16_t reg);
 int writeRegister(uint16_t reg, uint16_t value);
+int updateAllRegisters(void);
+int updateRegistersForShow(void);
+void holdingBlockLoaded(void);
+void inputRegistersLoaded(uint16_t from, uint16_t to);
+void refreshInBackground(void);
+int readInputRegisters(uint16_t from, uint16_t to);
+int maskWriteRegister(uint16_t reg, uint16_t and_mask, uint16_t or_mask);
+int probeCapabilities(bool force);
+int checkIdentity(void);
+
+constexpr uint8_t MODBUS_SLAVE_ID{53};
 
 std::atomic<bool> g_monitor_enable = false;
+Notifier monitor_wakeup; // g_monitor_enable changed
+Notifier alerts_changed; // a rule was added
+Notifier timer_stop;     // ends the timer thread
+std::thread g_refresh_thread; // refreshInBackground(), joined before the next one and on exit
 Prompt my_prompt("AHU_2040");
 
 uint16_t *holdingRegisters{nullptr};
@@ -45,43 +82,87 @@ std::vector<std::string> monitor_names;
 std::vector<uint16_t> monitor_registers;
 
 std::map<std::string, uint16_t> monitored;
+std::map<std::string, MonitorExpression> monitored_expressions; // derived channels, "misc monitor expr"
+DeadbandFilter monitor_filter;
 
 modbus_t *ctx;
+ModbusPipeline *pipeline{nullptr}; // used instead of ctx when -w is given (TCP only)
+const char *tcp_host{nullptr};     // set when connected over Modbus TCP
+uint16_t tcp_port{502};
 std::mutex monitor_mutex;
 std::mutex modbus_mutex;
-
-bool isInt(const std::string &s)
+SingleFlight input_flights;
+TransportStats g_transport_stats;
+bool g_snapshot_polling{false}; // keep g_snapshot fresh in the background (metrics, exporters)
+bool g_energy_polling{false};   // --energy, read what the energy meter needs when nothing else does
+std::filesystem::path capabilities_file; // probe results of this device, see device_caps.hpp
+bool g_offline{false};                   // --offline, the register model is all there is
+std::string g_push_target;               // default of "settings push", the device given with -i/-d
+std::atomic<int64_t> g_holding_loaded{0}; // steady clock ticks of the last whole holding block read, 0 - never
+constexpr auto HOLDING_MAX_AGE = std::chrono::seconds(30);
+
+static constexpr ArgSpec INPUT_REGISTER_ARG{"register", Arg::Int, 0, e_input_last_item - 1};
+
+// Splits "[address]:port", an empty address means all interfaces
+bool parseAddress(const std::string &str, std::string &host, uint16_t &port)
 {
-    try
-    {
-        size_t pos;
-        std::stoi(s, &pos);
-        return pos == s.size();
-    }
-    catch (...)
-    {
+    auto colon = str.rfind(':');
+    int32_t value;
+    const char *error;
+    if (colon == std::string::npos || parse_arg(std::string_view(str).substr(colon + 1), {"port", Arg::Int, 1, UINT16_MAX}, value, error) == -1)
         return false;
-    }
+
+    host = str.substr(0, colon);
+    port = static_cast<uint16_t>(value);
+    return true;
 }
 
 void monitor_add(const std::string &str)
 {
     std::unique_lock lk(monitor_mutex);
-    Tokens tokens = tokenize(str);
+    ArgTokens tokens(str);
     if (tokens.size() != 2)
     {
         printf("Wrong syntax\n");
         return;
     }
-    if (isInt(tokens[1]))
+
+    int32_t reg = find_input_register(tokens[1]);
+    const char *error;
+    if (reg != -1 || parse_arg(tokens[1], INPUT_REGISTER_ARG, reg, error) == 0)
     {
-        monitored.emplace(tokens[0], std::stoi(tokens[1]));
-        printf("Added %s = %u\n", tokens[0].c_str(), monitored[tokens[0]]);
+        std::string name(tokens[0]);
+        monitored.emplace(name, static_cast<uint16_t>(reg));
+        printf("Added %s = %u\n", name.c_str(), monitored[name]);
     }
     else
     {
-        printf("second parameter must be positive integer\n");
+        printf("second parameter must be an input register number (0..%u) or name\n", e_input_last_item - 1);
+    }
+}
+
+// NAME = expression, see MonitorExpression
+void monitor_expr(const std::string &str)
+{
+    auto equal_pos = str.find('=');
+    ArgTokens name(std::string_view(str).substr(0, equal_pos == std::string::npos ? 0 : equal_pos));
+    if (name.size() != 1)
+    {
+        printf("Usage: NAME = expression, e.g. T5_T3 = t5 - t3\n");
+        return;
+    }
+
+    MonitorExpression expression;
+    std::string error;
+    if (expression.compile(std::string_view(str).substr(equal_pos + 1), error) == -1)
+    {
+        printf("%s\n", error.c_str());
+        return;
     }
+
+    std::unique_lock lk(monitor_mutex);
+    monitored_expressions.insert_or_assign(std::string(name[0]), std::move(expression));
+    printf("Added %.*s = %s\n", static_cast<int>(name[0].size()), name[0].data(), monitored_expressions[std::string(name[0])].text().c_str());
 }
 
 void monitor_remove(const std::string &str)
@@ -93,6 +174,10 @@ void monitor_remove(const std::string &str)
         printf("Removing (%s)\n", str.c_str());
         monitored.erase(it);
     }
+    else if (monitored_expressions.erase(str))
+    {
+        printf("Removing (%s)\n", str.c_str());
+    }
     else
     {
         printf("No such register in monitor map (%s)\n", str.c_str());
@@ -104,97 +189,351 @@ void monitor_show()
     std::unique_lock lk(monitor_mutex);
     for (const auto &element : monitored)
     {
-        printf("%s = %u (%s)\n", element.first.c_str(), element.second, inputRegToStr(element.second));
+        printf("%s = %u (%s) deadband %g, poll %s%s\n", element.first.c_str(), element.second, inputRegToStr(element.second), monitor_filter.deadband(element.second),
+               POLL_CLASSES[g_poll_planner.poll_class(element.second)], g_poll_planner.pinned(element.second) ? " (pinned)" : "");
     }
+    for (const auto &element : monitored_expressions)
+        printf("%s = %s\n", element.first.c_str(), element.second.text().c_str());
+    if (monitor_filter.enabled() && monitor_filter.max_silence().count() > 0)
+        printf("Report by exception, max silence %lld [s]\n", static_cast<long long>(monitor_filter.max_silence().count()));
+    else if (monitor_filter.enabled())
+        printf("Report by exception, no forced re-report\n");
+    else
+        printf("Reporting every sample\n");
+
+    uint64_t registers, requests, flat_registers, flat_requests;
+    g_poll_planner.load(registers, requests, flat_registers, flat_requests);
+    if (flat_requests > 0)
+        printf("Read %" PRIu64 " registers in %" PRIu64 " requests, polling everything every tick: %" PRIu64 " in %" PRIu64 "\n", registers, requests, flat_registers, flat_requests);
+}
+
+// NAME fast|medium|slow|auto, auto - adapt to how fast the register changes
+void monitor_poll(const std::string &str)
+{
+    static constexpr const char *CHOICES[] = {"fast", "medium", "slow", "auto", nullptr};
+    static constexpr ArgSpec CLASS_ARG{"class", Arg::Enum, 0, PollClass::Count, 1, CHOICES};
+
+    std::unique_lock lk(monitor_mutex);
+    ArgTokens tokens(str);
+    int32_t poll_class;
+    const char *error;
+    if (tokens.size() != 2 || parse_arg(tokens[1], CLASS_ARG, poll_class, error) == -1)
+    {
+        printf("Usage: NAME fast|medium|slow|auto\n");
+        return;
+    }
+
+    auto it = monitored.find(std::string(tokens[0]));
+    if (it == monitored.end())
+    {
+        printf("No such register in monitor map (%.*s)\n", static_cast<int>(tokens[0].size()), tokens[0].data());
+        return;
+    }
+    g_poll_planner.pin(it->second, poll_class == PollClass::Count ? -1 : poll_class);
+    printf("Polling %s %s\n", it->first.c_str(), CHOICES[poll_class]);
+}
+
+void monitor_deadband(const std::string &str)
+{
+    std::unique_lock lk(monitor_mutex);
+    ArgTokens tokens(str);
+    if (tokens.size() != 2)
+    {
+        printf("Usage: NAME VALUE (in engineering units, e.g. T5 0.5)\n");
+        return;
+    }
+
+    auto it = monitored.find(std::string(tokens[0]));
+    if (it == monitored.end())
+    {
+        printf("No such register in monitor map (%.*s)\n", static_cast<int>(tokens[0].size()), tokens[0].data());
+        return;
+    }
+
+    int32_t milli;
+    const char *error;
+    if (parse_arg(tokens[1], {"deadband", Arg::Float, 0, INT32_MAX, 1000}, milli, error) == -1)
+    {
+        printf("deadband: %s\n", error);
+        return;
+    }
+    monitor_filter.set_deadband(it->second, milli / 1000.0f);
+    printf("Deadband of %s = %g\n", it->first.c_str(), monitor_filter.deadband(it->second));
+}
+
+void monitor_silence(const std::string &str)
+{
+    int32_t seconds;
+    const char *error;
+    if (parse_arg(str, {"seconds", Arg::Int, 0, INT32_MAX}, seconds, error) == -1)
+    {
+        printf("Usage: SECONDS (0 - report only what moved beyond its deadband)\n");
+        return;
+    }
+    std::unique_lock lk(monitor_mutex);
+    monitor_filter.set_max_silence(std::chrono::seconds(seconds));
 }
 
 void set_monitor(const std::string &str)
 {
     std::unique_lock lk(monitor_mutex);
-    Tokens tokens = tokenize(str);
+    ArgTokens tokens(str);
     monitor_names.clear();
     monitor_registers.clear();
 
-    for (const auto &myToken : tokens)
+    for (auto myToken : tokens)
     {
         auto equal_pos = myToken.find('=');
-        if (equal_pos == std::string::npos || equal_pos == 0 || equal_pos == myToken.size() - 1)
+        if (equal_pos == std::string_view::npos || equal_pos == 0 || equal_pos == myToken.size() - 1)
         {
             std::cerr << "incorrect syntax\n";
             return;
         }
 
-        std::string name = myToken.substr(0, equal_pos);
-        std::string valStr = myToken.substr(equal_pos + 1);
+        int32_t val;
+        const char *error;
+        if (parse_arg(myToken.substr(equal_pos + 1), INPUT_REGISTER_ARG, val, error) == -1)
+        {
+            std::cerr << myToken.substr(equal_pos + 1) << ": " << error << " (max = " << e_input_last_item - 1 << ").\n";
+            return;
+        }
+        monitor_names.emplace_back(myToken.substr(0, equal_pos));
+        monitor_registers.emplace_back(static_cast<uint16_t>(val));
+    }
+}
+
+// PollWant::want_t of every input register: monitored ones by their poll class,
+// everything the expressions read on every tick so rate() and ewma() see fresh
+// values. False when nothing is monitored.
+bool monitor_wanted(uint8_t *wanted)
+{
+    std::unique_lock lk(monitor_mutex);
+    std::fill_n(wanted, e_input_last_item, PollWant::No);
+    bool any = false;
+    for (const auto &element : monitored)
+    {
+        wanted[element.second] = PollWant::ByClass;
+        any = true;
+    }
+
+    for (const auto &element : monitored_expressions)
+    {
+        element.second.mark_inputs(wanted, PollWant::Always);
+        any = true;
+    }
+    return any;
+}
 
-        try
+// `fresh` marks the registers read on this tick, without a deadband only those are printed
+void print_monitor(const uint8_t *fresh)
+{
+    std::unique_lock lk(monitor_mutex);
+    uint8_t report[e_input_last_item];
+    monitor_filter.evaluate(inputRegisters, report);
+
+    std::string product;
+    for (const auto &element : monitored)
+    {
+        if (monitor_filter.enabled() ? !report[element.second] : !fresh[element.second])
+            continue;
+
+        const auto &desc = input_register(element.second);
+        product = product + element.first + "=" + to_string_with_precision(desc.to_engineering(inputRegisters[element.second]), desc.precision()) + " ";
+    }
+    monitor_filter.commit(inputRegisters, report);
+
+    // evaluated on every sample so rate() and ewma() see all of them, not covered by the deadband
+    for (auto &element : monitored_expressions)
+        product = product + element.first + "=" + to_string_with_precision(element.second.evaluate(inputRegisters, holdingRegisters), 2) + " ";
+
+    if (!product.empty())
+        printf("\r%s\n", product.c_str());
+}
+
+// Lateness of the periodic tasks, see "system show timing"
+PeriodicStats g_monitor_timing{"monitor"};
+PeriodicStats g_snapshot_timing{"snapshot"};
+PeriodicStats g_energy_timing{"energy"};
+PeriodicStats g_alert_timing{"alerts"};
+std::atomic<uint64_t> g_countdown_reads{0};
+
+Task<> monitor_task(Scheduler &sched, AsyncRegisters &regs, int ms)
+{
+    PeriodicTimer timer(sched, std::chrono::milliseconds(ms), &g_monitor_timing);
+    std::vector<PollRange> batches;
+    for (uint64_t tick = 0; !sched.stopping(); tick++)
+    {
+        if (!g_monitor_enable)
         {
-            uint16_t val = static_cast<uint16_t>(std::stoul(valStr));
-            if (val < e_input_last_item)
-            {
-                monitor_names.emplace_back(name);
-                monitor_registers.emplace_back(val);
-            }
-            else
-                std::cerr << val << " is too big (max = " << e_input_last_item << ").\n";
+            // no wake-ups at all until the monitor is enabled again
+            co_await sched.readable(monitor_wakeup.fd(), Scheduler::Clock::time_point::max());
+            monitor_wakeup.drain();
+            timer.restart();
+            continue;
         }
-        catch (const std::exception &e)
+        co_await timer.tick();
+
+        uint8_t wanted[e_input_last_item];
+        if (!g_monitor_enable || !monitor_wanted(wanted))
+            continue;
+
+        // fast registers on every tick, slower classes only on some, see PollPlanner
+        uint8_t fresh[e_input_last_item]{};
+        bool any = false;
+        g_poll_planner.plan(tick, wanted, g_caps.max_read_registers, batches);
+        for (const auto &batch : batches)
         {
-            std::cerr << "conversion failed: " << e.what() << "\n";
-            return;
+            if (co_await regs.read_input(batch.first, batch.last) != 0)
+                continue;
+            g_poll_planner.observe(inputRegisters, batch.first, batch.last);
+            std::fill(fresh + batch.first, fresh + batch.last + 1, 1);
+            any = true;
         }
+        if (any)
+            print_monitor(fresh);
     }
 }
 
-void print_monitor(void)
+// Keeps g_snapshot fresh for consumers which must not touch the bus themselves
+Task<> snapshot_task(Scheduler &sched, AsyncRegisters &regs)
 {
-    std::unique_lock lk(monitor_mutex);
-    if (g_monitor_enable)
+    constexpr auto input_period = std::chrono::seconds(5);
+    constexpr int holding_every = 12; // holding block once a minute, it rarely changes
+
+    PeriodicTimer timer(sched, input_period, &g_snapshot_timing);
+    for (int cycle = 0; !sched.stopping(); cycle++)
     {
-        auto it1 = std::min_element(
-            monitored.begin(), monitored.end(),
-            [](auto &a, auto &b)
-            { return a.second < b.second; });
+        if (cycle % holding_every == 0 && co_await regs.read_holding(0, e_holding_last_item - 1) == 0)
+            holdingBlockLoaded();
+        if (co_await regs.read_input(0, e_input_last_item - 1) == 0)
+            g_snapshot.publish_input(inputRegisters);
+        co_await timer.tick();
+    }
+}
 
-        uint16_t min = it1->second;
+// Reads what the energy meter needs whenever no other poll fed it recently, only
+// with --energy: otherwise the meter takes what the other polls read anyway
+Task<> energy_task(Scheduler &sched, AsyncRegisters &regs)
+{
+    constexpr auto period = std::chrono::seconds(10);
+    constexpr uint64_t period_ns = std::chrono::nanoseconds(period).count();
 
-        auto it2 = std::max_element(
-            monitored.begin(), monitored.end(),
-            [](auto &a, auto &b)
-            { return a.second < b.second; });
+    PeriodicTimer timer(sched, period, &g_energy_timing);
+    while (!sched.stopping())
+    {
+        if (realtime_ns() - g_energy.last_sample_ns() >= period_ns)
+            co_await regs.read_input(ENERGY_FIRST_REGISTER, ENERGY_LAST_REGISTER);
+        co_await timer.tick();
+    }
+}
 
-        uint16_t max = it2->second;
-        // Find min-max of monitored registers
+// Reads what the alert rules need, idle while there are none
+Task<> alert_task(Scheduler &sched, AsyncRegisters &regs)
+{
+    PeriodicTimer timer(sched, std::chrono::seconds(2), &g_alert_timing);
+    while (!sched.stopping())
+    {
+        uint16_t first, last;
+        if (!g_alerts.range(first, last))
         {
-            // uint16_t min = *std::min_element(monitor_registers.begin(), monitor_registers.end());
-            // uint16_t max = *std::max_element(monitor_registers.begin(), monitor_registers.end());
-            updateInputRegister(min, max);
+            co_await sched.readable(alerts_changed.fd(), Scheduler::Clock::time_point::max());
+            alerts_changed.drain();
+            timer.restart();
+            continue;
         }
+        co_await regs.read_input(first, last);
+        co_await timer.tick();
+    }
+}
 
-        std::string product;
-        for (const auto &element : monitored)
+// Re-reads the countdown registers only when the model asks for it, between
+// reads the CLI shows them extrapolated. Parked while nothing shows them.
+Task<> countdown_task(Scheduler &sched, AsyncRegisters &regs)
+{
+    while (!sched.stopping())
+    {
+        if (!g_countdowns.watched())
         {
-            if (getInputRegScaleFactor(element.second) == 0)
-                product = product + element.first + "=" + std::to_string((int16_t)inputRegisters[element.second]) + " ";
-            else
-            {
-                product = product + element.first + "=" + to_string_with_precision((float)((int16_t)inputRegisters[element.second]) / 10.0, 1) + " ";
-            }
+            co_await sched.readable(g_countdowns.shown_fd(), Scheduler::Clock::time_point::max());
+            g_countdowns.drain_shown();
+            continue;
         }
-        printf("\r%s\n", product.c_str());
+
+        auto next = g_countdowns.next_sync();
+        if (Scheduler::Clock::now() < next)
+        {
+            // until the re-sync is due or nothing shows the countdowns any more
+            co_await sched.sleep_until(std::min(next, g_countdowns.watch_end()));
+            continue;
+        }
+
+        g_countdown_reads.fetch_add(1, std::memory_order_relaxed);
+        if (co_await regs.read_input(COUNTDOWN_FIRST_REGISTER, COUNTDOWN_LAST_REGISTER) == -1)
+            co_await sched.sleep_for(std::chrono::seconds(5)); // next_sync() stays in the past
     }
 }
 
-void timer_thread(int ms)
+// Lateness histograms and missed deadlines of the periodic tasks
+void show_timing(void)
 {
-    while (true)
+    Report report;
+    for (const PeriodicStats *stats : {&g_monitor_timing, &g_snapshot_timing, &g_energy_timing, &g_alert_timing})
     {
-        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
-        if (g_monitor_enable)
+        uint64_t ticks = stats->ticks.load(std::memory_order_relaxed);
+        if (ticks == 0)
+            continue;
+
+        std::string key = stats->name;
+        report.heading(key + ":");
+        report.integer(key + "_period_ms", "Period", static_cast<long>(stats->period_ns / 1000000), "ms");
+        report.integer(key + "_ticks", "Wake-ups", static_cast<long>(ticks));
+        report.integer(key + "_missed", "Missed deadlines", static_cast<long>(stats->missed.load(std::memory_order_relaxed)));
+        report.number(key + "_late_max_ms", "Latest wake-up", stats->max_late_ns.load(std::memory_order_relaxed) / 1e6, 3, "ms");
+        for (size_t i = 0; i < JITTER_BUCKETS; i++)
         {
-            print_monitor();
+            uint64_t count = stats->buckets[i].load(std::memory_order_relaxed);
+            if (count == 0)
+                continue;
+            std::string bound = std::to_string(1u << (i + 4));
+            if (i == JITTER_BUCKETS - 1)
+                report.integer(key + "_late_over_" + std::to_string(1u << (i + 3)) + "us", "Late over " + std::to_string(1u << (i + 3)) + " us", static_cast<long>(count));
+            else
+                report.integer(key + "_late_under_" + bound + "us", "Late under " + bound + " us", static_cast<long>(count));
         }
     }
+
+    report.heading("countdowns:");
+    report.integer("countdown_reads", "Re-syncs", static_cast<long>(g_countdown_reads.load(std::memory_order_relaxed)));
+    report.integer("countdown_discontinuities", "Discontinuities", static_cast<long>(g_countdowns.discontinuities()));
+}
+
+// Ends `sched` when timer_stop is notified from the main thread
+Task<> stop_task(Scheduler &sched)
+{
+    co_await sched.readable(timer_stop.fd(), Scheduler::Clock::time_point::max());
+    sched.stop();
+}
+
+// Runs periodic events as coroutines on their own scheduler
+void timer_thread(int ms)
+{
+    Scheduler sched;
+    std::unique_ptr<AsyncRegisters> regs;
+    if (tcp_host)
+        regs = std::make_unique<AsyncRegisters>(sched, tcp_host, tcp_port, MODBUS_SLAVE_ID);
+    else
+        regs = std::make_unique<AsyncRegisters>(sched);
+
+    sched.spawn(monitor_task(sched, *regs, ms));
+    if (g_snapshot_polling)
+        sched.spawn(snapshot_task(sched, *regs));
+    if (g_energy_polling)
+        sched.spawn(energy_task(sched, *regs));
+    sched.spawn(alert_task(sched, *regs));
+    sched.spawn(countdown_task(sched, *regs));
+    sched.spawn(stop_task(sched));
+    sched.run();
+    regs->abandon();
 }
 
 void special_function(int key)
@@ -202,6 +541,7 @@ void special_function(int key)
     if (key == 3)
     {
         g_monitor_enable = !g_monitor_enable;
+        monitor_wakeup.notify();
         printf("Monitor is %s\n", g_monitor_enable ? "ENABLED" : "DISABLED");
     }
     else
@@ -235,45 +575,193 @@ void init_monitor(void)
 
 void monitor_clear()
 {
-    printf("Removing all %zu entries from monitored registers.\n", monitored.size());
+    std::unique_lock lk(monitor_mutex);
+    printf("Removing all %zu entries from monitored registers.\n", monitored.size() + monitored_expressions.size());
     monitored.clear();
+    monitored_expressions.clear();
+}
+
+// Parses the argument of a setter command in the register's engineering units
+// and writes it to `reg`, nothing is written on bad input
+void setHolding(uint16_t reg, const std::string &str)
+{
+    const auto &desc = holding_register(reg);
+    ArgSpec spec = desc.arg_spec();
+    if (g_clamp_writes)
+    {
+        // anything the register can hold, validate_holding_write() clamps it
+        spec.min = desc.is_signed ? INT16_MIN : 0;
+        spec.max = desc.is_signed ? INT16_MAX : UINT16_MAX;
+    }
+    int32_t value;
+    if (parse_args(str, std::span(&spec, 1), &value) == -1)
+        return;
+
+    uint16_t raw = static_cast<uint16_t>(value);
+    if (validate_holding_write(reg, &raw, 1) == -1)
+        return;
+    holdingRegisters[reg] = raw;
+    writeRegister(reg, raw);
+}
+
+// "<register> <raw value>", the register given by number or alias
+int parseRawWrite(const std::string &str, int32_t &reg, int32_t &value)
+{
+    static constexpr ArgSpec REGISTER_ARG{"register", Arg::Int, 0, e_holding_last_item - 1};
+    static constexpr ArgSpec VALUE_ARG{"value", Arg::Int, INT16_MIN, UINT16_MAX};
+
+    ArgTokens tokens(str);
+    if (tokens.size() != 2)
+    {
+        printf("Expected <register number or name> <value>\n");
+        return -1;
+    }
+
+    const char *error;
+    reg = find_holding_register(tokens[0]);
+    if (reg == -1 && parse_arg(tokens[0], REGISTER_ARG, reg, error) == -1)
+    {
+        printf("register \"%.*s\": %s\n", static_cast<int>(tokens[0].size()), tokens[0].data(), error);
+        return -1;
+    }
+    if (parse_arg(tokens[1], VALUE_ARG, value, error) == -1)
+    {
+        printf("value \"%.*s\": %s\n", static_cast<int>(tokens[1].size()), tokens[1].data(), error);
+        return -1;
+    }
+    return 0;
+}
+
+// Only the relay's own bit changes on the device, see maskWriteRegister()
+void setRelayPolarity(uint8_t relay_no, const std::string &str)
+{
+    uint16_t bit = 1 << relay_no;
+    if (str == "0" || str == "no")
+        maskWriteRegister(e_relay_polarity, ~bit, 0);
+    else if (str == "1" || str == "nc")
+        maskWriteRegister(e_relay_polarity, ~bit, bit);
+    else
+        printf("Incorrect arguments\n");
+}
+
+// Why the settings shown are not the device's, a banner in text mode and
+// "stale": "offline" | "cached" | "unread" in JSON
+void show_stale_banner(void)
+{
+    Report report;
+    bool json = g_output_mode == Output::Json;
+    if (g_holding_freshness == Freshness::Offline)
+    {
+        report.message("stale", json ? "offline" : "*** Offline, local settings (settings push to apply them) ***");
+    }
+    else if (g_holding_freshness == Freshness::Cached)
+    {
+        char when[32];
+        time_t stamp = g_warm_cache.stamp();
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M", localtime(&stamp));
+        if (json)
+        {
+            report.message("stale", "cached");
+            report.text("cached_at", "Cached at", when);
+        }
+        else
+        {
+            report.message("stale", std::string("*** Cached settings from ") + when + " (stale), refreshing in background ***");
+        }
+    }
+    else
+    {
+        report.message("stale", json ? "unread" : "*** Settings not read from the device yet, refreshing in background ***");
+    }
 }
 
 void new_terminal_init(void)
 {
     my_prompt.insertMenuItem(std::string("settings show"), [](std::string)
-                             {  updateHoldingRegister(0, e_holding_last_item);
-                                updateInputRegister(0,e_input_last_item);
+                             {  Report report; // the banner and the settings are one JSON object
+                                if (g_holding_freshness == Freshness::Live)
+                                {
+                                    updateRegistersForShow();
+                                }
+                                else
+                                {
+                                    show_stale_banner();
+                                    refreshInBackground();
+                                }
                                 show_settings(); });
     my_prompt.insertMenuItem("settings save", [](std::string)
                              { writeRegister(e_execute_command, Command::Save); });
     my_prompt.insertMenuItem("settings write_config", [](std::string x)
                              { 
-                                updateHoldingRegister(0, e_holding_last_item);
+                                updateHoldingRegister(0, e_holding_last_item - 1);
                                 write_settings_to_file(x); });
     my_prompt.insertMenuItem("settings read_config", [](std::string x)
-                             { read_registers_from_file(x);
-                                writeMultipleRegisters(holdingRegisters, 0, e_holding_last_item); });
+                             { if (read_registers_from_file(x) == 0)
+                                    writeMultipleRegisters(holdingRegisters, 0, e_holding_last_item); });
     my_prompt.insertMenuItem("settings restore_default", [](std::string)
                              { 
                                 writeRegister(e_execute_command, Command::DefaultSettings);
                                 writeMultipleRegisters(holdingRegisters, 0, e_holding_last_item); });
+    my_prompt.insertMenuItem("settings push", [](std::string x)
+                             {
+                                // Default target: the device of this session (or the one given with --offline)
+                                std::string target = x.empty() ? g_push_target : x;
+                                if (target.empty())
+                                {
+                                    printf("Expected host[:port] or a serial device\n");
+                                    return;
+                                }
+                                if (!g_offline && target == g_push_target)
+                                {
+                                    std::unique_lock lk(modbus_mutex);
+                                    push_settings(ctx, holdingRegisters);
+                                    return;
+                                }
+                                modbus_t *target_ctx = new_target_context(target, MODBUS_SLAVE_ID);
+                                if (target_ctx)
+                                {
+                                    push_settings(target_ctx, holdingRegisters);
+                                    modbus_free(target_ctx);
+                                } });
+    my_prompt.insertMenuItem("settings clamp", [](std::string x)
+                             {
+                                if (x == "on" || x == "1")
+                                    g_clamp_writes = true;
+                                else if (x == "off" || x == "0")
+                                    g_clamp_writes = false;
+                                else if (!x.empty())
+                                    printf("Expected on or off\n");
+                                printf("Out of range values are %s\n", g_clamp_writes ? "clamped to the limits" : "refused"); });
+    my_prompt.insertMenuItem("output json", [](std::string)
+                             { g_output_mode = Output::Json; });
+    my_prompt.insertMenuItem("output text", [](std::string)
+                             { g_output_mode = Output::Text; });
     my_prompt.insertMenuItem("system bootsel", [](std::string)
                              { writeRegister(e_execute_command, 3); });
     my_prompt.insertMenuItem("system reset", [](std::string)
                              { writeRegister(e_execute_command, 2); });
     my_prompt.insertMenuItem("system show info", [](std::string)
-                             { system_info(); });
+                             { std::unique_lock lk(modbus_mutex);
+                               system_info(); });
+    my_prompt.insertMenuItem("system show timing", [](std::string)
+                             { show_timing(); });
+    my_prompt.insertMenuItem("system probe", [](std::string)
+                             { if (probeCapabilities(true) == 0)
+                                   print_capabilities(g_caps);
+                               else
+                                   printf("Device did not answer, capabilities unchanged\n"); });
     // my_prompt.insertMenuItem("system faults show_all", [](std::string)
     //                            { print_fault_list(); });
     // my_prompt.insertMenuItem("system faults show_active", [](std::string)
     //                            { print_active_faults(true); });
 
     my_prompt.insertMenuItem("flow test", [](std::string x)
-                             { test_flow_value(static_cast<uint16_t>(std::stoul(x))); });
+                             { int32_t hz;
+                               if (parse_args(x, std::span(&ARG_UINT, 1), &hz) == 0)
+                                   test_flow_value(static_cast<int16_t>(hz)); });
 
     my_prompt.insertMenuItem("operation show", [](std::string)
-                             { printf("Set operation mode : %s\nActual operation mode: %s\n", operationToString(holdingRegisters[e_mode]), operationToString(inputRegisters[e_operation_mode_ro])); });
+                             { show_operation(); });
     my_prompt.insertMenuItem("operation set idle", [](std::string x)
                              { writeRegister(e_mode, Operation::Idle); holdingRegisters[e_mode] = Operation::Idle; });
     my_prompt.insertMenuItem("operation set cool_manual", [](std::string x)
@@ -292,21 +780,44 @@ void new_terminal_init(void)
                              { callback(1, x); });
     my_prompt.insertMenuItem("modbus holding_registers set", [](std::string x)
                              {
-
-                                   Tokens tokens = tokenize(x);
-
-                                   if (tokens.size() < 2)
-                                   {
-                                       printf("Too few parameters.\n");
+                                   int32_t reg, value;
+                                   if (parseRawWrite(x, reg, value) == -1)
                                        return;
-                                   }
-                                   else if (tokens.size() > 2)
-                                   {
-                                       printf("Too many parameters.\n");
+                                   uint16_t raw = static_cast<uint16_t>(value);
+                                   if (validate_holding_write(reg, &raw, 1) == -1)
                                        return;
-                                   }
-                                   writeRegister(std::stoi(tokens[0]),std::stoi(tokens[1]));
-                                   callback(2, x); });
+                                   writeRegister(reg, raw);
+                                   set_register(reg, raw); });
+    my_prompt.insertMenuItem("modbus stats", [](std::string)
+                             { printf("Input register reads issued           %" PRIu64 "\n", input_flights.issued());
+                               printf("Served by shared request              %" PRIu64 "\n", input_flights.shared()); });
+    my_prompt.insertMenuItem("modbus capture dump", [](std::string x)
+                             { ArgTokens file(x);
+                               if (file.size() != 1)
+                               {
+                                   printf("Usage: modbus capture dump <file.pcapng>\n");
+                                   return;
+                               }
+                               int frames = g_capture.dump(std::string(file[0]).c_str());
+                               if (frames != -1)
+                                   printf("%d frames written to %.*s\n", frames, static_cast<int>(file[0].size()), file[0].data()); });
+    my_prompt.insertMenuItem("alert add", [](std::string x)
+                             { if (g_alerts.add(x) == 0)
+                                   alerts_changed.notify(); });
+    my_prompt.insertMenuItem("alert remove", [](std::string x)
+                             { g_alerts.remove(x); });
+    my_prompt.insertMenuItem("alert show", [](std::string)
+                             { g_alerts.show(); });
+    my_prompt.insertMenuItem("energy show", [](std::string x)
+                             { static constexpr ArgSpec PERIOD_ARG{"period", Arg::Enum, 0, EnergyPeriod::Count - 1, 1, ENERGY_PERIODS};
+                               int32_t period = EnergyPeriod::Today;
+                               if (ArgTokens(x).empty() || parse_args(x, std::span(&PERIOD_ARG, 1), &period) == 0)
+                                   print_energy(period); });
+    my_prompt.insertMenuItem("modbus crc check", [](std::string)
+                             { if (crc16_self_check() == -1)
+                                   printf("RTU frame checks are not trustworthy on this machine\n"); });
+    my_prompt.insertMenuItem("modbus crc benchmark", [](std::string)
+                             { crc16_benchmark(); });
     // my_prompt.insertMenuItem("modbus show_info", [](std::string)
     //                            { printf("Serial settings: %u 8N1\nSlave_Id: %u\n", MODBUS_BAUD, MODBUS_SLAVE_ID); });
 
@@ -318,96 +829,96 @@ void new_terminal_init(void)
                              { writeRegister(e_control_mode,Control::RemoteTemperature); holdingRegisters[e_control_mode] = Control::RemoteTemperature; });
 
     my_prompt.insertMenuItem("level set", [](std::string x)
-                             { holdingRegisters[e_level] = static_cast<uint16_t>(std::stoul(x)); writeRegister(e_level, holdingRegisters[e_level]); });
+                             { setHolding(e_level, x); });
     my_prompt.insertMenuItem("level show", [](std::string x)
-                             { printf("Power level set: %u \nPower level actual: %u \n", holdingRegisters[e_level], inputRegisters[e_powerLevel_100]); });
+                             { show_level(); });
     my_prompt.insertMenuItem("level increment", [](std::string x)
-                             { holdingRegisters[e_increment] = static_cast<uint16_t>(std::stoul(x)); writeRegister(e_increment, holdingRegisters[e_increment]); });
+                             { setHolding(e_increment, x); });
     my_prompt.insertMenuItem("level decrement", [](std::string x)
-                             { holdingRegisters[e_decrement] = static_cast<uint16_t>(std::stoul(x)); writeRegister(e_decrement, holdingRegisters[e_decrement]); });
+                             { setHolding(e_decrement, x); });
 
     my_prompt.insertMenuItem("temperature target show", [](std::string)
-                             { printf("Temperature static setpoint: %2.1f'C\nTemperature actual setpoint: %2.1f'C\n", holdingRegisters[e_temp_setpoint] / 10.0, inputRegisters[e_temp_setpoint_ro] / 10.0); });
+                             { show_temperature_target(); });
     my_prompt.insertMenuItem("temperature set_mode static", [](std::string)
                              { holdingRegisters[e_curve_active] = 0; writeRegister(e_curve_active, holdingRegisters[e_curve_active]); });
     my_prompt.insertMenuItem("temperature set_mode dynamic", [](std::string)
                              { holdingRegisters[e_curve_active] = 1; writeRegister(e_curve_active, holdingRegisters[e_curve_active]); });
     my_prompt.insertMenuItem("temperature target set", [](std::string x)
-                             { holdingRegisters[e_temp_setpoint] = std::clamp(static_cast<int16_t>(10 * std::stof(x)), (int16_t)0, (int16_t)500); writeRegister(e_temp_setpoint, holdingRegisters[e_temp_setpoint]); });
+                             { setHolding(e_temp_setpoint, x); });
     my_prompt.insertMenuItem("temperature show", [](std::string)
-                             { updateHoldingRegister(0, e_holding_last_item); updateInputRegister(0,e_input_last_item); show_temperature(); });
+                             { updateRegistersForShow(); show_temperature(); });
     my_prompt.insertMenuItem("temperature delta_low", [](std::string x)
-                             { holdingRegisters[e_low_delta] = static_cast<uint16_t>(10 * std::stof(x)); writeRegister(e_low_delta, holdingRegisters[e_low_delta]); });
+                             { setHolding(e_low_delta, x); });
     my_prompt.insertMenuItem("temperature delta_high", [](std::string x)
-                             { holdingRegisters[e_high_delta] = static_cast<uint16_t>(10 * std::stof(x)); writeRegister(e_high_delta, holdingRegisters[e_high_delta]); });
+                             { setHolding(e_high_delta, x); });
     my_prompt.insertMenuItem("temperature idle_time", [](std::string x)
-                             { holdingRegisters[e_on_off_interval] = static_cast<uint16_t>(std::stoul(x)); writeRegister(e_on_off_interval, holdingRegisters[e_on_off_interval]); });
+                             { setHolding(e_on_off_interval, x); });
     my_prompt.insertMenuItem("temperature auto_off_delay", [](std::string x)
-                             { holdingRegisters[e_off_delay] = static_cast<uint16_t>(std::stoul(x)); writeRegister(e_off_delay, holdingRegisters[e_off_delay]); });
+                             { setHolding(e_off_delay, x); });
     my_prompt.insertMenuItem("temperature dynamic test", [](std::string x)
-                             { test_equithermal_curve(static_cast<int>(std::stoi(x))); });
+                             { int32_t ambient;
+                               if (parse_args(x, std::span(&ARG_INT, 1), &ambient) == 0)
+                                   test_equithermal_curve(static_cast<int16_t>(ambient)); });
     my_prompt.insertMenuItem("temperature dynamic gain", [](std::string x)
-                             { holdingRegisters[e_curve_gain] = static_cast<uint16_t>(100 * std::stof(x)); writeRegister(e_curve_gain, holdingRegisters[e_curve_gain]); });
+                             { setHolding(e_curve_gain, x); });
     my_prompt.insertMenuItem("temperature dynamic offset", [](std::string x)
-                             { holdingRegisters[e_curve_offset] = static_cast<uint16_t>(10 * std::stof(x)); writeRegister(e_curve_offset, holdingRegisters[e_curve_offset]); });
+                             { setHolding(e_curve_offset, x); });
     my_prompt.insertMenuItem("temperature dynamic calculate_AB", [](std::string x)
                              { calculate_curve(x); });
     my_prompt.insertMenuItem("temperature dynamic ambient_average_scope", [](std::string x)
-                             { holdingRegisters[e_ambient_temp_scope] = static_cast<uint16_t>(std::stoul(x)); writeRegister(e_ambient_temp_scope, holdingRegisters[e_ambient_temp_scope]); });;
+                             { setHolding(e_ambient_temp_scope, x); });;
 
     my_prompt.insertMenuItem("temperature pid k_p", [](std::string x)
-                             { holdingRegisters[e_Kp_factor] = static_cast<uint16_t>(10 * std::stof(x)); writeRegister(e_Kp_factor, holdingRegisters[e_Kp_factor]); });
+                             { setHolding(e_Kp_factor, x); });
     my_prompt.insertMenuItem("temperature pid k_i", [](std::string x)
-                             { holdingRegisters[e_Ki_factor] = static_cast<uint16_t>(100 * std::stof(x)); writeRegister(e_Ki_factor, holdingRegisters[e_Ki_factor]); });
+                             { setHolding(e_Ki_factor, x); });
     my_prompt.insertMenuItem("temperature pid k_d", [](std::string x)
-                             { holdingRegisters[e_Kd_factor] = static_cast<uint16_t>(10 * std::stof(x)); writeRegister(e_Kd_factor, holdingRegisters[e_Kd_factor]); });
+                             { setHolding(e_Kd_factor, x); });
     my_prompt.insertMenuItem("temperature pid sampling_time", [](std::string x)
-                             { holdingRegisters[e_pid_sampling_time] = static_cast<uint16_t>(std::stoul(x)); writeRegister(e_pid_sampling_time, holdingRegisters[e_pid_sampling_time]); });
+                             { setHolding(e_pid_sampling_time, x); });
     my_prompt.insertMenuItem("temperature pid hysteresis", [](std::string x)
-                             { holdingRegisters[e_pid_hysteresis] = static_cast<uint16_t>(10 * std::stof(x)); writeRegister(e_pid_hysteresis, holdingRegisters[e_pid_hysteresis]); });
+                             { setHolding(e_pid_hysteresis, x); });
     my_prompt.insertMenuItem("temperature pid show", [](std::string x)
                              { show_pid(); });
 
     my_prompt.insertMenuItem("softstart preheat", [](std::string x)
-                             { holdingRegisters[e_preheat_temp] = static_cast<uint16_t>(10 * std::stof(x)); writeRegister(e_preheat_temp, holdingRegisters[e_preheat_temp]); });
+                             { setHolding(e_preheat_temp, x); });
     my_prompt.insertMenuItem("softstart precool", [](std::string x)
-                             { holdingRegisters[e_precool_temp] = static_cast<uint16_t>(10 * std::stof(x)); writeRegister(e_precool_temp, holdingRegisters[e_precool_temp]); });
+                             { setHolding(e_precool_temp, x); });
     my_prompt.insertMenuItem("softstart hysteresis", [](std::string x)
-                             { holdingRegisters[e_pre_hysteresis] = static_cast<uint16_t>(10 * std::stof(x)); writeRegister(e_pre_hysteresis, holdingRegisters[e_pre_hysteresis]); });
+                             { setHolding(e_pre_hysteresis, x); });
     my_prompt.insertMenuItem("softstart show", [](std::string x)
                              { show_softstart(); });
 
     my_prompt.insertMenuItem("oil low_freq set", [](std::string x)
-                             { holdingRegisters[e_oil_recovery_low_freq] = static_cast<uint16_t>(std::stoul(x)); writeRegister(e_oil_recovery_low_freq, holdingRegisters[e_oil_recovery_low_freq]); });
+                             { setHolding(e_oil_recovery_low_freq, x); });
     my_prompt.insertMenuItem("oil interval set", [](std::string x)
-                             { holdingRegisters[e_oil_recovery_low_time] = static_cast<uint16_t>(std::stoul(x)); writeRegister(e_oil_recovery_low_time, holdingRegisters[e_oil_recovery_low_time]); });
+                             { setHolding(e_oil_recovery_low_time, x); });
     my_prompt.insertMenuItem("oil target_frequency set", [](std::string x)
-                             { holdingRegisters[e_oil_recovery_restore_freq] = static_cast<uint16_t>(std::stoul(x)); writeRegister(e_oil_recovery_restore_freq, holdingRegisters[e_oil_recovery_restore_freq]); });
+                             { setHolding(e_oil_recovery_restore_freq, x); });
     my_prompt.insertMenuItem("oil show", [](std::string x)
                              { show_oil(); });
 
     my_prompt.insertMenuItem("misc relay alarm function", [](std::string x)
-                             { holdingRegisters[e_alarm_relay_function] = static_cast<uint16_t>(std::stoul(x)); writeRegister(e_alarm_relay_function, holdingRegisters[e_alarm_relay_function]); });
+                             { setHolding(e_alarm_relay_function, x); });
     my_prompt.insertMenuItem("misc relay alarm polarity", [](std::string x)
-                             { updateHoldingRegister(0, e_holding_last_item);
-                                set_relay_polarity(0, x);
-                                writeRegister(e_relay_polarity, holdingRegisters[e_relay_polarity]); });
+                             { setRelayPolarity(0, x); });
     my_prompt.insertMenuItem("misc relay defrost function", [](std::string x)
-                             { holdingRegisters[e_defrost_relay_function] = static_cast<uint16_t>(std::stoul(x)); writeRegister(e_defrost_relay_function, holdingRegisters[e_defrost_relay_function]); });
+                             { setHolding(e_defrost_relay_function, x); });
     my_prompt.insertMenuItem("misc relay defrost polarity", [](std::string x)
-                             { updateHoldingRegister(0, e_holding_last_item);
-                                set_relay_polarity(1, x);
-                                writeRegister(e_relay_polarity, holdingRegisters[e_relay_polarity]); });
+                             { setRelayPolarity(1, x); });
     my_prompt.insertMenuItem("misc relay show", [](std::string x)
                              { show_relay_functions(); });
     my_prompt.insertMenuItem("misc input_function heat", [](std::string x)
-                             { holdingRegisters[e_heat_input_function] = static_cast<uint16_t>(std::stoul(x)); writeRegister(e_heat_input_function, holdingRegisters[e_heat_input_function]); });
+                             { setHolding(e_heat_input_function, x); });
     my_prompt.insertMenuItem("misc input_function cool", [](std::string x)
-                             { holdingRegisters[e_cool_input_function] = static_cast<uint16_t>(std::stoul(x)); writeRegister(e_cool_input_function, holdingRegisters[e_cool_input_function]); });
+                             { setHolding(e_cool_input_function, x); });
     my_prompt.insertMenuItem("misc input_function show", [](std::string x)
                              { show_input_functions(); });
     my_prompt.insertMenuItem("misc monitor add", [](std::string x)
                              { monitor_add(x); });
+    my_prompt.insertMenuItem("misc monitor expr", [](std::string x)
+                             { monitor_expr(x); });
     my_prompt.insertMenuItem("misc monitor remove", [](std::string x)
                              { monitor_remove(x); });
     my_prompt.insertMenuItem("misc monitor clear", [](std::string x)
@@ -416,11 +927,17 @@ void new_terminal_init(void)
                              { monitor_show(); });
     my_prompt.insertMenuItem("misc monitor default", [](std::string x)
                              { init_monitor(); });
+    my_prompt.insertMenuItem("misc monitor deadband", [](std::string x)
+                             { monitor_deadband(x); });
+    my_prompt.insertMenuItem("misc monitor silence", [](std::string x)
+                             { monitor_silence(x); });
+    my_prompt.insertMenuItem("misc monitor poll", [](std::string x)
+                             { monitor_poll(x); });
 
     my_prompt.insertMenuItem("misc protections t2_low", [](std::string x)
-                             { holdingRegisters[e_t2_low_alarm_value] = static_cast<int16_t>(10 * std::stof(x)); writeRegister(e_t2_low_alarm_value, holdingRegisters[e_t2_low_alarm_value]); });
+                             { setHolding(e_t2_low_alarm_value, x); });
     my_prompt.insertMenuItem("misc protections flow_low", [](std::string x)
-                             { holdingRegisters[e_minimal_flow] = static_cast<uint16_t>(std::stoul(x)); writeRegister(e_minimal_flow, holdingRegisters[e_minimal_flow]); });
+                             { setHolding(e_minimal_flow, x); });
 
     my_prompt.insertMenuItem("defrost start", [](std::string x)
                              { holdingRegisters[e_execute_command] = Command::StartDefrost; writeRegister(e_execute_command, holdingRegisters[e_execute_command]); });
@@ -429,24 +946,24 @@ void new_terminal_init(void)
     my_prompt.insertMenuItem("defrost show", [](std::string x)
                              { show_defrost(); });
     my_prompt.insertMenuItem("defrost temperature_target", [](std::string x)
-                             { holdingRegisters[e_defrost_end_t3_target] = static_cast<uint16_t>(10 * std::stof(x)); writeRegister(e_defrost_end_t3_target, holdingRegisters[e_defrost_end_t3_target]); });
+                             { setHolding(e_defrost_end_t3_target, x); });
     my_prompt.insertMenuItem("defrost compressor_max_speed", [](std::string x)
-                             { holdingRegisters[e_defrost_max_frequency] = static_cast<uint16_t>(std::stoul(x)); writeRegister(e_defrost_max_frequency, holdingRegisters[e_defrost_max_frequency]); });
+                             { setHolding(e_defrost_max_frequency, x); });
     my_prompt.insertMenuItem("defrost duration_max", [](std::string x)
-                             { holdingRegisters[e_defrost_max_duration] = static_cast<uint16_t>(std::stoul(x)); writeRegister(e_defrost_max_duration, holdingRegisters[e_defrost_max_duration]); });
+                             { setHolding(e_defrost_max_duration, x); });
     my_prompt.insertMenuItem("defrost max_odu_delta", [](std::string x)
-                             { holdingRegisters[e_defrost_max_odu_delta] = static_cast<uint16_t>(10 * std::stoul(x)); writeRegister(e_defrost_max_odu_delta, holdingRegisters[e_defrost_max_odu_delta]); });
+                             { setHolding(e_defrost_max_odu_delta, x); });
     my_prompt.insertMenuItem("defrost interval_min", [](std::string x)
-                             { holdingRegisters[e_defrost_min_interval] = static_cast<uint16_t>(std::stoul(x)); writeRegister(e_defrost_min_interval, holdingRegisters[e_defrost_min_interval]); });
+                             { setHolding(e_defrost_min_interval, x); });
     my_prompt.insertMenuItem("defrost drop_max_t3", [](std::string x)
-                             { holdingRegisters[e_defrost_max_t3_drop] = static_cast<uint16_t>(10 * std::stoul(x)); writeRegister(e_defrost_max_t3_drop, holdingRegisters[e_defrost_max_t3_drop]); });
+                             { setHolding(e_defrost_max_t3_drop, x); });
 
     my_prompt.insertMenuItem("dhw show", [](std::string x)
-                             { holdingRegisters[e_dhw_level] = static_cast<uint16_t>(std::stoul(x)); writeRegister(e_dhw_level, holdingRegisters[e_dhw_level]); });
+                             { show_dhw(); });
     my_prompt.insertMenuItem("dhw level", [](std::string x)
-                             { holdingRegisters[e_dhw_level] = static_cast<uint16_t>(std::stoul(x)); writeRegister(e_dhw_level, holdingRegisters[e_dhw_level]); });
+                             { setHolding(e_dhw_level, x); });
     my_prompt.insertMenuItem("dhw temperature", [](std::string x)
-                             { holdingRegisters[e_dhw_target_temperature] = static_cast<uint16_t>(std::stoul(x)); writeRegister(e_dhw_target_temperature, holdingRegisters[e_dhw_target_temperature]); });
+                             { setHolding(e_dhw_target_temperature, x); });
     my_prompt.insertMenuItem("dhw mode legacy", [](std::string x)
                              { holdingRegisters[e_dhw_mode] = DHW::Legacy; writeRegister(e_dhw_mode, holdingRegisters[e_dhw_mode]); });
     my_prompt.insertMenuItem("dhw mode const_level", [](std::string x)
@@ -455,77 +972,287 @@ void new_terminal_init(void)
                              { holdingRegisters[e_dhw_mode] = DHW::FixedTemp; writeRegister(e_dhw_mode, holdingRegisters[e_dhw_mode]); });
 
     my_prompt.insertMenuItem("bivalent temperature_0", [](std::string x)
-                             { holdingRegisters[e_bivalent0_temp] = static_cast<uint16_t>(10 * std::stof(x)); writeRegister(e_bivalent0_temp, holdingRegisters[e_bivalent0_temp]); });
+                             { setHolding(e_bivalent0_temp, x); });
     my_prompt.insertMenuItem("bivalent hystesis_0", [](std::string x)
-                             { holdingRegisters[e_bivalent0_hysteresis] = static_cast<uint16_t>(10 * std::stof(x)); writeRegister(e_bivalent0_hysteresis, holdingRegisters[e_bivalent0_hysteresis]); });
+                             { setHolding(e_bivalent0_hysteresis, x); });
     my_prompt.insertMenuItem("bivalent temperature_1", [](std::string x)
-                             { holdingRegisters[e_bivalent1_temp] = static_cast<uint16_t>(10 * std::stof(x)); writeRegister(e_bivalent1_temp, holdingRegisters[e_bivalent1_temp]); });
+                             { setHolding(e_bivalent1_temp, x); });
     my_prompt.insertMenuItem("bivalent hystesis_1", [](std::string x)
-                             { holdingRegisters[e_bivalent1_hysteresis] = static_cast<uint16_t>(10 * std::stof(x)); writeRegister(e_bivalent1_hysteresis, holdingRegisters[e_bivalent1_hysteresis]); });
+                             { setHolding(e_bivalent1_hysteresis, x); });
     my_prompt.insertMenuItem("bivalent show", [](std::string x)
                              { show_bivalent(); });
 
 #if defined(midea) || defined(gree) || defined(generic)
     my_prompt.insertMenuItem("developer odu compressor", [](std::string x)
-                             { holdingRegisters[e_override_compressor] = static_cast<uint16_t>(std::stoul(x)); });
+                             { int32_t value;
+                               if (parse_args(x, std::span(&ARG_UINT, 1), &value) == 0)
+                                   holdingRegisters[e_override_compressor] = static_cast<uint16_t>(value); });
 #endif
 #if defined(midea)
     my_prompt.insertMenuItem("developer odu fan", [](std::string x)
-                             { holdingRegisters[e_odu_fan_override] = static_cast<uint16_t>(std::stoul(x)); });
+                             { int32_t value;
+                               if (parse_args(x, std::span(&ARG_UINT, 1), &value) == 0)
+                                   holdingRegisters[e_odu_fan_override] = static_cast<uint16_t>(value); });
 #endif
 }
 
-int updateInputRegister(uint16_t reg)
+// errno-style code of a failed pipelined request, usable with modbus_strerror()
+int requestErrno(const ModbusRequest &request)
 {
-    std::unique_lock lk(modbus_mutex);
-    // Connect to the Modbus server
-    if (modbus_connect(ctx) == -1)
+    return request.rc > 0 ? MODBUS_ENOBASE + request.rc : errno;
+}
+
+int pipelineTransact(uint8_t function, uint16_t addr, uint16_t count, uint16_t *registers)
+{
+    ModbusRequest request{MODBUS_SLAVE_ID, function, addr, count, registers, 0};
+    g_transport_stats.transactions++;
+    if (pipeline->execute(&request, 1) == -1)
     {
-        fprintf(stderr, "Connection failed: %s\n", modbus_strerror(errno));
+        g_transport_stats.errors++;
+        fprintf(stderr, "Request failed: %s\n", modbus_strerror(requestErrno(request)));
         return -1;
     }
 
-    int rc = modbus_read_input_registers(ctx, reg, 1, &inputRegisters[reg]);
-    if (rc == -1)
+    return 0;
+}
+
+// Blocking transaction through libmodbus, the caller is connected and holds modbus_mutex
+int libmodbusTransact(ModbusRequest &request)
+{
+    return captured_transact(ctx, request);
+}
+
+// Called after the whole holding block was read from the device
+void holdingBlockLoaded(void)
+{
+    g_snapshot.publish_holding(holdingRegisters);
+    g_warm_cache.store(holdingRegisters, e_holding_last_item);
+    g_holding_freshness = Freshness::Live;
+    g_holding_loaded = std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+// Called after input registers [from, to] were read from the device
+void inputRegistersLoaded(uint16_t from, uint16_t to)
+{
+    if (from <= ENERGY_FIRST_REGISTER && to >= ENERGY_LAST_REGISTER)
+        g_energy.sample(inputRegisters, realtime_ns());
+    g_alerts.evaluate(inputRegisters, holdingRegisters, from, to);
+    g_countdowns.sampled(inputRegisters, from, to);
+}
+
+// Refreshes both register blocks without blocking the prompt, at most one refresh at a time
+void refreshInBackground(void)
+{
+    static std::atomic<bool> running{false};
+    if (g_offline || running.exchange(true))
+        return;
+
+    if (g_refresh_thread.joinable())
+        g_refresh_thread.join(); // the previous one is done, `running` was false
+    g_refresh_thread = std::thread([]
+                                   {
+                                       static bool identity_checked{false}; // one refresh thread at a time
+                                       if (!identity_checked)
+                                           identity_checked = checkIdentity() == 0;
+                                       // registers first, the probe may hold the bus for several timeouts
+                                       if (updateAllRegisters() == -1)
+                                           fprintf(stderr, "\rUnable to read registers, is the device online?\n");
+                                       else
+                                           probeCapabilities(false);
+                                       running = false; });
+}
+
+// Whether the unit answering is the one the cached settings and capabilities
+// belong to (FC43 identity), both are dropped when another unit answers.
+// -1 when the device did not answer.
+int checkIdentity(void)
+{
+    std::string expected = device_identity(g_caps);
+    if (expected.empty())
+        return 0; // never identified, nothing to compare with
+
+    DeviceCapabilities answering;
     {
-        fprintf(stderr, "Read failed: %s\n", modbus_strerror(errno));
-        modbus_close(ctx);
+        std::unique_lock lk(modbus_mutex);
+        if (read_identity(ctx, MODBUS_SLAVE_ID, answering) == -1)
+            return -1;
+    }
+    std::string identity = device_identity(answering);
+    if (identity == expected)
+        return 0;
+
+    printf("\rAnother device answers (%s, expected %s), dropping its cached settings and capabilities\n",
+           identity.empty() ? "unidentified" : identity.c_str(), expected.c_str());
+    g_warm_cache.set_identity(identity);
+    {
+        std::unique_lock lk(modbus_mutex);
+        // nothing of the other unit may be shown as this one's, even if the next read fails
+        memset(holdingRegisters, 0, sizeof(uint16_t) * e_holding_last_item);
+        g_holding_freshness = Freshness::Empty;
+        g_caps = DeviceCapabilities{}; // probed again after the next read
+    }
+    return 0;
+}
+
+// Probes the device unless its capabilities are known (or `force`), a result without timeouts is kept for later sessions
+int probeCapabilities(bool force)
+{
+    if (g_offline)
+    {
+        printf("Offline, there is no device to probe\n");
         return -1;
     }
 
-    // Close the connection
-    modbus_close(ctx);
+    DeviceCapabilities caps;
+    {
+        std::unique_lock lk(modbus_mutex);
+        if (g_caps.probed != 0 && g_caps.settled && !force)
+            return 0;
+        if (probe_capabilities(ctx, MODBUS_SLAVE_ID, e_input_last_item, e_holding_last_item, caps) == -1)
+            return -1;
+        g_caps = caps;
+    }
 
+    if (caps.settled)
+    {
+        g_warm_cache.set_identity(device_identity(caps));
+        if (!capabilities_file.empty())
+            store_capabilities(capabilities_file, caps);
+    }
     return 0;
 }
 
-int updateInputRegister(uint16_t from, uint16_t to)
+// Holding registers the unit changes by itself (RegFlag::Volatile), first and last
+constexpr auto VOLATILE_HOLDING = []
 {
-    std::unique_lock lk(modbus_mutex);
-    // Connect to the Modbus server
-    if (modbus_connect(ctx) == -1)
+    std::pair<uint16_t, uint16_t> span{UINT16_MAX, 0};
+    for (const auto &desc : HOLDING_REGISTERS)
     {
-        fprintf(stderr, "Connection failed: %s\n", modbus_strerror(errno));
-        return -1;
+        if (desc.flags & RegFlag::Volatile)
+            span = {std::min(span.first, desc.reg), std::max(span.second, desc.reg)};
     }
+    return span;
+}();
 
-    int rc = modbus_read_input_registers(ctx, from, to - from + 1, &inputRegisters[from]);
-    if (rc == -1)
+// After a command the unit may change any setting, the next show reads them all
+void dropHoldingAge(uint16_t addr, uint16_t count)
+{
+    for (uint16_t reg = addr; reg < addr + count; reg++)
     {
-        fprintf(stderr, "Read failed: %s\n", modbus_strerror(errno));
-        modbus_close(ctx);
+        if (holding_register(reg).flags & RegFlag::Command)
+            g_holding_loaded = 0;
+    }
+}
+
+// Input block on every call, the holding block only when it is older than
+// HOLDING_MAX_AGE: settings change when written, and writes from here update the
+// model. The registers the unit changes itself are read every time.
+int updateRegistersForShow(void)
+{
+    auto loaded = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(g_holding_loaded.load()));
+    if (g_offline || g_holding_loaded == 0 || std::chrono::steady_clock::now() - loaded >= HOLDING_MAX_AGE)
+        return updateAllRegisters();
+
+    if (updateHoldingRegister(VOLATILE_HOLDING.first, VOLATILE_HOLDING.second) == -1 || updateInputRegister(0, e_input_last_item - 1) == -1)
         return -1;
+    g_snapshot.publish_input(inputRegisters);
+    return 0;
+}
+
+// Reads both register blocks. With pipelining enabled both requests are in flight at once.
+int updateAllRegisters(void)
+{
+    if (g_offline)
+        return 0;
+
+    {
+        std::unique_lock lk(modbus_mutex);
+        if (pipeline && e_holding_last_item <= g_caps.max_read_registers && e_input_last_item <= g_caps.max_read_registers)
+        {
+            ModbusRequest requests[] = {
+                {MODBUS_SLAVE_ID, Function_code::ReadHolding, 0, e_holding_last_item, holdingRegisters, 0},
+                {MODBUS_SLAVE_ID, Function_code::ReadInput, 0, e_input_last_item, inputRegisters, 0},
+            };
+            // input reads of others share this one meanwhile
+            auto flight = input_flights.lead(0, e_input_last_item - 1);
+            g_transport_stats.transactions += std::size(requests);
+            if (pipeline->execute(requests, std::size(requests)) == -1)
+            {
+                for (const auto &request : requests)
+                {
+                    if (request.rc != 0)
+                    {
+                        g_transport_stats.errors++;
+                        fprintf(stderr, "Read failed: %s\n", modbus_strerror(requestErrno(request)));
+                    }
+                }
+                if (requests[1].rc == 0)
+                    inputRegistersLoaded(0, e_input_last_item - 1);
+                input_flights.finish(flight, requests[1].rc == 0 ? 0 : -1);
+                return -1;
+            }
+            holdingBlockLoaded();
+            inputRegistersLoaded(0, e_input_last_item - 1);
+            input_flights.finish(flight, 0);
+            g_snapshot.publish_input(inputRegisters);
+            return 0;
+        }
     }
 
-    // Close the connection
-    modbus_close(ctx);
+    if (updateHoldingRegister(0, e_holding_last_item - 1) == -1 || updateInputRegister(0, e_input_last_item - 1) == -1)
+        return -1;
 
+    holdingBlockLoaded();
+    g_snapshot.publish_input(inputRegisters);
     return 0;
 }
 
-int updateHoldingRegister(uint16_t reg)
+int updateInputRegister(uint16_t reg)
 {
-    std::unique_lock lk(modbus_mutex);
+    return updateInputRegister(reg, reg);
+}
+
+// Monitor, prompt and exporters often ask for overlapping ranges at the same time,
+// share one FC04 between them.
+int updateInputRegister(uint16_t from, uint16_t to)
+{
+    return input_flights.run(from, to, [from, to]
+                             { return readInputRegisters(from, to); });
+}
+
+// Reads registers [from, to] into `dest`, split into blocks the device accepts.
+// The caller holds modbus_mutex.
+int readBlock(uint8_t function, uint16_t from, uint16_t to, uint16_t *dest)
+{
+    if (g_offline)
+        return 0; // the model already holds everything there is to read
+
+    const uint32_t max = g_caps.max_read_registers;
+    if (pipeline)
+    {
+        std::vector<ModbusRequest> requests;
+        for (uint32_t addr = from; addr <= to; addr += max)
+        {
+            uint16_t count = static_cast<uint16_t>(std::min(max, to - addr + 1));
+            requests.push_back({MODBUS_SLAVE_ID, function, static_cast<uint16_t>(addr), count, &dest[addr - from], 0});
+        }
+
+        g_transport_stats.transactions += requests.size();
+        if (pipeline->execute(requests.data(), requests.size()) == -1)
+        {
+            for (const auto &request : requests)
+            {
+                if (request.rc != 0)
+                {
+                    g_transport_stats.errors++;
+                    fprintf(stderr, "Read failed: %s\n", modbus_strerror(requestErrno(request)));
+                }
+            }
+            return -1;
+        }
+        return 0;
+    }
+
     // Connect to the Modbus server
     if (modbus_connect(ctx) == -1)
     {
@@ -533,12 +1260,18 @@ int updateHoldingRegister(uint16_t reg)
         return -1;
     }
 
-    int rc = modbus_read_registers(ctx, reg, 1, &holdingRegisters[reg]);
-    if (rc == -1)
+    for (uint32_t addr = from; addr <= to; addr += max)
     {
-        fprintf(stderr, "Read failed: %s\n", modbus_strerror(errno));
-        modbus_close(ctx);
-        return -1;
+        uint16_t count = static_cast<uint16_t>(std::min(max, to - addr + 1));
+        ModbusRequest request{MODBUS_SLAVE_ID, function, static_cast<uint16_t>(addr), count, &dest[addr - from], 0};
+        g_transport_stats.transactions++;
+        if (libmodbusTransact(request) == -1)
+        {
+            g_transport_stats.errors++;
+            fprintf(stderr, "Read failed: %s\n", modbus_strerror(errno));
+            modbus_close(ctx);
+            return -1;
+        }
     }
 
     // Close the connection
@@ -547,33 +1280,69 @@ int updateHoldingRegister(uint16_t reg)
     return 0;
 }
 
-int updateHoldingRegister(uint16_t from, uint16_t to)
+int readInputRegisters(uint16_t from, uint16_t to)
 {
     std::unique_lock lk(modbus_mutex);
-    // Connect to the Modbus server
-    if (modbus_connect(ctx) == -1)
-    {
-        fprintf(stderr, "Connection failed: %s\n", modbus_strerror(errno));
+    if (readBlock(Function_code::ReadInput, from, to, &inputRegisters[from]) == -1)
         return -1;
-    }
+    if (!g_offline)
+        inputRegistersLoaded(from, to);
+    return 0;
+}
 
-    int rc = modbus_read_registers(ctx, from, to - from + 1, &holdingRegisters[from]);
-    if (rc == -1)
+int updateHoldingRegister(uint16_t reg)
+{
+    return updateHoldingRegister(reg, reg);
+}
+
+int updateHoldingRegister(uint16_t from, uint16_t to)
+{
+    std::unique_lock lk(modbus_mutex);
+    return readBlock(Function_code::ReadHolding, from, to, &holdingRegisters[from]);
+}
+
+// Offline writes only change the model, commands have nothing to act on
+int storeOffline(uint16_t addr, const uint16_t *values, uint16_t count)
+{
+    for (uint16_t i = 0; i < count; i++)
     {
-        fprintf(stderr, "Read failed: %s\n", modbus_strerror(errno));
-        modbus_close(ctx);
-        return -1;
+        const auto &desc = holding_register(addr + i);
+        if (desc.flags & RegFlag::Command)
+        {
+            if (count == 1)
+            {
+                printf("Offline, %s is not sent anywhere\n", desc.alias);
+                return -1;
+            }
+            continue;
+        }
+        holdingRegisters[addr + i] = values[i];
     }
+    return 0;
+}
 
-    // Close the connection
-    modbus_close(ctx);
-
+// What every holding register write goes through before the bus: the register
+// limits (clamping `values` with --clamp) and the offline model.
+// -1 refused, 1 handled without the device, 0 to be sent.
+int admitHoldingWrite(uint16_t addr, uint16_t *values, uint16_t count)
+{
+    if (validate_holding_write(addr, values, count) == -1)
+        return -1;
+    if (g_offline)
+        return storeOffline(addr, values, count) == -1 ? -1 : 1;
+    dropHoldingAge(addr, count);
     return 0;
 }
 
 int writeRegister(uint16_t reg, uint16_t value)
 {
+    if (int admitted = admitHoldingWrite(reg, &value, 1); admitted != 0)
+        return admitted == -1 ? -1 : 0;
+
     std::unique_lock lk(modbus_mutex);
+    if (pipeline)
+        return pipelineTransact(Function_code::WriteSingle, reg, 1, &value);
+
     // Connect to the Modbus server
     if (modbus_connect(ctx) == -1)
     {
@@ -581,9 +1350,11 @@ int writeRegister(uint16_t reg, uint16_t value)
         return -1;
     }
 
-    int rc = modbus_write_register(ctx, reg, value);
-    if (rc == -1)
+    ModbusRequest request{MODBUS_SLAVE_ID, Function_code::WriteSingle, reg, 1, &value, 0};
+    g_transport_stats.transactions++;
+    if (libmodbusTransact(request) == -1)
     {
+        g_transport_stats.errors++;
         fprintf(stderr, "Write failed: %s\n", modbus_strerror(errno));
         modbus_close(ctx);
         return -1;
@@ -593,9 +1364,38 @@ int writeRegister(uint16_t reg, uint16_t value)
     return 0;
 }
 
+// Falls back to one FC06 per register on devices without FC16
 int writeMultipleRegisters(uint16_t *registers, uint16_t addr, uint16_t count)
 {
+    if (int admitted = admitHoldingWrite(addr, registers, count); admitted != 0)
+        return admitted == -1 ? -1 : 0;
+
     std::unique_lock lk(modbus_mutex);
+    if (pipeline)
+    {
+        if (g_caps.write_multiple)
+            return pipelineTransact(Function_code::WriteMultiple, addr, count, registers);
+
+        std::vector<ModbusRequest> requests;
+        for (uint16_t i = 0; i < count; i++)
+            requests.push_back({MODBUS_SLAVE_ID, Function_code::WriteSingle, static_cast<uint16_t>(addr + i), 1, &registers[i], 0});
+
+        g_transport_stats.transactions += requests.size();
+        if (pipeline->execute(requests.data(), requests.size()) == -1)
+        {
+            for (const auto &request : requests)
+            {
+                if (request.rc != 0)
+                {
+                    g_transport_stats.errors++;
+                    fprintf(stderr, "Write failed: %s\n", modbus_strerror(requestErrno(request)));
+                }
+            }
+            return -1;
+        }
+        return 0;
+    }
+
     // Connect to the Modbus server
     if (modbus_connect(ctx) == -1)
     {
@@ -603,9 +1403,22 @@ int writeMultipleRegisters(uint16_t *registers, uint16_t addr, uint16_t count)
         return -1;
     }
 
-    int rc = modbus_write_registers(ctx, addr, count, registers);
+    int rc{0};
+    g_transport_stats.transactions++;
+    if (g_caps.write_multiple)
+    {
+        ModbusRequest request{MODBUS_SLAVE_ID, Function_code::WriteMultiple, addr, count, registers, 0};
+        rc = libmodbusTransact(request);
+    }
+    for (uint16_t i = 0; i < count && !g_caps.write_multiple && rc != -1; i++)
+    {
+        ModbusRequest request{MODBUS_SLAVE_ID, Function_code::WriteSingle, static_cast<uint16_t>(addr + i), 1, &registers[i], 0};
+        rc = libmodbusTransact(request);
+    }
+
     if (rc == -1)
     {
+        g_transport_stats.errors++;
         fprintf(stderr, "Write failed: %s\n", modbus_strerror(errno));
         modbus_close(ctx);
         return -1;
@@ -615,6 +1428,62 @@ int writeMultipleRegisters(uint16_t *registers, uint16_t addr, uint16_t count)
     return 0;
 }
 
+// FC22 when the device implements it, otherwise a read-modify-write of the single register.
+// With FC22 bits outside ~and_mask keep the device's value even when our copy is stale.
+int maskWriteRegister(uint16_t reg, uint16_t and_mask, uint16_t or_mask)
+{
+    if (reg >= e_holding_last_item)
+    {
+        printf("Register %u is beyond the last one (%u)\n", reg, e_holding_last_item - 1);
+        return -1;
+    }
+
+    {
+        std::unique_lock lk(modbus_mutex);
+        uint16_t merged = (holdingRegisters[reg] & and_mask) | (or_mask & ~and_mask);
+        uint16_t expected = merged;
+        if (validate_holding_write(reg, &expected, 1) == -1)
+            return -1;
+        if (g_offline)
+            return storeOffline(reg, &expected, 1);
+
+        // FC22 merges the masks on the device, a clamped value goes out with FC06 below
+        if (g_caps.mask_write && expected == merged)
+        {
+            // Connect to the Modbus server
+            if (modbus_connect(ctx) == -1)
+            {
+                fprintf(stderr, "Connection failed: %s\n", modbus_strerror(errno));
+                return -1;
+            }
+
+            uint16_t masks[] = {and_mask, or_mask};
+            ModbusRequest request{MODBUS_SLAVE_ID, Function_code::MaskWrite, reg, 1, masks, 0};
+            g_transport_stats.transactions++;
+            if (libmodbusTransact(request) == -1)
+            {
+                g_transport_stats.errors++;
+                fprintf(stderr, "Write failed: %s\n", modbus_strerror(errno));
+                modbus_close(ctx);
+                return -1;
+            }
+            modbus_close(ctx);
+
+            holdingRegisters[reg] = expected;
+            return 0;
+        }
+    }
+
+    if (updateHoldingRegister(reg) == -1)
+        return -1;
+
+    uint16_t value = (holdingRegisters[reg] & and_mask) | (or_mask & ~and_mask);
+    if (validate_holding_write(reg, &value, 1) == -1 || writeRegister(reg, value) == -1)
+        return -1;
+    holdingRegisters[reg] = value;
+    return 0;
+}
+
 void write_settings_to_file(const std::filesystem::path &file)
 {
     std::ofstream ofs(file);
@@ -644,53 +1513,204 @@ void write_settings_to_file(const std::filesystem::path &file)
 
         ofs << left_part
             << std::string(padding, ' ') // pad with spaces
-            << "# " << holdingRegToStr(i)
+            << "# " << holding_register(i).alias << ": " << holding_register(i).name
             << '\n';
     }
 
     printf("Successfully written settings to the config file \"%s\" :-)\n", file.string().c_str());
 }
 
-void read_registers_from_file(const std::filesystem::path &file)
+int read_registers_from_file(const std::filesystem::path &file)
 {
     std::ifstream ifs(file);
     if (!ifs)
     {
         fprintf(stderr, "Failed to open file: %s :(\n", file.string().c_str());
-        return;
+        return -1;
     }
 
-    std::string line;
-    std::regex line_pattern(R"(reg\[(\d+)\]\s*=\s*(\d+))");
+    static constexpr ArgSpec INDEX_ARG{"register", Arg::Int, 0, e_holding_last_item - 1};
+    static constexpr ArgSpec RAW_ARG{"value", Arg::Int, 0, UINT16_MAX};
 
+    std::string line;
     while (std::getline(ifs, line))
     {
-        std::smatch match;
-        if (std::regex_search(line, match, line_pattern))
+        // "alias = value" in engineering units, e.g. "temp_setpoint = 21.5",
+        // or "reg[N] = value" raw as written by settings write_config
+        std::string_view view(line);
+        view = view.substr(0, view.find('#'));
+        auto equal_pos = view.find('=');
+        ArgTokens key(view.substr(0, equal_pos));
+        if (equal_pos == std::string_view::npos || key.size() != 1)
+            continue;
+
+        ArgTokens token(view.substr(equal_pos + 1));
+        int32_t value;
+        const char *error;
+        if (key[0].starts_with("reg[") && key[0].ends_with("]"))
         {
-            size_t index = std::stoul(match[1].str());
-            unsigned long value = std::stoul(match[2].str());
-
-            if (value > std::numeric_limits<uint16_t>::max())
+            int32_t index;
+            if (token.size() != 1 || parse_arg(key[0].substr(4, key[0].size() - 5), INDEX_ARG, index, error) == -1 ||
+                parse_arg(token[0], RAW_ARG, value, error) == -1)
             {
-                throw std::out_of_range("Value out of range for uint16_t at reg[" + std::to_string(index) + "]");
+                fprintf(stderr, "Ignoring \"%s\": %s\n", line.c_str(), token.size() != 1 ? "one value expected" : error);
+                continue;
             }
-
             holdingRegisters[index] = static_cast<uint16_t>(value);
+            continue;
         }
+
+        int reg = find_holding_register(key[0]);
+        if (reg == -1 || token.size() != 1)
+        {
+            fprintf(stderr, "Ignoring \"%s\"\n", line.c_str());
+            continue;
+        }
+        if (parse_arg(token[0], holding_register(reg).arg_spec(), value, error) == -1)
+        {
+            fprintf(stderr, "Ignoring \"%s\": %s\n", line.c_str(), error);
+            continue;
+        }
+        holdingRegisters[reg] = static_cast<uint16_t>(value);
     }
     printf("Successfully read config file \"%s\" :-)\n", file.string().c_str());
+    return 0;
+}
+
+// --offline: no device at all, setters and show commands work on the loaded register model
+// and "settings push" applies it later. -i/-d, when given, only name the default push target.
+int runOffline(const char *file)
+{
+    g_offline = true;
+    holdingRegisters = new uint16_t[e_holding_last_item]();
+
+    WarmCache snapshot;
+    snapshot.set_path(file);
+    if (snapshot.load(holdingRegisters, e_holding_last_item) == 0)
+    {
+        char when[32];
+        time_t stamp = snapshot.stamp();
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M", localtime(&stamp));
+        printf("Offline, settings from the cached snapshot %s taken %s\n", file, when);
+    }
+    else if (read_registers_from_file(file) == -1)
+    {
+        delete[] holdingRegisters;
+        return EXIT_FAILURE;
+    }
+    g_holding_freshness = Freshness::Offline;
+
+    init_monitor();
+    for (int i = static_cast<int>(FnKey::F1); i < static_cast<int>(FnKey::F12) + 1; i++)
+    {
+        my_prompt.attachFnKeyCallback(static_cast<FnKey>(i), [i]()
+                                      { special_function(i); });
+    }
+
+    new_terminal_init();
+    my_prompt.Run();
+
+    delete[] holdingRegisters;
+    return EXIT_SUCCESS;
+}
+
+// --replay: issues the requests of a capture through the same helpers the prompt uses
+// and reports latency and throughput, e.g. against a local test server
+// One captured request as it was sent: the same transport as the production
+// helpers, but reads do not touch the register model or its hooks (energy,
+// alerts, countdowns) and writes are neither checked nor clamped.
+int replayTransact(const ReplayItem &item)
+{
+    std::vector<uint16_t> values = item.values;
+    std::unique_lock lk(modbus_mutex);
+    if (item.function == Function_code::ReadInput || item.function == Function_code::ReadHolding)
+    {
+        values.resize(item.count);
+        return readBlock(item.function, item.addr, item.addr + item.count - 1, values.data());
+    }
+
+    if (pipeline)
+        return pipelineTransact(item.function, item.addr, item.count, values.data());
+
+    if (modbus_connect(ctx) == -1)
+    {
+        fprintf(stderr, "Connection failed: %s\n", modbus_strerror(errno));
+        return -1;
+    }
+    ModbusRequest request{MODBUS_SLAVE_ID, item.function, item.addr, item.count, values.data(), 0};
+    g_transport_stats.transactions++;
+    int rc = libmodbusTransact(request);
+    if (rc == -1)
+    {
+        g_transport_stats.errors++;
+        fprintf(stderr, "Write failed: %s\n", modbus_strerror(errno));
+    }
+    modbus_close(ctx);
+    return rc;
+}
+
+int runReplay(const char *file, double speed)
+{
+    std::vector<ReplayItem> items;
+    size_t ignored;
+    if (load_replay_capture(file, items, ignored) == -1)
+        return EXIT_FAILURE;
+
+    // Only what fits the register blocks of this unit is replayed
+    size_t skipped = items.size();
+    std::erase_if(items, [](const ReplayItem &item)
+                  { uint32_t size = e_holding_last_item;
+                    if (item.function == Function_code::ReadInput)
+                        size = e_input_last_item;
+                    return item.addr + item.count > size; });
+    skipped -= items.size();
+
+    printf("Replaying %zu requests from %s", items.size(), file);
+    if (speed > 0)
+        printf(" at %gx speed", speed);
+    else
+        printf(" back to back");
+    if (ignored || skipped)
+        printf(" (%zu other function codes and %zu out of range requests skipped)", ignored, skipped);
+    printf("\n");
+
+    ReplayStats stats;
+    run_replay(items, speed, replayTransact, stats);
+    print_replay_report(stats);
+
+    return stats.failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
 int main(int argc, char **argv)
 {
-    uint16_t tcp_port{502};
     const char *ip_address{nullptr};
     const char *char_dev{nullptr};
+    size_t window{0};
+    const char *serve_address{nullptr};
+    int cache_ttl_ms{500};
+    const char *metrics_address{nullptr};
+    const char *shm_name{nullptr};
+    const char *offline_file{nullptr};
+    const char *replay_file{nullptr};
+    double replay_speed{1.0};
     int opt;
+    int32_t value;
     bool given_ip{false};
     bool given_chardev{false};
-    while ((opt = getopt(argc, argv, "i:p:d:")) != -1)
+    const option long_options[] = {
+        {"serve", required_argument, nullptr, 'S'},
+        {"cache-ttl", required_argument, nullptr, 'T'},
+        {"metrics", required_argument, nullptr, 'M'},
+        {"shm", required_argument, nullptr, 'H'},
+        {"json", no_argument, nullptr, 'J'},
+        {"clamp", no_argument, nullptr, 'C'},
+        {"offline", required_argument, nullptr, 'O'},
+        {"replay", required_argument, nullptr, 'R'},
+        {"speed", required_argument, nullptr, 'V'},
+        {"energy", no_argument, nullptr, 'E'},
+        {nullptr, 0, nullptr, 0},
+    };
+    while ((opt = getopt_long(argc, argv, "i:p:d:w:", long_options, nullptr)) != -1)
     {
         switch (opt)
         {
@@ -704,22 +1724,78 @@ int main(int argc, char **argv)
             break;
 
         case 'p':
+            if (parse_args(optarg, std::span(&ARG_UINT, 1), &value) == -1)
+                exit(EXIT_FAILURE);
+            tcp_port = static_cast<uint16_t>(value);
+            break;
+
+        case 'w':
+            if (parse_args(optarg, std::span(&ARG_UINT, 1), &value) == -1)
+                exit(EXIT_FAILURE);
+            window = static_cast<size_t>(value);
+            break;
+
+        case 'S':
+            serve_address = optarg;
+            break;
+
+        case 'T':
+            if (parse_args(optarg, std::span(&ARG_UINT, 1), &value) == -1)
+                exit(EXIT_FAILURE);
+            cache_ttl_ms = static_cast<int>(value);
+            break;
+
+        case 'M':
+            metrics_address = optarg;
+            break;
+
+        case 'H':
+            shm_name = optarg;
+            break;
+
+        case 'J':
+            g_output_mode = Output::Json;
+            break;
+
+        case 'C':
+            g_clamp_writes = true;
+            break;
+
+        case 'O':
+            offline_file = optarg;
+            break;
+
+        case 'R':
+            replay_file = optarg;
+            break;
+
+        case 'E':
+            g_energy_polling = true;
+            break;
+
+        case 'V':
         {
-            unsigned long value = std::stoul(optarg);
-            if (value > std::numeric_limits<uint16_t>::max())
-            {
-                throw std::out_of_range("TCP port value should not overflow the range of uint16_t");
-            }
+            // a factor, or "max" for back to back
+            int32_t centi;
+            const char *error;
+            if (std::string_view(optarg) == "max")
+                replay_speed = 0;
+            else if (parse_arg(optarg, {"speed", Arg::Float, 1, INT32_MAX, 100}, centi, error) == 0)
+                replay_speed = centi / 100.0;
             else
             {
-                tcp_port = static_cast<uint16_t>(std::stoul(optarg));
+                fprintf(stderr, "--speed \"%s\": %s, expected a factor like 1, 2.5 or max\n", optarg, error);
+                exit(EXIT_FAILURE);
             }
             break;
         }
 
         default:
-            fprintf(stderr, "Usage: %s -i ip_address\n", argv[0]);
-            fprintf(stderr, "Usage: %s -d /dev/ttyUSB<N>\n", argv[0]);
+            fprintf(stderr, "Usage: %s -i ip_address [-p port] [-w window] [--metrics [address]:port] [--shm /name] [--energy] [--json] [--clamp]\n", argv[0]);
+            fprintf(stderr, "Usage: %s -d /dev/ttyUSB<N> [--metrics [address]:port] [--shm /name] [--energy] [--json] [--clamp]\n", argv[0]);
+            fprintf(stderr, "Usage: %s -d /dev/ttyUSB<N> --serve [address]:port [--cache-ttl ms] [--clamp]\n", argv[0]);
+            fprintf(stderr, "Usage: %s --offline config|cache [-i ip_address [-p port] | -d /dev/ttyUSB<N>] [--json] [--clamp]\n", argv[0]);
+            fprintf(stderr, "Usage: %s -i ip_address [-p port] [-w window] | -d /dev/ttyUSB<N> --replay capture.pcapng [--speed factor|max] [--json]\n", argv[0]);
             exit(EXIT_FAILURE);
         }
     }
@@ -730,21 +1806,49 @@ int main(int argc, char **argv)
         exit(EXIT_FAILURE);
     }
 
+    if (given_ip)
+        g_push_target = std::string(ip_address) + ":" + std::to_string(tcp_port);
+    else if (given_chardev)
+        g_push_target = char_dev;
+
+    if (offline_file)
+    {
+        if (serve_address || metrics_address || shm_name)
+        {
+            fprintf(stderr, "--serve, --metrics and --shm need a device, they do not go with --offline\n");
+            exit(EXIT_FAILURE);
+        }
+        return runOffline(offline_file);
+    }
+
+    if (replay_file && (serve_address || metrics_address || shm_name))
+    {
+        fprintf(stderr, "--replay runs on its own, it does not go with --serve, --metrics or --shm\n");
+        exit(EXIT_FAILURE);
+    }
+
     if (!ip_address && !char_dev)
     {
-        fprintf(stderr, "Usage: %s -i ip_address\n", argv[0]);
+        fprintf(stderr, "Usage: %s -i ip_address [-p port] [-w window]\n", argv[0]);
         fprintf(stderr, "Usage: %s -d /dev/ttyUSB<N>\n", argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    // Start timer thread for some periodic events
-    std::thread timerThread(timer_thread, 1000);
-    timerThread.detach();
+    if (window > 0 && given_chardev)
+    {
+        fprintf(stderr, "Pipelining (-w) is available only for Modbus TCP, ignoring\n");
+    }
 
     if (given_ip)
     {
         printf("IP Address: %s port : %hu\n", ip_address, tcp_port);
         ctx = modbus_new_tcp(ip_address, tcp_port);
+        tcp_host = ip_address;
+        if (window > 0)
+        {
+            printf("Pipelining up to %zu requests\n", window);
+            pipeline = new ModbusPipeline(ip_address, tcp_port, window);
+        }
     }
     else if (given_chardev)
     {
@@ -761,7 +1865,7 @@ int main(int argc, char **argv)
         std::abort();
     }
 
-    modbus_set_slave(ctx, 53);
+    modbus_set_slave(ctx, MODBUS_SLAVE_ID);
     init_monitor();
 
     // Because Libmodbus API has changed after 3.1.2 version
@@ -772,6 +1876,22 @@ int main(int argc, char **argv)
     modbus_set_response_timeout(ctx, 2, 0);
 #endif
 
+    if (serve_address)
+    {
+        // Gateway mode, the serial line is shared by network clients instead of the prompt
+        std::string host;
+        uint16_t port;
+        if (!parseAddress(serve_address, host, port))
+        {
+            fprintf(stderr, "--serve expects [address]:port\n");
+            exit(EXIT_FAILURE);
+        }
+        ModbusGateway gateway(ctx, MODBUS_SLAVE_ID, cache_ttl_ms);
+        gateway.serve(host, port);
+        modbus_free(ctx);
+        return EXIT_FAILURE;
+    }
+
     holdingRegisters = new uint16_t[e_holding_last_item];
 
     memset(holdingRegisters, 0, sizeof(uint16_t) * e_holding_last_item);
@@ -782,14 +1902,65 @@ int main(int argc, char **argv)
                                       { special_function(i); });
     }
 
-    if (updateHoldingRegister(0, e_holding_last_item) == -1 || updateInputRegister(0, e_input_last_item) == -1)
+    // Show the prompt right away, the warm cache covers until the device answers
+    std::string device_key;
+    if (given_ip)
+        device_key = "tcp_" + std::string(ip_address) + "_" + std::to_string(tcp_port) + "_" + std::to_string(MODBUS_SLAVE_ID);
+    else
+        device_key = "rtu_" + std::string(char_dev) + "_" + std::to_string(MODBUS_SLAVE_ID);
+    g_warm_cache.set_device(device_key);
+    capabilities_file = cache_file(device_key, ".caps");
+    load_capabilities(capabilities_file, g_caps);
+    g_warm_cache.set_identity(device_identity(g_caps));
+
+    if (replay_file)
     {
-        fprintf(stderr, "unable to connetc\n");
-        std::abort();
+        int rc = runReplay(replay_file, replay_speed);
+        modbus_free(ctx);
+        delete pipeline;
+        return rc;
     }
+
+    g_energy.open(cache_file(device_key, ".energy"));
+    g_alerts.set_log(cache_file(device_key, ".alerts.log"));
+    if (g_warm_cache.load(holdingRegisters, e_holding_last_item) == 0)
+        g_holding_freshness = Freshness::Cached;
+    refreshInBackground();
+
+    std::unique_ptr<MetricsServer> metrics;
+    if (metrics_address)
+    {
+        std::string host;
+        uint16_t port;
+        if (!parseAddress(metrics_address, host, port))
+        {
+            fprintf(stderr, "--metrics expects [address]:port\n");
+            exit(EXIT_FAILURE);
+        }
+        metrics = std::make_unique<MetricsServer>(g_snapshot, input_flights);
+        if (metrics->start(host, port) == 0)
+            g_snapshot_polling = true;
+    }
+
+    if (shm_name && g_snapshot.enable_shm(shm_name) == 0)
+    {
+        printf("Publishing register snapshot in shared memory %s\n", shm_name);
+        g_snapshot_polling = true;
+    }
+
+    // Start timer thread for some periodic events
+    std::thread timerThread(timer_thread, 1000);
+
     new_terminal_init();
     my_prompt.Run();
 
+    // nothing may touch the bus or the register model once they are gone
+    timer_stop.notify();
+    timerThread.join();
+    if (g_refresh_thread.joinable())
+        g_refresh_thread.join();
+    g_energy.store();
+    delete pipeline;
     delete[] holdingRegisters;
     return 0;
 }
@@ -0,0 +1,220 @@
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "metrics_server.hpp"
+#include "register_table.hpp"
+#include "transport_stats.hpp"
+
+// Configuration worth graphing next to the measurements, scaled as described in register_table.hpp
+static constexpr uint16_t holding_metrics[] = {
+    e_control_mode,
+    e_mode,
+    e_level,
+    e_temp_setpoint,
+    e_curve_active,
+    e_curve_gain,
+    e_curve_offset,
+    e_low_delta,
+    e_high_delta,
+    e_dhw_mode,
+    e_dhw_level,
+    e_dhw_target_temperature,
+    e_minimal_flow,
+    e_t2_low_alarm_value,
+};
+
+static std::string label(const char *metric, unsigned reg, const char *description)
+{
+    std::string retval = std::string(metric) + "{reg=\"" + std::to_string(reg) + "\",description=\"";
+    for (const char *c = description; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            retval += '\\';
+        retval += *c;
+    }
+    return retval + "\"} ";
+}
+
+MetricsServer::MetricsServer(const SnapshotStore &snapshot, const SingleFlight &flights)
+    : snapshot_(snapshot), flights_(flights)
+{
+    for (uint16_t reg = 0; reg < e_input_last_item; reg++)
+        input_labels_.emplace_back(label("ahu_input_register", reg, inputRegToStr(reg)));
+    for (uint16_t reg : holding_metrics)
+        holding_labels_.emplace_back(label("ahu_holding_register", reg, holdingRegToStr(reg)));
+}
+
+int MetricsServer::start(const std::string &host, uint16_t port)
+{
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    addrinfo *result{nullptr};
+    if (getaddrinfo(host.empty() ? nullptr : host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0)
+    {
+        fprintf(stderr, "Unable to resolve metrics address \"%s\"\n", host.c_str());
+        return -1;
+    }
+
+    int listen_fd = ::socket(result->ai_family, result->ai_socktype | SOCK_CLOEXEC, result->ai_protocol);
+    int flag = 1;
+    if (listen_fd < 0 ||
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag)) == -1 ||
+        bind(listen_fd, result->ai_addr, result->ai_addrlen) == -1 ||
+        listen(listen_fd, 4) == -1)
+    {
+        fprintf(stderr, "Unable to serve metrics on port %u: %s\n", port, strerror(errno));
+        freeaddrinfo(result);
+        if (listen_fd >= 0)
+            ::close(listen_fd);
+        return -1;
+    }
+    freeaddrinfo(result);
+
+    printf("Serving metrics on port %u\n", port);
+    std::thread(&MetricsServer::serve, this, listen_fd).detach();
+    return 0;
+}
+
+void MetricsServer::serve(int listen_fd)
+{
+    static constexpr char not_found[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    char request[2048];
+    char header[256];
+
+    while (true)
+    {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            fprintf(stderr, "metrics accept failed: %s\n", strerror(errno));
+            break;
+        }
+
+        timeval timeout{2, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        ssize_t n = recv(fd, request, sizeof(request) - 1, 0);
+        if (n > 0)
+        {
+            request[n] = '\0';
+            if (strncmp(request, "GET /metrics", 12) == 0)
+            {
+                size_t body_length = render();
+                int header_length = snprintf(header, sizeof(header),
+                                             "HTTP/1.1 200 OK\r\n"
+                                             "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                                             "Content-Length: %zu\r\n"
+                                             "Connection: close\r\n\r\n",
+                                             body_length);
+                iovec iov[] = {{header, static_cast<size_t>(header_length)}, {body_.data(), body_length}};
+                msghdr msg{};
+                msg.msg_iov = iov;
+                msg.msg_iovlen = 2;
+                sendmsg(fd, &msg, MSG_NOSIGNAL);
+            }
+            else
+            {
+                send(fd, not_found, sizeof(not_found) - 1, MSG_NOSIGNAL);
+            }
+        }
+        ::close(fd);
+    }
+    ::close(listen_fd);
+}
+
+size_t MetricsServer::render(void)
+{
+    snapshot_.read(current_);
+    length_ = 0;
+
+    static constexpr char input_help[] = "# TYPE ahu_input_register gauge\n# HELP ahu_input_register Input register in engineering units\n";
+    append(input_help, sizeof(input_help) - 1);
+    if (current_.input_stamp_ns != 0)
+    {
+        for (uint16_t reg = 0; reg < e_input_last_item; reg++)
+        {
+            const auto &desc = input_register(reg);
+            append(input_labels_[reg]);
+            append_value(desc.to_engineering(current_.input[reg]), desc.precision());
+        }
+    }
+
+    static constexpr char holding_help[] = "# TYPE ahu_holding_register gauge\n# HELP ahu_holding_register Holding register in engineering units\n";
+    append(holding_help, sizeof(holding_help) - 1);
+    if (current_.holding_stamp_ns != 0)
+    {
+        for (size_t i = 0; i < std::size(holding_metrics); i++)
+        {
+            const auto &desc = holding_register(holding_metrics[i]);
+            append(holding_labels_[i]);
+            append_value(desc.to_engineering(current_.holding[desc.reg]), desc.precision());
+        }
+    }
+
+    static constexpr char stamp_help[] = "# TYPE remote_cli_snapshot_timestamp_seconds gauge\n# HELP remote_cli_snapshot_timestamp_seconds Time of the last complete register block read\n";
+    append(stamp_help, sizeof(stamp_help) - 1);
+    static constexpr char stamp_input[] = "remote_cli_snapshot_timestamp_seconds{block=\"input\"} ";
+    append(stamp_input, sizeof(stamp_input) - 1);
+    append_value(current_.input_stamp_ns / 1e9, 3);
+    static constexpr char stamp_holding[] = "remote_cli_snapshot_timestamp_seconds{block=\"holding\"} ";
+    append(stamp_holding, sizeof(stamp_holding) - 1);
+    append_value(current_.holding_stamp_ns / 1e9, 3);
+
+    struct Counter
+    {
+        const char *name;
+        const char *help;
+        uint64_t value;
+    };
+    const Counter counters[] = {
+        {"remote_cli_modbus_transactions", "Modbus transactions issued", g_transport_stats.transactions},
+        {"remote_cli_modbus_errors", "Modbus transactions which failed", g_transport_stats.errors},
+        {"remote_cli_input_reads", "Input register reads issued by the single-flight layer", flights_.issued()},
+        {"remote_cli_input_reads_shared", "Input register reads served by a shared request", flights_.shared()},
+    };
+    for (const auto &counter : counters)
+    {
+        char line[256];
+        int n = snprintf(line, sizeof(line), "# TYPE %s counter\n# HELP %s %s\n%s_total ", counter.name, counter.name, counter.help, counter.name);
+        append(line, n);
+        append_value(counter.value);
+    }
+
+    append("# EOF\n", 6);
+    return length_;
+}
+
+void MetricsServer::append(const char *str, size_t length)
+{
+    length = std::min(length, body_.size() - length_);
+    memcpy(&body_[length_], str, length);
+    length_ += length;
+}
+
+void MetricsServer::append_value(double value, int precision)
+{
+    char buf[32];
+    auto [end, ec] = std::to_chars(buf, buf + sizeof(buf) - 1, value, std::chars_format::fixed, precision);
+    *end++ = '\n';
+    append(buf, end - buf);
+}
+
+void MetricsServer::append_value(uint64_t value)
+{
+    char buf[32];
+    auto [end, ec] = std::to_chars(buf, buf + sizeof(buf) - 1, value);
+    *end++ = '\n';
+    append(buf, end - buf);
+}
@@ -0,0 +1,41 @@
+#ifndef METRICS_SERVER_HPP
+#define METRICS_SERVER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "register_snapshot.hpp"
+#include "single_flight.hpp"
+
+// Prometheus/OpenMetrics scrape endpoint (GET /metrics). Every scrape is
+// rendered from the background register snapshot into preallocated buffers:
+// no bus traffic and no dynamic allocation per request.
+class MetricsServer
+{
+public:
+    MetricsServer(const SnapshotStore &snapshot, const SingleFlight &flights);
+
+    // Starts serving on a background thread, returns -1 when the socket cannot be set up
+    int start(const std::string &host, uint16_t port);
+
+private:
+    void serve(int listen_fd);
+    size_t render(void);
+    void append(const char *str, size_t length);
+    void append(const std::string &str) { append(str.data(), str.size()); }
+    void append_value(double value, int precision);
+    void append_value(uint64_t value);
+
+    const SnapshotStore &snapshot_;
+    const SingleFlight &flights_;
+    RegisterSnapshot current_{};
+    std::vector<std::string> input_labels_;   // metric name and labels, built once
+    std::vector<std::string> holding_labels_;
+    std::array<char, 32 * 1024> body_;
+    size_t length_{0};
+};
+
+#endif // METRICS_SERVER_HPP
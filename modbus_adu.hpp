@@ -0,0 +1,235 @@
+#ifndef MODBUS_ADU_HPP
+#define MODBUS_ADU_HPP
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "crc16.hpp"
+
+// Modbus application data units (MBAP or RTU framing around a PDU), encoded
+// into and decoded from buffers owned by the caller. Nothing is allocated;
+// register payloads go straight between the frame and their destination.
+
+inline constexpr size_t MBAP_HEADER_LENGTH = 7; // transaction id, protocol id, length, unit id
+inline constexpr size_t MBAP_MAX_ADU_LENGTH = 260;
+inline constexpr size_t RTU_MAX_ADU_LENGTH = 256; // unit id, PDU, CRC
+
+namespace Framing
+{
+    enum framing_t
+    {
+        Tcp = 0, // MBAP header, no check field
+        Rtu,     // unit id in front, CRC-16 behind
+    };
+}
+
+// Function codes which can be issued through the codec
+namespace Function_code
+{
+    enum function_code_t
+    {
+        ReadHolding = 0x03,
+        ReadInput = 0x04,
+        WriteSingle = 0x06,
+        WriteMultiple = 0x10,
+        MaskWrite = 0x16,
+    };
+}
+
+struct ModbusRequest
+{
+    uint8_t unit_id;
+    uint8_t function;    // one of Function_code
+    uint16_t addr;
+    uint16_t count;      // number of registers (1 for WriteSingle and MaskWrite)
+    uint16_t *registers; // destination for reads, source for writes, AND and OR mask for MaskWrite
+    int rc;              // 0 - ok, -1 - transport error, >0 - modbus exception code
+};
+
+// Swaps the bytes of `count` 16 bit words, big endian wire order <-> host order.
+// Eight words per SSE2 step, the rest one by one.
+inline void swap_registers(void *dest, const void *src, size_t count)
+{
+    auto *out = static_cast<uint8_t *>(dest);
+    auto *in = static_cast<const uint8_t *>(src);
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&in[2 * i]));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&out[2 * i]), _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        uint16_t value = (in[2 * i] << 8) | in[2 * i + 1];
+        memcpy(&out[2 * i], &value, sizeof(value));
+    }
+}
+
+inline void load_registers(uint16_t *dest, const uint8_t *payload, size_t count)
+{
+    swap_registers(dest, payload, count);
+}
+
+inline void store_registers(uint8_t *payload, const uint16_t *src, size_t count)
+{
+    swap_registers(payload, src, count);
+}
+
+// Where the PDU starts within a frame
+inline constexpr size_t pdu_offset(int framing)
+{
+    return framing == Framing::Tcp ? MBAP_HEADER_LENGTH : 1;
+}
+
+// Adds header (and CRC) around the `pdu_length` bytes already at frame + pdu_offset(), returns the ADU length
+inline size_t wrap_pdu(int framing, uint8_t *frame, size_t pdu_length, uint8_t unit_id, uint16_t tid)
+{
+    if (framing == Framing::Tcp)
+    {
+        frame[0] = tid >> 8;
+        frame[1] = tid & 0xff;
+        frame[2] = 0; // protocol id
+        frame[3] = 0;
+        frame[4] = (pdu_length + 1) >> 8;
+        frame[5] = (pdu_length + 1) & 0xff;
+        frame[6] = unit_id;
+        return MBAP_HEADER_LENGTH + pdu_length;
+    }
+
+    frame[0] = unit_id;
+    uint16_t crc = crc16(frame, 1 + pdu_length);
+    frame[1 + pdu_length] = crc & 0xff;
+    frame[2 + pdu_length] = crc >> 8;
+    return 3 + pdu_length;
+}
+
+// Writes the PDU of `request` to `pdu`, returns its length, 0 with errno set when it cannot be encoded
+inline size_t encode_pdu(const ModbusRequest &request, uint8_t *pdu)
+{
+    pdu[0] = request.function;
+    pdu[1] = request.addr >> 8;
+    pdu[2] = request.addr & 0xff;
+    switch (request.function)
+    {
+    case Function_code::ReadHolding:
+    case Function_code::ReadInput:
+        pdu[3] = request.count >> 8;
+        pdu[4] = request.count & 0xff;
+        return 5;
+
+    case Function_code::WriteSingle:
+        pdu[3] = request.registers[0] >> 8;
+        pdu[4] = request.registers[0] & 0xff;
+        return 5;
+
+    case Function_code::WriteMultiple:
+        if (request.count * 2 + 6 + MBAP_HEADER_LENGTH > MBAP_MAX_ADU_LENGTH)
+        {
+            errno = EMSGSIZE;
+            return 0;
+        }
+        pdu[3] = request.count >> 8;
+        pdu[4] = request.count & 0xff;
+        pdu[5] = request.count * 2;
+        store_registers(&pdu[6], request.registers, request.count);
+        return 6 + request.count * 2;
+
+    case Function_code::MaskWrite:
+        store_registers(&pdu[3], request.registers, 2);
+        return 7;
+
+    default:
+        errno = EINVAL;
+        return 0;
+    }
+}
+
+// Whole request ADU, returns frame length, 0 on error. `tid` is ignored for RTU.
+inline size_t encode_request(int framing, const ModbusRequest &request, uint16_t tid, uint8_t *frame)
+{
+    size_t pdu_length = encode_pdu(request, &frame[pdu_offset(framing)]);
+    return pdu_length ? wrap_pdu(framing, frame, pdu_length, request.unit_id, tid) : 0;
+}
+
+// Length of the MBAP frame at the start of `buf`, 0 while it is incomplete, -1 for a bad header
+inline int mbap_frame_length(const uint8_t *buf, size_t length)
+{
+    if (length < MBAP_HEADER_LENGTH)
+        return 0;
+    size_t frame_length = 6 + ((buf[4] << 8) | buf[5]);
+    if (frame_length < MBAP_HEADER_LENGTH + 1 || frame_length > MBAP_MAX_ADU_LENGTH)
+        return -1;
+    return length >= frame_length ? static_cast<int>(frame_length) : 0;
+}
+
+inline uint16_t mbap_tid(const uint8_t *frame)
+{
+    return (frame[0] << 8) | frame[1];
+}
+
+// PDU length of a received RTU frame from `unit_id` with a good CRC, -1 otherwise
+inline int rtu_pdu_length(const uint8_t *frame, size_t length, uint8_t unit_id)
+{
+    if (length < 4 || length > RTU_MAX_ADU_LENGTH || frame[0] != unit_id ||
+        crc16(frame, length - 2) != (frame[length - 2] | (frame[length - 1] << 8)))
+        return -1;
+    return static_cast<int>(length - 3);
+}
+
+// 0 for a regular answer to `function`, the exception code for an exception, -1 for anything else
+inline int response_exception(uint8_t function, const uint8_t *pdu, size_t pdu_length)
+{
+    if (pdu_length < 2 || (pdu[0] & 0x7f) != function)
+        return -1;
+    if (pdu[0] & 0x80)
+        return pdu[1] ? pdu[1] : -1;
+    return 0;
+}
+
+// Checks a response PDU against `request` and stores read registers in request.registers.
+// Sets request.rc and returns 0 when the request succeeded, -1 otherwise.
+inline int decode_response(ModbusRequest &request, const uint8_t *pdu, size_t pdu_length)
+{
+    request.rc = -1;
+    int exception = response_exception(request.function, pdu, pdu_length);
+    if (exception != 0)
+    {
+        if (exception > 0)
+            request.rc = exception;
+        return -1;
+    }
+
+    switch (request.function)
+    {
+    case Function_code::ReadHolding:
+    case Function_code::ReadInput:
+        if (pdu[1] != request.count * 2 || pdu_length != 2 + request.count * 2u)
+            return -1;
+        load_registers(request.registers, &pdu[2], request.count);
+        break;
+
+    case Function_code::WriteSingle:
+    case Function_code::WriteMultiple:
+        if (pdu_length != 5)
+            return -1;
+        break;
+
+    case Function_code::MaskWrite:
+        if (pdu_length != 7)
+            return -1;
+        break;
+    }
+
+    request.rc = 0;
+    return 0;
+}
+
+#endif // MODBUS_ADU_HPP
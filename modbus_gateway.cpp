@@ -0,0 +1,389 @@
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "frame_capture.hpp"
+#include "modbus_adu.hpp"
+#include "modbus_gateway.hpp"
+#include "register_table.hpp"
+
+static constexpr uint8_t EXCEPTION_ILLEGAL_DATA_ADDRESS = 0x02;
+static constexpr uint8_t EXCEPTION_ILLEGAL_DATA_VALUE = 0x03;
+static constexpr uint8_t EXCEPTION_GATEWAY_TARGET_FAILED = 0x0B;
+static constexpr uint8_t FC_MASK_WRITE = 0x16;
+static constexpr uint8_t FC_READ_WRITE = 0x17;
+
+static bool recv_all(int fd, uint8_t *buf, size_t length)
+{
+    size_t received = 0;
+    while (received < length)
+    {
+        ssize_t n = ::recv(fd, &buf[received], length - received, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        received += n;
+    }
+    return true;
+}
+
+static bool send_all(int fd, const uint8_t *buf, size_t length)
+{
+    size_t sent = 0;
+    while (sent < length)
+    {
+        ssize_t n = ::send(fd, &buf[sent], length - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+ModbusGateway::ModbusGateway(modbus_t *ctx, uint8_t unit_id, int ttl_ms)
+    : ctx_(ctx), unit_id_(unit_id), ttl_(std::chrono::milliseconds(ttl_ms))
+{
+}
+
+int ModbusGateway::serve(const std::string &host, uint16_t port)
+{
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    addrinfo *result{nullptr};
+    if (getaddrinfo(host.empty() ? nullptr : host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0)
+    {
+        fprintf(stderr, "Unable to resolve listen address \"%s\"\n", host.c_str());
+        return -1;
+    }
+
+    int listen_fd = ::socket(result->ai_family, result->ai_socktype | SOCK_CLOEXEC, result->ai_protocol);
+    int flag = 1;
+    if (listen_fd < 0 ||
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag)) == -1 ||
+        bind(listen_fd, result->ai_addr, result->ai_addrlen) == -1 ||
+        listen(listen_fd, 16) == -1)
+    {
+        fprintf(stderr, "Unable to listen on port %u: %s\n", port, strerror(errno));
+        freeaddrinfo(result);
+        if (listen_fd >= 0)
+            ::close(listen_fd);
+        return -1;
+    }
+    freeaddrinfo(result);
+
+    printf("Serving Modbus TCP on port %u\n", port);
+    std::thread bus(&ModbusGateway::bus_thread, this);
+
+    while (true)
+    {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            fprintf(stderr, "accept failed: %s\n", strerror(errno));
+            break;
+        }
+        std::unique_lock lk(mutex_);
+        clients_.insert(fd);
+        std::thread(&ModbusGateway::client_thread, this, fd).detach();
+    }
+    ::close(listen_fd);
+
+    // Clients may still wait for the bus, it runs until they are gone
+    std::unique_lock lk(mutex_);
+    for (int fd : clients_)
+        ::shutdown(fd, SHUT_RDWR);
+    clients_cv_.wait(lk, [this]
+                     { return clients_.empty(); });
+    stopping_ = true;
+    bus_cv_.notify_one();
+    lk.unlock();
+    bus.join();
+    return -1;
+}
+
+void ModbusGateway::client_thread(int fd)
+{
+    uint8_t frame[MBAP_MAX_ADU_LENGTH];
+    printf("Client connected (fd %d)\n", fd);
+
+    while (recv_all(fd, frame, MBAP_HEADER_LENGTH))
+    {
+        size_t length = (frame[4] << 8) | frame[5]; // unit id + PDU
+        if (length < 2 || MBAP_HEADER_LENGTH - 1 + length > MBAP_MAX_ADU_LENGTH)
+            break;
+        if (!recv_all(fd, &frame[MBAP_HEADER_LENGTH], length - 1))
+            break;
+
+        g_capture.record(Framing::Tcp, Capture::RxRequest, frame, MBAP_HEADER_LENGTH - 1 + length);
+        Pdu request(&frame[MBAP_HEADER_LENGTH - 1], &frame[MBAP_HEADER_LENGTH - 1 + length]);
+        Pdu response = process(request);
+
+        std::copy(response.begin() + 1, response.end(), &frame[MBAP_HEADER_LENGTH]);
+        size_t frame_length = wrap_pdu(Framing::Tcp, frame, response.size() - 1, response[0], mbap_tid(frame));
+        g_capture.record(Framing::Tcp, Capture::TxResponse, frame, frame_length);
+        if (!send_all(fd, frame, frame_length))
+            break;
+    }
+
+    std::unique_lock lk(mutex_);
+    ::close(fd);
+    clients_.erase(fd);
+    clients_cv_.notify_all();
+    printf("Client disconnected (fd %d). Requests: %" PRIu64 ", cache hits: %" PRIu64 ", coalesced: %" PRIu64 ", bus transactions: %" PRIu64 ", refused writes: %" PRIu64 "\n",
+           fd, requests_, cache_hits_, coalesced_, bus_transactions_, refused_);
+}
+
+// Values written to our unit outside the register limits are answered here
+// (or clamped in the request with --clamp), they never reach the bus.
+// Returns the exception code to answer with, 0 to forward the request.
+uint8_t ModbusGateway::check_write(Pdu &request)
+{
+    if (request[0] != unit_id_)
+        return 0;
+
+    size_t addr_pos, count_pos, values_pos;
+    switch (request[1])
+    {
+    case Function_code::WriteSingle:
+        addr_pos = 2, count_pos = 0, values_pos = 4;
+        break;
+    case Function_code::WriteMultiple:
+        addr_pos = 2, count_pos = 4, values_pos = 7;
+        break;
+    case FC_READ_WRITE:
+        addr_pos = 6, count_pos = 8, values_pos = 11;
+        break;
+    case FC_MASK_WRITE:
+        // the result depends on the unit's current value unless every bit is replaced
+        if (request.size() != 8 || request[4] != 0 || request[5] != 0)
+            return 0;
+        addr_pos = 2, count_pos = 0, values_pos = 6;
+        break;
+    default:
+        return 0;
+    }
+
+    uint16_t count = count_pos ? (request[count_pos] << 8) | request[count_pos + 1] : 1;
+    if (request.size() < values_pos + 2 || count > MODBUS_MAX_WRITE_REGISTERS || request.size() < values_pos + 2u * count)
+        return 0; // malformed, the unit answers that itself
+
+    uint16_t addr = (request[addr_pos] << 8) | request[addr_pos + 1];
+    if (addr + count > e_holding_last_item)
+        return EXCEPTION_ILLEGAL_DATA_ADDRESS;
+
+    uint16_t values[MODBUS_MAX_WRITE_REGISTERS];
+    load_registers(values, &request[values_pos], count);
+    if (validate_holding_write(addr, values, count) == -1)
+        return EXCEPTION_ILLEGAL_DATA_VALUE;
+
+    store_registers(&request[values_pos], values, count);
+    return 0;
+}
+
+ModbusGateway::Pdu ModbusGateway::process(Pdu &request)
+{
+    uint8_t exception = check_write(request);
+
+    std::unique_lock lk(mutex_);
+    requests_++;
+    if (exception)
+    {
+        refused_++;
+        return {request[0], static_cast<uint8_t>(request[1] | 0x80), exception};
+    }
+
+    std::shared_ptr<BusJob> job;
+    if (CacheEntry *entry = cacheable(request) ? cache_entry(request) : nullptr)
+    {
+        if (!entry->response.empty() && Clock::now() - entry->stamp < ttl_)
+        {
+            cache_hits_++;
+            return entry->response;
+        }
+
+        if (entry->in_flight)
+        {
+            coalesced_++;
+            job = entry->in_flight;
+        }
+        else
+        {
+            job = std::make_shared<BusJob>();
+            job->request = request;
+            entry->in_flight = job;
+            queue_.push_back(job);
+            bus_cv_.notify_one();
+        }
+    }
+    else
+    {
+        job = std::make_shared<BusJob>();
+        job->request = request;
+        queue_.push_back(job);
+        bus_cv_.notify_one();
+    }
+
+    done_cv_.wait(lk, [&job]
+                  { return job->done; });
+    return job->response;
+}
+
+void ModbusGateway::bus_thread(void)
+{
+    bool connected{false};
+    while (true)
+    {
+        std::shared_ptr<BusJob> job;
+        {
+            std::unique_lock lk(mutex_);
+            bus_cv_.wait(lk, [this]
+                         { return !queue_.empty() || stopping_; });
+            if (queue_.empty())
+                break;
+            job = queue_.front();
+            queue_.pop_front();
+        }
+
+        if (!connected)
+        {
+            connected = modbus_connect(ctx_) != -1;
+            if (!connected)
+                fprintf(stderr, "Connection failed: %s\n", modbus_strerror(errno));
+        }
+
+        Pdu response;
+        if (connected)
+        {
+            bool broken{false};
+            response = forward(job->request, broken);
+            if (broken)
+            {
+                // reconnected for the next job, e.g. a TCP upstream which went away or a replugged adapter
+                modbus_close(ctx_);
+                connected = false;
+            }
+        }
+        else
+            response = {job->request[0], static_cast<uint8_t>(job->request[1] | 0x80), EXCEPTION_GATEWAY_TARGET_FAILED};
+
+        std::unique_lock lk(mutex_);
+        bus_transactions_++;
+        job->response = std::move(response);
+        job->done = true;
+
+        bool exception = job->response[1] & 0x80;
+        Clock::time_point now = Clock::now();
+        if (cacheable(job->request))
+        {
+            auto it = cache_.find(job->request);
+            if (it != cache_.end() && it->second.in_flight == job)
+            {
+                it->second.in_flight.reset();
+                if (!exception)
+                {
+                    it->second.response = job->response;
+                    it->second.stamp = now;
+                }
+            }
+        }
+        else if (!exception)
+        {
+            invalidate(job->request[0]);
+        }
+        if (now - expired_ >= ttl_)
+            expire(now);
+        done_cv_.notify_all();
+    }
+}
+
+// `broken` is set on a transport error, the connection is then unusable; an
+// exception is a regular answer and a silent RTU unit leaves the line as it was
+ModbusGateway::Pdu ModbusGateway::forward(const Pdu &request, bool &broken)
+{
+    uint8_t rsp[MODBUS_MAX_ADU_LENGTH];
+    int header = modbus_get_header_length(ctx_);
+    int crc = header == 1 ? 2 : 0; // RTU frames end with CRC
+    int framing = header == 1 ? Framing::Rtu : Framing::Tcp;
+
+    g_capture.record_pdu(framing, Capture::TxRequest, request[0], &request[1], request.size() - 1);
+    int rc = modbus_send_raw_request(ctx_, request.data(), request.size());
+    if (rc != -1)
+        rc = modbus_receive_confirmation(ctx_, rsp);
+
+    bool timeout = rc == -1 && errno == ETIMEDOUT;
+    if (timeout)
+        g_capture.record_timeout(framing, request[0], request[1]);
+    else if (rc != -1)
+        g_capture.record(framing, Capture::RxResponse, rsp, rc, rc < header + 1 + crc ? Capture::Malformed : Capture::Ok);
+
+    if (rc == -1 || rc < header + 1 + crc)
+    {
+        broken = !(framing == Framing::Rtu && timeout);
+        fprintf(stderr, "Forwarding failed: %s\n", modbus_strerror(errno));
+        return {request[0], static_cast<uint8_t>(request[1] | 0x80), EXCEPTION_GATEWAY_TARGET_FAILED};
+    }
+
+    Pdu response{request[0]};
+    response.insert(response.end(), &rsp[header], &rsp[rc - crc]);
+    return response;
+}
+
+// Anything but a read may have changed the device state, drop cached reads of that unit
+void ModbusGateway::invalidate(uint8_t unit_id)
+{
+    for (auto it = cache_.begin(); it != cache_.end();)
+    {
+        if (it->first[0] == unit_id && !it->second.in_flight)
+        {
+            it = cache_.erase(it);
+            continue;
+        }
+        if (it->first[0] == unit_id)
+            it->second.response.clear();
+        ++it;
+    }
+}
+
+// Entry of a cacheable read, nullptr when the cache is full even after dropping
+// the expired entries; with mutex_ held
+ModbusGateway::CacheEntry *ModbusGateway::cache_entry(const Pdu &request)
+{
+    auto it = cache_.find(request);
+    if (it != cache_.end())
+        return &it->second;
+
+    if (cache_.size() >= MAX_CACHE_ENTRIES)
+        expire(Clock::now());
+    if (cache_.size() >= MAX_CACHE_ENTRIES)
+        return nullptr;
+    return &cache_[request];
+}
+
+// Drops entries which are neither fresh nor waited for, so clients scanning
+// addresses do not grow the cache; with mutex_ held
+void ModbusGateway::expire(Clock::time_point now)
+{
+    expired_ = now;
+    std::erase_if(cache_, [&](const auto &item)
+                  { return !item.second.in_flight && (item.second.response.empty() || now - item.second.stamp >= ttl_); });
+}
+
+bool ModbusGateway::cacheable(const Pdu &request)
+{
+    return request.size() == 6 &&
+           (request[1] == Function_code::ReadHolding || request[1] == Function_code::ReadInput);
+}
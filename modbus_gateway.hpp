@@ -0,0 +1,84 @@
+#ifndef MODBUS_GATEWAY_HPP
+#define MODBUS_GATEWAY_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <modbus/modbus.h>
+
+// Modbus TCP server forwarding client requests onto a single upstream context
+// (typically the RTU line). All bus traffic goes through one FIFO worker so
+// writes reach the device in arrival order. Successful register reads are
+// cached for `ttl_ms` and identical reads already on their way to the device
+// are shared between clients instead of being sent twice. Writes addressed to
+// `unit_id` are checked against the register limits before they are queued.
+class ModbusGateway
+{
+public:
+    ModbusGateway(modbus_t *ctx, uint8_t unit_id, int ttl_ms);
+
+    // Blocks serving clients, returns -1 when the listening socket cannot be set up
+    // or fails; the client and bus threads are ended before it returns
+    int serve(const std::string &host, uint16_t port);
+
+private:
+    static constexpr size_t MAX_CACHE_ENTRIES = 1024; // reads beyond it go to the bus uncached
+
+    using Clock = std::chrono::steady_clock;
+    using Pdu = std::vector<uint8_t>; // unit id followed by modbus PDU
+
+    struct BusJob
+    {
+        Pdu request;
+        Pdu response;
+        bool done{false};
+    };
+
+    struct CacheEntry
+    {
+        Pdu response;
+        Clock::time_point stamp;
+        std::shared_ptr<BusJob> in_flight;
+    };
+
+    void client_thread(int fd);
+    void bus_thread(void);
+    Pdu process(Pdu &request);
+    uint8_t check_write(Pdu &request);
+    Pdu forward(const Pdu &request, bool &broken);
+    void invalidate(uint8_t unit_id);
+    CacheEntry *cache_entry(const Pdu &request);
+    void expire(Clock::time_point now);
+    static bool cacheable(const Pdu &request);
+
+    modbus_t *ctx_;
+    uint8_t unit_id_;
+    Clock::duration ttl_;
+
+    std::mutex mutex_;
+    std::condition_variable bus_cv_;
+    std::condition_variable done_cv_;
+    std::condition_variable clients_cv_;
+    std::set<int> clients_; // sockets of the running client threads
+    bool stopping_{false};  // the bus thread ends once the clients are gone
+    std::deque<std::shared_ptr<BusJob>> queue_;
+    std::map<Pdu, CacheEntry> cache_;
+    Clock::time_point expired_{}; // last sweep of idle entries
+
+    // statistics
+    uint64_t requests_{0};
+    uint64_t cache_hits_{0};
+    uint64_t coalesced_{0};
+    uint64_t bus_transactions_{0};
+    uint64_t refused_{0};
+};
+
+#endif // MODBUS_GATEWAY_HPP
@@ -0,0 +1,288 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "frame_capture.hpp"
+#include "modbus_pipeline.hpp"
+
+ModbusPipeline::ModbusPipeline(const std::string &host, uint16_t port, size_t window, int timeout_ms)
+    : host_(host), port_(port), window_(std::max<size_t>(window, 1)), timeout_ms_(timeout_ms)
+{
+    rx_buf_.resize(MBAP_MAX_ADU_LENGTH * (window_ + 1));
+    in_flight_.reserve(window_);
+}
+
+ModbusPipeline::~ModbusPipeline()
+{
+    close();
+}
+
+int tcp_connect(const std::string &host, uint16_t port)
+{
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo *result{nullptr};
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0)
+    {
+        errno = EHOSTUNREACH;
+        return -1;
+    }
+
+    int fd = -1;
+    for (addrinfo *ai = result; ai != nullptr; ai = ai->ai_next)
+    {
+        fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+
+        if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+        {
+            int flag = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+            break;
+        }
+        ::close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+
+    return fd;
+}
+
+int ModbusPipeline::connect(void)
+{
+    if (fd_ >= 0)
+        return 0;
+
+    fd_ = tcp_connect(host_, port_);
+
+    return fd_ >= 0 ? 0 : -1;
+}
+
+void ModbusPipeline::close(void)
+{
+    if (fd_ >= 0)
+        ::close(fd_);
+    fd_ = -1;
+    rx_begin_ = rx_end_ = 0;
+    in_flight_.clear();
+}
+
+int ModbusPipeline::execute(ModbusRequest *requests, size_t count)
+{
+    std::vector<size_t> pending;
+    pending.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        requests[i].rc = -1;
+        pending.push_back(i);
+    }
+
+    while (!pending.empty())
+    {
+        if (connect() == -1)
+            return -1;
+
+        size_t window_before = window_;
+        if (run(requests, count, pending) == 0)
+            break;
+
+        int saved_errno = errno;
+        close();
+        errno = saved_errno;
+
+        // Device could not cope with overlapping requests, retry the rest one by one
+        if (window_ < window_before)
+            continue;
+
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (requests[i].rc != 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+// Keeps up to window_ requests in flight until everything in `pending` is answered.
+// On failure `pending` is left holding only the unanswered requests which are safe
+// to send again: reads, and writes which never left. A write whose response was
+// lost may already have been applied, e.g. a command register, it fails instead.
+int ModbusPipeline::run(ModbusRequest *requests, size_t count, std::vector<size_t> &pending)
+{
+    std::vector<bool> answered(count, false);
+    std::vector<bool> sent(count, false);
+    size_t next = 0;
+    size_t completed = 0;
+    bool overlapped = false; // a request was sent while another one was still unanswered
+    int rc = 0;
+
+    in_flight_.clear();
+    while (completed < pending.size())
+    {
+        while (next < pending.size() && in_flight_.size() < window_)
+        {
+            uint16_t tid = next_tid_++;
+            if (send_request(requests[pending[next]], tid) == -1)
+            {
+                rc = -1;
+                break;
+            }
+            sent[pending[next]] = true;
+            in_flight_.push_back({tid, pending[next]});
+            overlapped |= in_flight_.size() > 1;
+            next++;
+        }
+        if (rc == -1)
+            break;
+
+        const uint8_t *frame{nullptr};
+        size_t length{0};
+        if (receive_frame(frame, length) == -1)
+        {
+            if (errno == ETIMEDOUT)
+            {
+                for (const auto &waiting : in_flight_)
+                    g_capture.record_timeout(Framing::Tcp, requests[waiting.index].unit_id, requests[waiting.index].function);
+            }
+            if (overlapped)
+                degrade(errno == ETIMEDOUT ? "timeout" : "connection lost");
+            rc = -1;
+            break;
+        }
+
+        g_capture.record(Framing::Tcp, Capture::RxResponse, frame, length);
+        uint16_t tid = mbap_tid(frame);
+        auto it = std::find_if(in_flight_.begin(), in_flight_.end(), [tid](const InFlight &f)
+                               { return f.tid == tid; });
+        if (it == in_flight_.end())
+        {
+            degrade("unknown transaction id");
+            errno = EPROTO;
+            rc = -1;
+            break;
+        }
+
+        decode_response(requests[it->index], &frame[MBAP_HEADER_LENGTH], length - MBAP_HEADER_LENGTH);
+        answered[it->index] = true;
+        in_flight_.erase(it);
+        completed++;
+    }
+
+    if (rc == -1)
+    {
+        auto done = [&](size_t i)
+        {
+            bool read = requests[i].function == Function_code::ReadHolding || requests[i].function == Function_code::ReadInput;
+            return answered[i] || (sent[i] && !read);
+        };
+        pending.erase(std::remove_if(pending.begin(), pending.end(), done), pending.end());
+    }
+    in_flight_.clear();
+
+    return rc;
+}
+
+int ModbusPipeline::send_request(const ModbusRequest &request, uint16_t tid)
+{
+    uint8_t frame[MBAP_MAX_ADU_LENGTH];
+    size_t total = encode_request(Framing::Tcp, request, tid, frame);
+    if (total == 0)
+        return -1;
+
+    size_t sent = 0;
+    while (sent < total)
+    {
+        ssize_t n = ::send(fd_, &frame[sent], total - sent, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        sent += n;
+    }
+    g_capture.record(Framing::Tcp, Capture::TxRequest, frame, total);
+
+    return 0;
+}
+
+// Hands out the next complete frame in place. It stays valid until the next call,
+// only then is the buffer compacted to make room for more data.
+int ModbusPipeline::receive_frame(const uint8_t *&frame, size_t &length)
+{
+    while (true)
+    {
+        int frame_length = mbap_frame_length(&rx_buf_[rx_begin_], rx_end_ - rx_begin_);
+        if (frame_length == -1)
+        {
+            errno = EPROTO;
+            return -1;
+        }
+        if (frame_length > 0)
+        {
+            frame = &rx_buf_[rx_begin_];
+            length = frame_length;
+            rx_begin_ += frame_length;
+            return 0;
+        }
+
+        if (rx_begin_ > 0)
+        {
+            memmove(rx_buf_.data(), &rx_buf_[rx_begin_], rx_end_ - rx_begin_);
+            rx_end_ -= rx_begin_;
+            rx_begin_ = 0;
+        }
+
+        pollfd pfd{fd_, POLLIN, 0};
+        int rc = poll(&pfd, 1, timeout_ms_);
+        if (rc == 0)
+        {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        if (rc < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        ssize_t n = ::recv(fd_, &rx_buf_[rx_end_], rx_buf_.size() - rx_end_, 0);
+        if (n == 0)
+        {
+            errno = ECONNRESET;
+            return -1;
+        }
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        rx_end_ += n;
+    }
+}
+
+void ModbusPipeline::degrade(const char *reason)
+{
+    if (window_ > 1)
+    {
+        fprintf(stderr, "Device does not cope with pipelined requests (%s), falling back to window = 1\n", reason);
+        window_ = 1;
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef MODBUS_PIPELINE_HPP
+#define MODBUS_PIPELINE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "modbus_adu.hpp"
+
+// Opens a blocking TCP connection with TCP_NODELAY set, returns fd or -1
+int tcp_connect(const std::string &host, uint16_t port);
+
+// Modbus TCP client keeping up to `window` transactions in flight on one
+// persistent connection. Responses are matched to requests by MBAP
+// transaction id, so they may arrive in any order. When the device does not
+// cope with overlapping requests (timeout, unknown transaction id, dropped
+// connection) the client falls back to window = 1 and retries what is left.
+class ModbusPipeline
+{
+public:
+    ModbusPipeline(const std::string &host, uint16_t port, size_t window, int timeout_ms = 2000);
+    ~ModbusPipeline();
+
+    ModbusPipeline(const ModbusPipeline &) = delete;
+    ModbusPipeline &operator=(const ModbusPipeline &) = delete;
+
+    int connect(void);
+    void close(void);
+
+    // Executes all requests, returns 0 when every request succeeded, -1 otherwise
+    // (see ModbusRequest::rc for per-request result, errno for the last error).
+    int execute(ModbusRequest *requests, size_t count);
+
+    size_t window(void) const { return window_; }
+
+private:
+    struct InFlight
+    {
+        uint16_t tid;
+        size_t index;
+    };
+
+    int run(ModbusRequest *requests, size_t count, std::vector<size_t> &pending);
+    int send_request(const ModbusRequest &request, uint16_t tid);
+    int receive_frame(const uint8_t *&frame, size_t &length);
+    void degrade(const char *reason);
+
+    std::string host_;
+    uint16_t port_;
+    size_t window_;
+    int timeout_ms_;
+    int fd_{-1};
+    uint16_t next_tid_{0};
+    std::vector<uint8_t> rx_buf_; // responses are decoded where they were received
+    size_t rx_begin_{0};          // first byte not yet handed out by receive_frame()
+    size_t rx_end_{0};
+    std::vector<InFlight> in_flight_;
+};
+
+#endif // MODBUS_PIPELINE_HPP
@@ -0,0 +1,391 @@
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <limits>
+
+#include "monitor_expr.hpp"
+#include "register_table.hpp"
+
+// Recursive descent over the usual precedence, emitting stack code as it goes
+class ExprParser
+{
+public:
+    ExprParser(std::string_view text, std::vector<ExprInstruction> &code) : text_(text), code_(code) {}
+
+    bool parse(void)
+    {
+        if (!expression())
+            return false;
+        skip_space();
+        return pos_ == text_.size() || fail("unexpected character");
+    }
+
+    const char *error(void) const { return error_; }
+    size_t error_pos(void) const { return error_pos_; }
+    uint16_t slots(void) const { return slots_; }
+
+private:
+    bool fail(const char *message)
+    {
+        if (!error_)
+        {
+            error_ = message;
+            error_pos_ = pos_;
+        }
+        return false;
+    }
+
+    void skip_space(void)
+    {
+        while (pos_ < text_.size() && isspace(static_cast<unsigned char>(text_[pos_])))
+            pos_++;
+    }
+
+    bool accept(char c)
+    {
+        skip_space();
+        if (pos_ < text_.size() && text_[pos_] == c)
+        {
+            pos_++;
+            return true;
+        }
+        return false;
+    }
+
+    void emit(uint8_t op, uint16_t arg = 0, double value = 0) { code_.push_back({op, arg, value}); }
+
+    bool expression(void)
+    {
+        if (!term())
+            return false;
+        for (;;)
+        {
+            if (accept('+'))
+            {
+                if (!term())
+                    return false;
+                emit(ExprOp::Add);
+            }
+            else if (accept('-'))
+            {
+                if (!term())
+                    return false;
+                emit(ExprOp::Sub);
+            }
+            else
+                return true;
+        }
+    }
+
+    bool term(void)
+    {
+        if (!unary())
+            return false;
+        for (;;)
+        {
+            if (accept('*'))
+            {
+                if (!unary())
+                    return false;
+                emit(ExprOp::Mul);
+            }
+            else if (accept('/'))
+            {
+                if (!unary())
+                    return false;
+                emit(ExprOp::Div);
+            }
+            else
+                return true;
+        }
+    }
+
+    bool unary(void)
+    {
+        if (accept('-'))
+        {
+            if (!unary())
+                return false;
+            emit(ExprOp::Neg);
+            return true;
+        }
+        accept('+');
+        return primary();
+    }
+
+    bool primary(void)
+    {
+        skip_space();
+        if (pos_ >= text_.size())
+            return fail("expression expected");
+
+        if (accept('('))
+            return expression() && (accept(')') || fail("')' expected"));
+
+        char c = text_[pos_];
+        if (isdigit(static_cast<unsigned char>(c)) || c == '.')
+        {
+            double value;
+            auto [ptr, ec] = std::from_chars(text_.data() + pos_, text_.data() + text_.size(), value);
+            if (ec != std::errc())
+                return fail("bad number");
+            pos_ = ptr - text_.data();
+            emit(ExprOp::Const, 0, value);
+            return true;
+        }
+
+        if (!isalpha(static_cast<unsigned char>(c)) && c != '_')
+            return fail("register name, number or function expected");
+
+        size_t start = pos_;
+        std::string name;
+        while (pos_ < text_.size() && (isalnum(static_cast<unsigned char>(text_[pos_])) || text_[pos_] == '_'))
+            name += static_cast<char>(tolower(static_cast<unsigned char>(text_[pos_++])));
+
+        if (accept('('))
+            return function(name, start);
+        return load(name, start, ExprOp::Load);
+    }
+
+    bool load(const std::string &name, size_t start, uint8_t op)
+    {
+        int reg = find_input_register(name);
+        if (reg == -1 && op == ExprOp::Load)
+        {
+            reg = find_holding_register(name);
+            op = ExprOp::LoadHolding;
+        }
+        if (reg == -1)
+        {
+            pos_ = start;
+            return fail("unknown register");
+        }
+        emit(op, static_cast<uint16_t>(reg));
+        return true;
+    }
+
+    // Arguments up to and including ')', returns how many there were
+    int arguments(void)
+    {
+        int count = 0;
+        do
+        {
+            if (!expression())
+                return -1;
+            count++;
+        } while (accept(','));
+        return accept(')') ? count : (fail("')' expected"), -1);
+    }
+
+    bool function(const std::string &name, size_t start)
+    {
+        if (name == "raw")
+        {
+            skip_space();
+            size_t arg_start = pos_;
+            std::string reg;
+            while (pos_ < text_.size() && (isalnum(static_cast<unsigned char>(text_[pos_])) || text_[pos_] == '_'))
+                reg += static_cast<char>(tolower(static_cast<unsigned char>(text_[pos_++])));
+            return load(reg, arg_start, ExprOp::LoadRaw) && (accept(')') || fail("')' expected"));
+        }
+
+        size_t first = code_.size();
+        int count = arguments();
+        if (count == -1)
+            return false;
+
+        if ((name == "min" || name == "max") && count >= 2)
+        {
+            for (int i = 1; i < count; i++)
+                emit(name == "min" ? ExprOp::Min : ExprOp::Max);
+            return true;
+        }
+        if (name == "abs" && count == 1)
+        {
+            emit(ExprOp::Abs);
+            return true;
+        }
+        if (name == "rate" && count == 1)
+        {
+            // rate() of a bare counter register survives its wrap to 0
+            double modulus = 0;
+            if (code_.size() == first + 1 && code_[first].op == ExprOp::Load)
+            {
+                const auto &desc = input_register(code_[first].arg);
+                if (!desc.is_signed)
+                    modulus = 65536.0 / desc.scale;
+            }
+            emit(ExprOp::Rate, slots_++, modulus);
+            return true;
+        }
+        if (name == "ewma" && count == 2)
+        {
+            const ExprInstruction &tau = code_.back();
+            if (tau.op != ExprOp::Const || !(tau.value > 0))
+                return fail("ewma() needs a time constant in seconds, e.g. ewma(t5, 60)");
+            double seconds = tau.value;
+            code_.pop_back();
+            emit(ExprOp::Ewma, slots_++, seconds);
+            return true;
+        }
+
+        pos_ = start;
+        if (name == "min" || name == "max" || name == "abs" || name == "rate" || name == "ewma")
+            return fail("wrong number of arguments");
+        return fail("unknown function");
+    }
+
+    std::string_view text_;
+    std::vector<ExprInstruction> &code_;
+    size_t pos_{0};
+    uint16_t slots_{0};
+    const char *error_{nullptr};
+    size_t error_pos_{0};
+};
+
+int MonitorExpression::compile(std::string_view text, std::string &error)
+{
+    while (!text.empty() && isspace(static_cast<unsigned char>(text.front())))
+        text.remove_prefix(1);
+    while (!text.empty() && isspace(static_cast<unsigned char>(text.back())))
+        text.remove_suffix(1);
+
+    std::vector<ExprInstruction> code;
+    ExprParser parser(text, code);
+    if (!parser.parse())
+    {
+        error = std::string(text) + "\n" + std::string(parser.error_pos(), ' ') + "^ " + parser.error();
+        return -1;
+    }
+
+    size_t depth = 0, max_depth = 0;
+    for (const auto &ins : code)
+    {
+        switch (ins.op)
+        {
+        case ExprOp::Const:
+        case ExprOp::Load:
+        case ExprOp::LoadRaw:
+        case ExprOp::LoadHolding:
+            max_depth = std::max(max_depth, ++depth);
+            break;
+        case ExprOp::Add:
+        case ExprOp::Sub:
+        case ExprOp::Mul:
+        case ExprOp::Div:
+        case ExprOp::Min:
+        case ExprOp::Max:
+            depth--;
+            break;
+        }
+    }
+
+    text_ = text;
+    code_ = std::move(code);
+    stack_.assign(max_depth, 0.0);
+    state_.assign(parser.slots(), std::numeric_limits<double>::quiet_NaN());
+    last_ = {};
+    return 0;
+}
+
+double MonitorExpression::evaluate(const uint16_t *input, const uint16_t *holding, Clock::time_point now)
+{
+    double dt = last_ == Clock::time_point{} ? 0 : std::chrono::duration<double>(now - last_).count();
+    last_ = now;
+
+    double *sp = stack_.data(); // next free entry
+    for (const auto &ins : code_)
+    {
+        switch (ins.op)
+        {
+        case ExprOp::Const:
+            *sp++ = ins.value;
+            break;
+        case ExprOp::Load:
+            *sp++ = input_register(ins.arg).to_engineering(input[ins.arg]);
+            break;
+        case ExprOp::LoadRaw:
+            *sp++ = input[ins.arg];
+            break;
+        case ExprOp::LoadHolding:
+            *sp++ = holding ? holding_register(ins.arg).to_engineering(holding[ins.arg]) : std::numeric_limits<double>::quiet_NaN();
+            break;
+        case ExprOp::Add:
+            sp--;
+            sp[-1] += sp[0];
+            break;
+        case ExprOp::Sub:
+            sp--;
+            sp[-1] -= sp[0];
+            break;
+        case ExprOp::Mul:
+            sp--;
+            sp[-1] *= sp[0];
+            break;
+        case ExprOp::Div:
+            sp--;
+            sp[-1] /= sp[0];
+            break;
+        case ExprOp::Neg:
+            sp[-1] = -sp[-1];
+            break;
+        case ExprOp::Min:
+            sp--;
+            sp[-1] = std::min(sp[-1], sp[0]);
+            break;
+        case ExprOp::Max:
+            sp--;
+            sp[-1] = std::max(sp[-1], sp[0]);
+            break;
+        case ExprOp::Abs:
+            sp[-1] = std::fabs(sp[-1]);
+            break;
+        case ExprOp::Rate:
+        {
+            double &previous = state_[ins.arg];
+            double value = sp[-1];
+            double delta = value - previous;
+            if (delta < 0 && ins.value > 0)
+                delta += ins.value;
+            sp[-1] = dt > 0 ? delta / dt : std::numeric_limits<double>::quiet_NaN();
+            previous = value;
+            break;
+        }
+        case ExprOp::Ewma:
+        {
+            double &average = state_[ins.arg];
+            if (std::isnan(average))
+                average = sp[-1];
+            else if (dt > 0)
+                average += (1 - std::exp(-dt / ins.value)) * (sp[-1] - average);
+            sp[-1] = average;
+            break;
+        }
+        }
+    }
+    return sp[-1];
+}
+
+bool MonitorExpression::range(uint16_t &first, uint16_t &last) const
+{
+    bool any = false;
+    for (const auto &ins : code_)
+    {
+        if (ins.op != ExprOp::Load && ins.op != ExprOp::LoadRaw)
+            continue;
+        first = any ? std::min(first, ins.arg) : ins.arg;
+        last = any ? std::max(last, ins.arg) : ins.arg;
+        any = true;
+    }
+    return any;
+}
+
+void MonitorExpression::mark_inputs(uint8_t *marks, uint8_t value) const
+{
+    for (const auto &ins : code_)
+    {
+        if (ins.op == ExprOp::Load || ins.op == ExprOp::LoadRaw)
+            marks[ins.arg] = value;
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef MONITOR_EXPR_HPP
+#define MONITOR_EXPR_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ExprOp
+{
+    enum op_t : uint8_t
+    {
+        Const = 0,   // push value
+        Load,        // push input register `arg` in engineering units
+        LoadRaw,     // push input register `arg` as read
+        LoadHolding, // push holding register `arg` in engineering units
+        Add,
+        Sub,
+        Mul,
+        Div,
+        Neg,
+        Min,
+        Max,
+        Abs,
+        Rate,        // per second change of the top since the last sample, state slot `arg`, counter wraps at `value`
+        Ewma,        // moving average of the top with time constant `value` [s], state slot `arg`
+    };
+}
+
+struct ExprInstruction
+{
+    uint8_t op;   // ExprOp::op_t
+    uint16_t arg; // register or state slot
+    double value; // constant, counter modulus or time constant
+};
+
+// Derived monitor channel, e.g. "t5 - t3" or "rate(rx_err_count) / rate(tx_count)".
+// Register aliases (any case, input registers first, then settings), numbers,
+// + - * / and parentheses, abs(x), min(a, b, ...), max(a, b, ...),
+// raw(register), rate(x) and ewma(x, seconds).
+// Compiled once into stack code, evaluating it does not allocate.
+class MonitorExpression
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // -1 on a syntax error, `error` tells what and where
+    int compile(std::string_view text, std::string &error);
+
+    // Value for one sample of the registers, NaN until rate() has two samples
+    double evaluate(const uint16_t *input, const uint16_t *holding, Clock::time_point now = Clock::now());
+
+    // Range of input registers the expression reads, false when it reads none.
+    // Settings are taken as they are in the model.
+    bool range(uint16_t &first, uint16_t &last) const;
+    // marks[reg] = value for each input register the expression reads
+    void mark_inputs(uint8_t *marks, uint8_t value) const;
+    const std::string &text(void) const { return text_; }
+
+private:
+    std::string text_;
+    std::vector<ExprInstruction> code_;
+    std::vector<double> stack_; // sized by compile()
+    std::vector<double> state_; // rate() and ewma() history
+    Clock::time_point last_{};
+};
+
+#endif // MONITOR_EXPR_HPP
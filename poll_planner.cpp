@@ -0,0 +1,99 @@
+#include <cstdlib>
+
+#include "poll_planner.hpp"
+
+PollPlanner g_poll_planner;
+
+PollPlanner::PollPlanner()
+{
+    for (uint16_t reg = 0; reg < e_input_last_item; reg++)
+        class_[reg] = static_cast<uint8_t>(default_poll_class(input_register(reg)));
+}
+
+void PollPlanner::plan(uint64_t tick, const uint8_t *wanted, uint16_t max_length, std::vector<PollRange> &batches)
+{
+    std::unique_lock lk(mutex_);
+    batches.clear();
+
+    int first_wanted = -1, last_wanted = -1;
+    for (uint16_t reg = 0; reg < e_input_last_item; reg++)
+    {
+        if (wanted[reg] == PollWant::No)
+            continue;
+        if (first_wanted == -1)
+            first_wanted = reg;
+        last_wanted = reg;
+
+        if (wanted[reg] != PollWant::Always && tick % POLL_DIVIDERS[class_[reg]] != 0)
+            continue;
+
+        if (!batches.empty() && reg - batches.back().last <= MAX_GAP + 1 && reg - batches.back().first < max_length)
+            batches.back().last = reg;
+        else
+            batches.push_back({reg, reg});
+    }
+
+    if (first_wanted == -1)
+        return;
+    for (const auto &batch : batches)
+        registers_ += batch.last - batch.first + 1;
+    requests_ += batches.size();
+    uint32_t span = last_wanted - first_wanted + 1;
+    flat_registers_ += span;
+    flat_requests_ += (span + max_length - 1) / max_length;
+}
+
+void PollPlanner::observe(const uint16_t *input, uint16_t from, uint16_t to)
+{
+    std::unique_lock lk(mutex_);
+    for (uint16_t reg = from; reg <= to && reg < e_input_last_item; reg++)
+    {
+        bool moved = seen_[reg] && std::abs(input_register(reg).to_int(input[reg]) - input_register(reg).to_int(last_[reg])) >= MOVE_STEPS;
+        seen_[reg] = true;
+        last_[reg] = input[reg];
+        if (pinned_[reg])
+            continue;
+
+        if (moved)
+        {
+            quiet_[reg] = 0;
+            if (class_[reg] > PollClass::Fast)
+                class_[reg]--;
+        }
+        else if (++quiet_[reg] >= QUIET_READS)
+        {
+            quiet_[reg] = 0;
+            if (class_[reg] < PollClass::Slow)
+                class_[reg]++;
+        }
+    }
+}
+
+void PollPlanner::pin(uint16_t reg, int poll_class)
+{
+    std::unique_lock lk(mutex_);
+    pinned_[reg] = poll_class != -1;
+    class_[reg] = static_cast<uint8_t>(poll_class != -1 ? poll_class : default_poll_class(input_register(reg)));
+    quiet_[reg] = 0;
+}
+
+int PollPlanner::poll_class(uint16_t reg) const
+{
+    std::unique_lock lk(mutex_);
+    return class_[reg];
+}
+
+bool PollPlanner::pinned(uint16_t reg) const
+{
+    std::unique_lock lk(mutex_);
+    return pinned_[reg];
+}
+
+void PollPlanner::load(uint64_t &registers, uint64_t &requests, uint64_t &flat_registers, uint64_t &flat_requests) const
+{
+    std::unique_lock lk(mutex_);
+    registers = registers_;
+    requests = requests_;
+    flat_registers = flat_registers_;
+    flat_requests = flat_requests_;
+}
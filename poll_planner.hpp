@@ -0,0 +1,99 @@
+#ifndef POLL_PLANNER_HPP
+#define POLL_PLANNER_HPP
+
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include "modbus_registers.h"
+#include "register_table.hpp"
+
+namespace PollClass
+{
+    enum class_t
+    {
+        Fast = 0, // every monitor tick
+        Medium,   // every 4th tick
+        Slow,     // every 16th tick
+        Count,
+    };
+}
+
+inline constexpr uint32_t POLL_DIVIDERS[PollClass::Count] = {1, 4, 16};
+inline constexpr const char *POLL_CLASSES[] = {"fast", "medium", "slow", nullptr};
+
+// Starting class of an input register from its descriptor: machine quantities
+// move quickly, temperatures and states slowly, countdowns are extrapolated
+constexpr int default_poll_class(const RegisterDescriptor &desc)
+{
+    if (desc.flags & RegFlag::Countdown)
+        return PollClass::Slow;
+    std::string_view unit = desc.unit;
+    if (unit == "Hz" || unit == "RPM" || unit == "W" || unit == "mA")
+        return PollClass::Fast;
+    return PollClass::Medium;
+}
+
+namespace PollWant
+{
+    enum want_t : uint8_t
+    {
+        No = 0,
+        ByClass, // when its class is due
+        Always,  // every tick, e.g. read by a derived channel
+    };
+}
+
+struct PollRange
+{
+    uint16_t first;
+    uint16_t last;
+};
+
+// Decides which monitored input registers to read on each monitor tick. Every
+// register has a rate class; one that moved by MOVE_STEPS since its last read
+// goes one class faster, one that stayed put for QUIET_READS reads one class
+// slower. Pinned registers keep their class. The registers due on a tick are
+// merged into as few requests as possible, reading up to MAX_GAP registers in
+// between rather than starting another request.
+class PollPlanner
+{
+public:
+    static constexpr int QUIET_READS = 8;
+    static constexpr int MOVE_STEPS = 2;   // raw units
+    static constexpr uint16_t MAX_GAP = 6; // a request costs about as much as this many registers
+
+    PollPlanner();
+
+    // Requests for `tick`, `wanted` has a PollWant::want_t for every input register
+    void plan(uint64_t tick, const uint8_t *wanted, uint16_t max_length, std::vector<PollRange> &batches);
+
+    // After input registers [from, to] were read for a planned request
+    void observe(const uint16_t *input, uint16_t from, uint16_t to);
+
+    // PollClass::class_t, -1 lets the register adapt again from its default
+    void pin(uint16_t reg, int poll_class);
+    int poll_class(uint16_t reg) const;
+    bool pinned(uint16_t reg) const;
+
+    // Registers and requests read so far, and what one request over the whole
+    // monitored range on every tick would have cost
+    void load(uint64_t &registers, uint64_t &requests, uint64_t &flat_registers, uint64_t &flat_requests) const;
+
+private:
+    mutable std::mutex mutex_;
+    uint8_t class_[e_input_last_item];
+    bool pinned_[e_input_last_item]{};
+    uint8_t quiet_[e_input_last_item]{};
+    bool seen_[e_input_last_item]{};
+    uint16_t last_[e_input_last_item]{};
+    uint64_t registers_{0};
+    uint64_t requests_{0};
+    uint64_t flat_registers_{0};
+    uint64_t flat_requests_{0};
+};
+
+extern PollPlanner g_poll_planner;
+
+#endif // POLL_PLANNER_HPP
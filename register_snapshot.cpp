@@ -0,0 +1,94 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "register_snapshot.hpp"
+
+static_assert(e_input_last_item <= SHM_MAX_REGISTERS && e_holding_last_item <= SHM_MAX_REGISTERS);
+
+SnapshotStore g_snapshot;
+
+uint64_t realtime_ns(void)
+{
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+void SnapshotStore::publish_input(const uint16_t *registers)
+{
+    std::unique_lock lk(mutex_);
+    memcpy(snapshot_.input, registers, sizeof(snapshot_.input));
+    snapshot_.input_stamp_ns = realtime_ns();
+    snapshot_.sequence++;
+    mirror();
+}
+
+void SnapshotStore::publish_holding(const uint16_t *registers)
+{
+    std::unique_lock lk(mutex_);
+    memcpy(snapshot_.holding, registers, sizeof(snapshot_.holding));
+    snapshot_.holding_stamp_ns = realtime_ns();
+    snapshot_.sequence++;
+    mirror();
+}
+
+void SnapshotStore::read(RegisterSnapshot &out) const
+{
+    std::unique_lock lk(mutex_);
+    out = snapshot_;
+}
+
+int SnapshotStore::enable_shm(const char *name)
+{
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (fd < 0 || ftruncate(fd, sizeof(ShmSnapshotSegment)) == -1)
+    {
+        fprintf(stderr, "Unable to create shared memory \"%s\": %s\n", name, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    void *addr = mmap(nullptr, sizeof(ShmSnapshotSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        fprintf(stderr, "Unable to map shared memory \"%s\": %s\n", name, strerror(errno));
+        return -1;
+    }
+
+    std::unique_lock lk(mutex_);
+    segment_ = static_cast<ShmSnapshotSegment *>(addr);
+    segment_->version = SHM_SNAPSHOT_VERSION;
+    segment_->data.input_count = e_input_last_item;
+    segment_->data.holding_count = e_holding_last_item;
+    mirror();
+    segment_->magic = SHM_SNAPSHOT_MAGIC;
+    return 0;
+}
+
+// Seqlock writer side, called with mutex_ held so there is only one writer
+void SnapshotStore::mirror(void)
+{
+    if (!segment_)
+        return;
+
+    uint32_t seq = segment_->seqlock.load(std::memory_order_relaxed);
+    segment_->seqlock.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    ShmSnapshot &data = segment_->data;
+    memcpy(data.input, snapshot_.input, sizeof(snapshot_.input));
+    memcpy(data.holding, snapshot_.holding, sizeof(snapshot_.holding));
+    data.input_stamp_ns = snapshot_.input_stamp_ns;
+    data.holding_stamp_ns = snapshot_.holding_stamp_ns;
+    data.sequence = snapshot_.sequence;
+
+    segment_->seqlock.store(seq + 2, std::memory_order_release);
+}
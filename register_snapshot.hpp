@@ -0,0 +1,43 @@
+#ifndef REGISTER_SNAPSHOT_HPP
+#define REGISTER_SNAPSHOT_HPP
+
+#include <cstdint>
+#include <mutex>
+
+#include "modbus_registers.h"
+#include "shm_snapshot.hpp"
+
+struct RegisterSnapshot
+{
+    uint16_t input[e_input_last_item];
+    uint16_t holding[e_holding_last_item];
+    uint64_t input_stamp_ns;   // CLOCK_REALTIME of the last complete input block read, 0 - never
+    uint64_t holding_stamp_ns; // same for the holding block
+    uint64_t sequence;         // incremented on every publish
+};
+
+// Last complete register blocks read from the device. Consumers (metrics,
+// exporters) read from here and never touch the bus themselves.
+class SnapshotStore
+{
+public:
+    void publish_input(const uint16_t *registers);
+    void publish_holding(const uint16_t *registers);
+    void read(RegisterSnapshot &out) const;
+
+    // Mirrors every publish into a POSIX shared memory segment (see shm_snapshot.hpp)
+    int enable_shm(const char *name);
+
+private:
+    void mirror(void);
+
+    mutable std::mutex mutex_;
+    RegisterSnapshot snapshot_{};
+    ShmSnapshotSegment *segment_{nullptr};
+};
+
+extern SnapshotStore g_snapshot;
+
+uint64_t realtime_ns(void);
+
+#endif // REGISTER_SNAPSHOT_HPP
@@ -0,0 +1,339 @@
+#ifndef REGISTER_TABLE_HPP
+#define REGISTER_TABLE_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "modbus_registers.h"
+#include "struct.h"
+#include "args.hpp"
+
+namespace Access
+{
+    enum access_t
+    {
+        ReadOnly = 0, // input registers
+        ReadWrite,    // settings
+        WriteOnly,    // triggers, reading them back means nothing
+    };
+}
+
+namespace RegFlag
+{
+    enum flag_t
+    {
+        None = 0,
+        Volatile = 1,  // changed by the unit itself, never worth caching or restoring
+        Command = 2,   // writing it makes the unit do something
+        Countdown = 4, // seconds counted down by the unit, extrapolated between polls
+    };
+}
+
+namespace Limit
+{
+    enum limit_t
+    {
+        Ok = 0,
+        Clamped,  // moved onto the nearest limit
+        Rejected, // out of range and clamping not allowed
+    };
+}
+
+// Everything known about one register. Values are stored raw, i.e. in register
+// units: engineering value = raw / scale, interpreted as int16_t when is_signed.
+struct RegisterDescriptor
+{
+    uint16_t reg;        // own index, checked at compile time
+    const char *name;    // description for listings
+    const char *alias;   // short name for the CLI and config files
+    const char *unit;    // engineering unit, empty when there is none
+    uint16_t scale;      // 1, 10 (0.1 resolution) or 100
+    bool is_signed;
+    int32_t min;         // raw limits accepted by the unit
+    int32_t max;
+    uint8_t flags;       // RegFlag::flag_t
+    uint8_t access;      // Access::access_t
+
+    constexpr int precision(void) const { return scale >= 100 ? 2 : scale >= 10 ? 1 : 0; }
+    constexpr int32_t to_int(uint16_t raw) const { return is_signed ? static_cast<int16_t>(raw) : raw; }
+    constexpr double to_engineering(uint16_t raw) const { return static_cast<double>(to_int(raw)) / scale; }
+    // How setter commands parse a value for this register
+    constexpr ArgSpec arg_spec(void) const { return {alias, scale == 1 ? Arg::Int : Arg::Float, min, max, scale}; }
+
+    // Limit::limit_t of a raw value about to be written, `raw` is updated when clamped
+    constexpr int check(uint16_t &raw, bool clamp) const
+    {
+        int32_t value = to_int(raw);
+        if (value >= min && value <= max)
+            return Limit::Ok;
+        if (!clamp)
+            return Limit::Rejected;
+        raw = static_cast<uint16_t>(value < min ? min : max);
+        return Limit::Clamped;
+    }
+};
+
+namespace detail
+{
+    constexpr RegisterDescriptor input(uint16_t reg, const char *name, const char *alias, const char *unit = "", uint16_t scale = 1, bool is_signed = false)
+    {
+        return {reg, name, alias, unit, scale, is_signed, is_signed ? INT16_MIN : 0, is_signed ? INT16_MAX : UINT16_MAX, RegFlag::Volatile, Access::ReadOnly};
+    }
+
+    constexpr RegisterDescriptor countdown(uint16_t reg, const char *name, const char *alias)
+    {
+        return {reg, name, alias, "s", 1, false, 0, UINT16_MAX, RegFlag::Volatile | RegFlag::Countdown, Access::ReadOnly};
+    }
+
+    constexpr RegisterDescriptor holding(uint16_t reg, const char *name, const char *alias, const char *unit, uint16_t scale, bool is_signed, int32_t min, int32_t max,
+                                         uint8_t flags = RegFlag::None, uint8_t access = Access::ReadWrite)
+    {
+        return {reg, name, alias, unit, scale, is_signed, min, max, flags, access};
+    }
+
+    // Full range of an unsigned register without known limits
+    constexpr int32_t U16 = UINT16_MAX;
+}
+
+// clang-format off
+inline constexpr RegisterDescriptor INPUT_REGISTERS[] = {
+    detail::input(e_tx_count, "Counter vale of sent LNS frames", "tx_count"),
+    detail::input(e_rx_err_count, "Number of incorrectly received LNS frames", "rx_err_count"),
+    detail::input(e_xfer_ok_ratio, "good/bad ratio of LNS rx frames", "xfer_ok_ratio"),
+    detail::input(index_enum, "rcv_index", "rcv_index"),
+    detail::input(eev1_ro, "Expansion valve (B) position", "eev_b"),
+    detail::input(e_operation_mode_ro, "e_operation_mode_ro", "operation_mode"),
+    detail::input(selector_switch, "Power selector switch value", "selector_switch"),
+    detail::input(control_mode_ro, "IDU operation mode", "idu_mode"),
+    detail::input(eev_ro, "Expansion valve (A) position", "eev_a"),
+    detail::input(e_fan, "ODU Fan speed [RPM]", "fan", "RPM"),
+    detail::input(e_compressor, "ODU Compressor speed [Hz]", "compressor", "Hz"),
+    detail::input(e_pwr, "ODU Active power [W]", "power", "W"),
+    detail::input(e_outdoor_mode, "ODU operation mode", "odu_mode"),
+    detail::input(e_ambient_temp_avg_ro, "Ambient average temperature (T4a) ['C]", "t4_avg", "'C", 10, true),
+    detail::input(e_discharge_temp, "ODU Discharge temperature (T5) ['C]", "t5", "'C", 10, true),
+    detail::input(e_condenser_temp, "ODU exchanger temperature (T3) ['C]", "t3", "'C", 10, true),
+    detail::input(e_ambient_temp, "ODU ambient temperature (T4) ['C]", "t4", "'C", 10, true),
+    detail::input(e_indoor_temp, "IDU supply temperature (T1) ['C]", "t1", "'C", 10, true),
+    detail::input(e_evaporator_temp, "IDU exchanger temperature (T2) ['C]", "t2", "'C", 10, true),
+    detail::input(e_indoor_ro, "e_indoor_ro", "indoor_check"),
+    detail::input(e_water_flow, "IDU water flow pulse frequency [Hz]", "flow_hz", "Hz"),
+    detail::input(e_faults_ro, "IDU Fault status register", "idu_faults"),
+    detail::input(e_fault_byte11, "ODU Fault status register_1", "odu_faults1"),
+    detail::input(e_fault_byte12, "ODU Fault status register_2", "odu_faults2"),
+    detail::input(e_target_frequency, "IDU compressor target frequency [Hz]", "target_frequency", "Hz"),
+    detail::input(e_powerLevel_100, "Target power level (0-100) %", "power_level", "%"),
+    detail::input(e_compressor_min_frequency, "Minimum compressor frequency [Hz]", "compressor_min", "Hz"),
+    detail::input(e_compressor_max_frequency, "Maximum compressor frequency [Hz]", "compressor_max", "Hz"),
+    detail::input(e_water_flow_ltr_per_hour, "Water flow [ltr/hr]", "flow", "ltr/hr"),
+    detail::input(e_temp_setpoint_ro, "Supply temperature setpoint ['C]", "setpoint", "'C", 10, true),
+    detail::input(e_superheat_ro, "Superheat value ['K]", "superheat", "'K", 10, true),
+    detail::input(e_curve_offset_ro, "Equithermal curve offset value", "curve_offset", "'K", 10, true),
+    detail::input(e_ipm_temperature, "IPM module temperature", "ipm_temp", "'C", 1, true),
+    detail::input(e_suction_temperature, "Compressor suction temperature", "suction_temp", "'C", 1, true),
+    detail::input(e_water_in_ro, "Return water temperature ['C]", "water_in", "'C", 10, true),
+    detail::input(e_refrigerant_in, "Vapor Refrigerant temperature ['C]", "refrigerant_in", "'C", 10, true),
+    detail::input(e_refrigerant_out, "Condensed refrigerant temperature ['C]", "refrigerant_out", "'C", 10, true),
+    detail::input(e_COP, "COP", "cop", "", 10, true),
+    detail::input(e_heat_power, "Heating power [W]", "heat_power", "W"),
+    detail::input(e_ac_voltage, "AC Voltage [V]", "ac_voltage", "V"),
+    detail::input(e_ac_current, "AC Current [mA]", "ac_current", "mA"),
+    detail::input(e_dc_bus_voltage, "e_dc_bus_voltage [V]", "dc_voltage", "V"),
+    detail::input(e_settings_saved, "Command executed", "command_done"),
+    detail::input(e_water_delta, "Water temperature delta", "water_delta", "", 1, true),
+    detail::input(e_pid_p_component, "PID_P_component", "pid_p", "", 10, true),
+    detail::input(e_pid_i_component, "PID_I_component", "pid_i", "", 10, true),
+    detail::input(e_pid_d_component, "PID_D_component", "pid_d", "", 10, true),
+    detail::input(e_pid_output, "PID controler output value", "pid_output"),
+    detail::countdown(e_time_to_oil_recovery, "Time till oil recovery mode starts", "oil_recovery_in"),
+    detail::countdown(e_interval_on_off_remaining, "Remaining interval before next start", "start_in"),
+    detail::countdown(e_auto_off_remaining, "Remaining interval till stop", "stop_in"),
+    detail::countdown(e_till_defrost, "Remaining time till defrost", "defrost_in"),
+    detail::input(e_adc0, "ADC channel 0", "adc0"),
+    detail::input(e_adc1, "ADC channel 1", "adc1"),
+    detail::input(e_adc2, "ADC channel 2", "adc2"),
+};
+
+inline constexpr RegisterDescriptor HOLDING_REGISTERS[] = {
+    detail::holding(e_control_mode, "control_mode : 0-local, 1-remote_0-100, 2-temperature", "control_mode", "", 1, false, Control::Local, Control::RemoteTemperature),
+    detail::holding(e_mode, "operation mode : 0-idle, 1-cool_manual, 2-heat_manual, 3-coo_auto, 4-heat_auto", "mode", "", 1, false, Operation::Idle, 4),
+    detail::holding(e_level, "Power level 0-100", "level", "%", 1, false, 0, 100, RegFlag::Volatile),
+    detail::holding(e_delta_offset, "Delta correction for COP calculation ['K]", "delta_offset", "'K", 10, true, INT16_MIN, INT16_MAX),
+    detail::holding(e_temp_setpoint, "Temeprature setpoint ['C]", "temp_setpoint", "'C", 10, false, 0, 500),
+    detail::holding(e_increment, "increment level value by %", "increment", "%", 1, false, 0, 100, RegFlag::Volatile | RegFlag::Command, Access::WriteOnly),
+    detail::holding(e_decrement, "decrement level value by %", "decrement", "%", 1, false, 0, 100, RegFlag::Volatile | RegFlag::Command, Access::WriteOnly),
+    detail::holding(e_odu_fan_override, "ODU fan speed override - byte coded.", "odu_fan_override", "", 1, false, 0, detail::U16),
+    detail::holding(e_pipe_override, "exchanger temperature override - byte coded.", "pipe_override", "", 1, false, 0, 255),
+    detail::holding(e_pid_sampling_time, "PID controller cycle time [s]", "pid_interval", "s", 1, false, 0, 60),
+    detail::holding(e_pid_hysteresis, "e_pid_hysteresi", "pid_hysteresis", "'K", 10, false, 0, detail::U16),
+    detail::holding(e_off_delay, "Delay before going to OFF/STBY [min]", "off_delay", "min", 1, false, 5, 20),
+    detail::holding(e_override_compressor, "Override compressor speed", "override_compressor", "Hz", 1, false, 0, 80),
+    detail::holding(e_Kp_factor, "PID controller K_p coefficient", "pid_kp", "", 10, false, 0, 500),
+    detail::holding(e_ambient_temp_scope, "Ambient avg scope [hour]", "ambient_scope", "h", 1, false, 1, 24),
+    detail::holding(e_dhw_level, "DHW heating level", "dhw_level", "%", 1, false, 1, 100),
+    detail::holding(e_curve_gain, "gain/slope of equithermal curve", "curve_gain", "", 100, false, 0, 100),
+    detail::holding(e_curve_offset, "equithermal curve offset value (from 20'C)", "curve_offset", "'K", 10, true, -150, 150),
+    detail::holding(e_curve_active, "Constant temperature mode - 0, equithermal mode active - 1. ", "curve_active", "", 1, false, 0, 1),
+    detail::holding(e_low_delta, "low_delta", "low_delta", "'K", 10, false, 1, 50),
+    detail::holding(e_high_delta, "high_delta", "high_delta", "'K", 10, false, 1, 50),
+    detail::holding(e_on_off_interval, "Interval between Off and On [min]", "on_off_interval", "min", 1, false, 10, 240),
+    detail::holding(e_flow_x1, "x1 flow [Hz]", "flow_x1", "Hz", 1, false, 0, detail::U16),
+    detail::holding(e_flow_y1, "y1 flow [ltr/hr]", "flow_y1", "ltr/hr", 1, false, 0, detail::U16),
+    detail::holding(e_flow_x2, "x2 flow [Hz]", "flow_x2", "Hz", 1, false, 0, detail::U16),
+    detail::holding(e_flow_y2, "y2 flow [ltr/hr]", "flow_y2", "ltr/hr", 1, false, 0, detail::U16),
+    detail::holding(e_flow_x3, "x3 flow [Hz]", "flow_x3", "Hz", 1, false, 0, detail::U16),
+    detail::holding(e_flow_y3, "y3 flow [ltr/hr]", "flow_y3", "ltr/hr", 1, false, 0, detail::U16),
+    detail::holding(HOLDING_SPARE_4, "Gree room temperature", "spare4", "", 1, false, 0, detail::U16),
+    detail::holding(HOLDING_SPARE_5, "Gree setpoint", "spare5", "", 1, false, 0, detail::U16),
+    detail::holding(HOLDING_SPARE_6, "Gree IDU fan", "spare6", "", 1, false, 0, detail::U16),
+    detail::holding(e_Ki_factor, "PID controller K_i coefficient", "pid_ki", "", 100, false, 0, 500),
+    detail::holding(e_Kd_factor, "PID controller K_d coefficient", "pid_kd", "", 10, false, 0, 500),
+    detail::holding(e_execute_command, "Execute command", "execute_command", "", 1, false, 0, detail::U16, RegFlag::Volatile | RegFlag::Command, Access::WriteOnly),
+    detail::holding(e_minimal_flow, "Minimal water flow value before alarm [Hz]", "minimal_flow", "Hz", 1, false, 0, 50),
+    detail::holding(e_t2_low_alarm_value, "Exchanger low temperature alarm level", "t2_low_alarm", "'C", 10, true, -300, 100),
+    detail::holding(e_alarm_relay_function, "ALARM relay function (bitmask)", "alarm_relay", "", 1, false, 0, detail::U16),
+    detail::holding(e_defrost_relay_function, "DEFROST relay function (bitmask)", "defrost_relay", "", 1, false, 0, detail::U16),
+    detail::holding(e_heat_input_function, "HEAT input function", "heat_input", "", 1, false, Function::NoFunction, Function::DHW),
+    detail::holding(e_cool_input_function, "COOL input function", "cool_input", "", 1, false, Function::NoFunction, Function::DHW),
+    detail::holding(e_multisplit_power_option, "Multisplit power selector position", "multisplit_power", "", 1, false, 0, 15),
+    detail::holding(e_oil_recovery_low_freq, "Compressor speed [Hz] below which, oil recovery timer runs.", "oil_low_freq", "Hz", 1, false, 0, detail::U16),
+    detail::holding(e_oil_recovery_low_time, "Time until oil recovery mode stars.", "oil_low_time", "min", 1, false, 5, 60),
+    detail::holding(e_oil_recovery_restore_freq, "Compressor speed [Hz] till which oil recovery mode ends.", "oil_restore_freq", "Hz", 1, false, 0, detail::U16),
+    detail::holding(e_dhw_mode, "dhw mode", "dhw_mode", "", 1, false, DHW::FixedLevel, DHW::Legacy),
+    detail::holding(e_dhw_target_temperature, "dhw target temperature", "dhw_temp", "'C", 10, false, 250, 600),
+    detail::holding(e_defrost_max_frequency, "Defrost max. compressor frequency", "defrost_max_freq", "Hz", 1, false, 40, 80),
+    detail::holding(e_defrost_end_t3_target, "Defrost end T3 target ['C]", "defrost_t3_target", "'C", 10, false, 100, 400),
+    detail::holding(e_defrost_max_duration, "Defrost max duration [min]", "defrost_max_duration", "min", 1, false, 1, 15),
+    detail::holding(e_defrost_min_interval, "Defrost minimal interval [min]", "defrost_min_interval", "min", 1, false, 30, 120),
+    detail::holding(e_defrost_max_odu_delta, "Defrost max t4-t3 delta ['K]", "defrost_max_odu_delta", "'K", 10, false, 50, 150),
+    detail::holding(e_defrost_max_t3_drop, "Defrost max t30-t3 drop ['K]", "defrost_max_t3_drop", "'K", 10, false, 10, 50),
+    detail::holding(e_10v_scale, "scaling of 0-10V input [%]", "10v_scale", "%", 1, false, 0, detail::U16),
+    detail::holding(e_preheat_temp, "Preheat temperature treshold ['C]", "preheat_temp", "'C", 10, false, 150, 450),
+    detail::holding(e_precool_temp, "Precool temperature treshold ['C]", "precool_temp", "'C", 10, false, 50, 200),
+    detail::holding(e_pre_hysteresis, "Preheating hysteresis ['K]", "pre_hysteresis", "'K", 10, false, 0, 50),
+    detail::holding(e_relay_polarity, "Polarity/logic of output relays [NO/NC]", "relay_polarity", "", 1, false, 0, detail::U16),
+    detail::holding(e_pwr_override, "Override Electrical Power [W]", "power_override", "W", 1, false, 0, detail::U16),
+    detail::holding(e_bivalent0_temp, "Bivalent0 ambient temperature", "bivalent0_temp", "'C", 10, true, -250, 100),
+    detail::holding(e_bivalent0_hysteresis, "Bivalent0 hysteresis", "bivalent0_hysteresis", "'K", 10, false, 0, 50),
+    detail::holding(e_bivalent1_temp, "Bivalent1 ambient temperature", "bivalent1_temp", "'C", 10, true, -250, 100),
+    detail::holding(e_bivalent1_hysteresis, "Bivalent1 hysteresis", "bivalent1_hysteresis", "'K", 10, false, 0, 50),
+    detail::holding(e_bivalent0_level, "Bivalent0 level", "bivalent0_level", "%", 1, false, 0, 100),
+};
+// clang-format on
+
+namespace detail
+{
+    template <size_t N>
+    constexpr bool indexed_by_enum(const RegisterDescriptor (&table)[N])
+    {
+        for (size_t i = 0; i < N; i++)
+            if (table[i].reg != i)
+                return false;
+        return true;
+    }
+}
+
+static_assert(std::size(INPUT_REGISTERS) == e_input_last_item, "one descriptor per input register");
+static_assert(std::size(HOLDING_REGISTERS) == e_holding_last_item, "one descriptor per holding register");
+static_assert(detail::indexed_by_enum(INPUT_REGISTERS), "input descriptors out of order");
+static_assert(detail::indexed_by_enum(HOLDING_REGISTERS), "holding descriptors out of order");
+
+// Alias -> register index without string compares beyond the final check. The
+// seed is searched at compile time until every alias lands in its own slot.
+namespace detail
+{
+    constexpr size_t NAME_SLOTS = 1024;
+    constexpr uint8_t NO_SLOT = 0xFF;
+    constexpr uint32_t MAX_SEEDS = 1 << 16;
+
+    constexpr uint32_t name_hash(std::string_view name, uint32_t seed)
+    {
+        uint32_t hash = 2166136261u ^ seed; // FNV-1a
+        for (char c : name)
+        {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 16777619u;
+        }
+        return hash ^ (hash >> 16);
+    }
+
+    struct NameIndex
+    {
+        uint32_t seed{MAX_SEEDS};
+        std::array<uint8_t, NAME_SLOTS> slots{};
+    };
+
+    template <size_t N>
+    constexpr NameIndex build_name_index(const RegisterDescriptor (&table)[N])
+    {
+        static_assert(N < NO_SLOT);
+        NameIndex index;
+        for (uint32_t seed = 0; seed < MAX_SEEDS; seed++)
+        {
+            index.slots.fill(NO_SLOT);
+            bool collision = false;
+            for (size_t i = 0; i < N && !collision; i++)
+            {
+                auto &slot = index.slots[name_hash(table[i].alias, seed) % NAME_SLOTS];
+                collision = slot != NO_SLOT;
+                slot = static_cast<uint8_t>(i);
+            }
+            if (!collision)
+            {
+                index.seed = seed;
+                return index;
+            }
+        }
+        return index;
+    }
+
+    inline constexpr NameIndex INPUT_NAMES = build_name_index(INPUT_REGISTERS);
+    inline constexpr NameIndex HOLDING_NAMES = build_name_index(HOLDING_REGISTERS);
+    static_assert(INPUT_NAMES.seed < MAX_SEEDS, "input register aliases must be unique");
+    static_assert(HOLDING_NAMES.seed < MAX_SEEDS, "holding register aliases must be unique");
+
+    template <size_t N>
+    constexpr int find(const NameIndex &index, const RegisterDescriptor (&table)[N], std::string_view alias)
+    {
+        uint8_t i = index.slots[name_hash(alias, index.seed) % NAME_SLOTS];
+        return i != NO_SLOT && alias == table[i].alias ? i : -1;
+    }
+}
+
+// Register index of `alias`, -1 when there is no such register
+constexpr int find_input_register(std::string_view alias)
+{
+    return detail::find(detail::INPUT_NAMES, INPUT_REGISTERS, alias);
+}
+
+constexpr int find_holding_register(std::string_view alias)
+{
+    return detail::find(detail::HOLDING_NAMES, HOLDING_REGISTERS, alias);
+}
+
+static_assert(find_holding_register("temp_setpoint") == e_temp_setpoint);
+static_assert(find_input_register("t4") == e_ambient_temp);
+static_assert(find_input_register("nonexistent") == -1);
+
+// Descriptors by index, callers check the range
+inline const RegisterDescriptor &input_register(uint16_t reg)
+{
+    return INPUT_REGISTERS[reg];
+}
+
+inline const RegisterDescriptor &holding_register(uint16_t reg)
+{
+    return HOLDING_REGISTERS[reg];
+}
+
+// Clamp out-of-range writes onto the limits instead of refusing them (--clamp)
+extern bool g_clamp_writes;
+
+// Checks a block of holding register values before it is written to the unit,
+// out-of-range values are reported and clamped in place when g_clamp_writes is
+// set. Returns -1 when anything is refused, then nothing may be sent.
+int validate_holding_write(uint16_t addr, uint16_t *values, uint16_t count);
+
+#endif // REGISTER_TABLE_HPP
@@ -0,0 +1,229 @@
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+
+#if !defined PICO_ON_DEVICE
+#include <unistd.h>
+#endif
+
+#include "report.hpp"
+
+static constexpr size_t LABEL_WIDTH = 42;
+static constexpr size_t VALUE_WIDTH = 6;
+
+int g_output_mode{Output::Text};
+
+// Shared by nested reports, the buffer keeps its capacity between commands
+thread_local static std::string buffer;
+thread_local static int depth{0};
+thread_local static bool json{false};
+thread_local static bool first_field{true};
+
+Report::Report()
+{
+    if (depth++ > 0)
+        return;
+
+    buffer.clear();
+    json = g_output_mode == Output::Json;
+    first_field = true;
+    if (json)
+        buffer += '{';
+}
+
+Report::~Report()
+{
+    if (--depth > 0)
+        return;
+
+    if (json)
+        buffer += "}\n";
+    flush();
+}
+
+void Report::heading(std::string_view text)
+{
+    if (json)
+        return;
+    buffer += text;
+    buffer += '\n';
+}
+
+void Report::message(std::string_view key, std::string_view text)
+{
+    if (!json)
+    {
+        heading(text);
+        return;
+    }
+    begin_field(key, {});
+    buffer += '"';
+    append_escaped(text);
+    buffer += '"';
+}
+
+void Report::text(std::string_view key, std::string_view label, std::string_view value)
+{
+    begin_field(key, label);
+    if (json)
+    {
+        buffer += '"';
+        append_escaped(value);
+        buffer += '"';
+    }
+    else
+    {
+        buffer += value;
+    }
+    end_field({});
+}
+
+void Report::flag(std::string_view key, std::string_view label, bool value)
+{
+    begin_field(key, label);
+    if (json)
+        buffer += value ? "true" : "false";
+    else
+        buffer += value ? "yes" : "no";
+    end_field({});
+}
+
+void Report::integer(std::string_view key, std::string_view label, long value, std::string_view unit)
+{
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    size_t length = result.ptr - digits;
+
+    begin_field(key, label);
+    append_value(digits, length);
+    end_field(unit);
+}
+
+void Report::number(std::string_view key, std::string_view label, double value, int precision, std::string_view unit)
+{
+    char digits[32];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::fixed, precision);
+    size_t length = result.ec == std::errc() ? result.ptr - digits : 0;
+
+    begin_field(key, label);
+    append_value(digits, length);
+    end_field(unit);
+}
+
+void Report::indexed(std::string_view kind, size_t index, std::string_view name, long value)
+{
+    char number[24];
+    auto result = std::to_chars(number, number + sizeof(number), index);
+    std::string_view index_str(number, result.ptr - number);
+
+    char digits[24];
+    result = std::to_chars(digits, digits + sizeof(digits), value);
+    size_t length = result.ptr - digits;
+
+    size_t start = buffer.size();
+    if (json)
+    {
+        if (!first_field)
+            buffer += ',';
+        first_field = false;
+        buffer += '"';
+        append_escaped(kind);
+        buffer += '_';
+        buffer += index_str;
+        buffer += "\":";
+    }
+    else
+    {
+        buffer += "register[";
+        buffer += index_str;
+        buffer += "] (";
+        buffer += name;
+        buffer += ')';
+        size_t label = buffer.size() - start;
+        buffer.append(label < LABEL_WIDTH ? LABEL_WIDTH - label : 1, ' ');
+    }
+    append_value(digits, length);
+    end_field({});
+}
+
+void Report::append_value(const char *digits, size_t length)
+{
+    if (!json && length < VALUE_WIDTH)
+        buffer.append(VALUE_WIDTH - length, ' ');
+    buffer.append(digits, length);
+}
+
+void Report::begin_field(std::string_view key, std::string_view label)
+{
+    if (json)
+    {
+        if (!first_field)
+            buffer += ',';
+        first_field = false;
+        buffer += '"';
+        append_escaped(key);
+        buffer += "\":";
+        return;
+    }
+
+    buffer += label;
+    buffer.append(label.size() < LABEL_WIDTH ? LABEL_WIDTH - label.size() : 1, ' ');
+}
+
+void Report::end_field(std::string_view unit)
+{
+    if (json)
+        return;
+
+    if (!unit.empty())
+    {
+        buffer += " [";
+        buffer += unit;
+        buffer += ']';
+    }
+    buffer += '\n';
+}
+
+void Report::append_escaped(std::string_view str)
+{
+    static constexpr char hex[] = "0123456789abcdef";
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\')
+        {
+            buffer += '\\';
+            buffer += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            buffer += "\\u00";
+            buffer += hex[(c >> 4) & 0xf];
+            buffer += hex[c & 0xf];
+        }
+        else
+        {
+            buffer += c;
+        }
+    }
+}
+
+// One write for the whole command, whatever printf left in stdio goes first
+void Report::flush(void)
+{
+    fflush(stdout);
+#if defined PICO_ON_DEVICE
+    fwrite(buffer.data(), 1, buffer.size(), stdout);
+    fflush(stdout);
+#else
+    size_t written = 0;
+    while (written < buffer.size())
+    {
+        ssize_t n = ::write(STDOUT_FILENO, buffer.data() + written, buffer.size() - written);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        written += n;
+    }
+#endif
+}
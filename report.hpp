@@ -0,0 +1,53 @@
+#ifndef REPORT_HPP
+#define REPORT_HPP
+
+#include <string>
+#include <string_view>
+
+namespace Output
+{
+    enum output_t
+    {
+        Text = 0, // aligned columns for humans
+        Json,     // one JSON object per command, for scripts
+    };
+}
+
+extern int g_output_mode;
+
+// Output of one show command, rendered into a reusable buffer and emitted with a
+// single write. Show functions calling each other append to the same report,
+// the outermost one writes it when it goes out of scope:
+//     Report report;
+//     report.number("pid_kp", "PID K_p", holdingRegisters[e_Kp_factor] / 10.0, 1);
+// `key` names the value in JSON, `label` (and `unit`) describe it in text mode.
+class Report
+{
+public:
+    Report();
+    ~Report();
+
+    Report(const Report &) = delete;
+    Report &operator=(const Report &) = delete;
+
+    // Line printed as is in text mode, nothing in JSON
+    void heading(std::string_view text);
+    // Sentence in text mode, "key": "text" in JSON
+    void message(std::string_view key, std::string_view text);
+
+    void text(std::string_view key, std::string_view label, std::string_view value);
+    void flag(std::string_view key, std::string_view label, bool value);
+    void integer(std::string_view key, std::string_view label, long value, std::string_view unit = {});
+    void number(std::string_view key, std::string_view label, double value, int precision, std::string_view unit = {});
+    // Register listing, "register[N] (name)" in text, "<kind>_N" in JSON
+    void indexed(std::string_view kind, size_t index, std::string_view name, long value);
+
+private:
+    void begin_field(std::string_view key, std::string_view label);
+    void append_value(const char *digits, size_t length);
+    void end_field(std::string_view unit);
+    void append_escaped(std::string_view str);
+    void flush(void);
+};
+
+#endif // REPORT_HPP
@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "scheduler.hpp"
+
+// Fire-and-forget wrapper owning a spawned task, destroys itself when done
+struct Scheduler::Detached
+{
+    struct promise_type
+    {
+        Detached get_return_object(void) { return {std::coroutine_handle<promise_type>::from_promise(*this)}; }
+        std::suspend_always initial_suspend(void) noexcept { return {}; }
+        std::suspend_never final_suspend(void) noexcept { return {}; }
+        void return_void(void) {}
+        void unhandled_exception(void) { std::terminate(); }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+Scheduler::Detached Scheduler::detach(Scheduler &sched, Task<> task)
+{
+    co_await task;
+    sched.active_--;
+}
+
+void Scheduler::spawn(Task<> task)
+{
+    active_++;
+    post(detach(*this, std::move(task)).handle);
+}
+
+Scheduler::~Scheduler()
+{
+    if (timer_fd_ >= 0)
+        close(timer_fd_);
+}
+
+// steady_clock is CLOCK_MONOTONIC, its time points can be armed as they are
+static itimerspec absolute_deadline(Scheduler::Clock::time_point deadline)
+{
+    itimerspec spec{};
+    if (deadline == Scheduler::Clock::time_point::max())
+        return spec; // disarmed
+
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+    spec.it_value.tv_sec = ns / 1000000000;
+    spec.it_value.tv_nsec = ns % 1000000000;
+    if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+        spec.it_value.tv_nsec = 1; // zero would disarm it
+    return spec;
+}
+
+void Scheduler::run(void)
+{
+    stop_ = false;
+    std::vector<pollfd> pfds;
+    if (timer_fd_ < 0)
+        timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    while (!stop_ && active_ > 0)
+    {
+        while (!ready_.empty() && !stop_)
+        {
+            auto h = ready_.front();
+            ready_.pop_front();
+            h.resume();
+        }
+        if (stop_ || active_ == 0)
+            break;
+
+        if (timers_.empty() && fd_waits_.empty())
+            break; // nothing could ever wake the remaining tasks
+
+        auto now = Clock::now();
+        auto wake = Clock::time_point::max();
+        if (!timers_.empty())
+            wake = timers_.begin()->first;
+        for (const auto &wait : fd_waits_)
+            wake = std::min(wake, wait.deadline);
+
+        // the timerfd goes first (poll() skips it when there is none), fd_waits_[i] is pfds[i + 1]
+        int timeout_ms = -1;
+        pfds.clear();
+        pfds.push_back({timer_fd_, POLLIN, 0});
+        if (timer_fd_ >= 0)
+        {
+            itimerspec spec = absolute_deadline(wake);
+            timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+        }
+        else if (wake != Clock::time_point::max())
+        {
+            auto ms = std::chrono::ceil<std::chrono::milliseconds>(wake - now).count();
+            timeout_ms = static_cast<int>(std::clamp<decltype(ms)>(ms, 0, 60 * 1000));
+        }
+        for (const auto &wait : fd_waits_)
+            pfds.push_back({wait.fd, POLLIN, 0});
+
+        if (poll(pfds.data(), pfds.size(), timeout_ms) < 0 && errno != EINTR)
+            break;
+
+        if (pfds[0].revents)
+        {
+            uint64_t expirations; // only clears the readiness, timers_ tells what is due
+            if (read(timer_fd_, &expirations, sizeof(expirations)) < 0)
+                expirations = 0;
+        }
+
+        now = Clock::now();
+        for (size_t i = fd_waits_.size(); i-- > 0;)
+        {
+            bool readable = pfds[i + 1].revents != 0;
+            if (readable || fd_waits_[i].deadline <= now)
+            {
+                *fd_waits_[i].readable = readable;
+                post(fd_waits_[i].handle);
+                fd_waits_.erase(fd_waits_.begin() + i);
+            }
+        }
+
+        while (!timers_.empty() && timers_.begin()->first <= now)
+        {
+            post(timers_.begin()->second);
+            timers_.erase(timers_.begin());
+        }
+    }
+}
+
+Notifier::Notifier()
+    : fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+}
+
+Notifier::~Notifier()
+{
+    if (fd_ >= 0)
+        close(fd_);
+}
+
+void Notifier::notify(void)
+{
+    uint64_t one = 1;
+    if (write(fd_, &one, sizeof(one)) < 0)
+        return; // counter saturated, the waiter wakes anyway
+}
+
+void Notifier::drain(void)
+{
+    uint64_t count;
+    if (read(fd_, &count, sizeof(count)) < 0)
+        return; // nothing was pending
+}
+
+void PeriodicStats::record(Scheduler::Clock::duration late)
+{
+    uint64_t ns = std::max<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(late).count(), 0);
+    uint64_t us = ns / 1000;
+    size_t bucket = us < 16 ? 0 : std::min<size_t>(std::bit_width(us) - 4, JITTER_BUCKETS - 1);
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    ticks.fetch_add(1, std::memory_order_relaxed);
+    if (ns > max_late_ns.load(std::memory_order_relaxed))
+        max_late_ns.store(ns, std::memory_order_relaxed); // single writer
+}
+
+PeriodicTimer::PeriodicTimer(Scheduler &sched, Scheduler::Clock::duration period, PeriodicStats *stats)
+    : sched_(sched), period_(period), next_(Scheduler::Clock::now()), stats_(stats)
+{
+    if (stats_)
+        stats_->period_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(period).count();
+}
+
+PeriodicTimer::TickAwaiter PeriodicTimer::tick(void)
+{
+    next_ += period_;
+    auto now = Scheduler::Clock::now();
+    if (next_ < now)
+    {
+        auto skipped = (now - next_) / period_ + 1;
+        next_ += skipped * period_;
+        if (stats_)
+            stats_->missed.fetch_add(skipped, std::memory_order_relaxed);
+    }
+    return {sched_.sleep_until(next_), *this};
+}
+
+void PeriodicTimer::woke(void)
+{
+    if (stats_)
+        stats_->record(Scheduler::Clock::now() - next_);
+}
@@ -0,0 +1,220 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <map>
+#include <utility>
+#include <vector>
+
+template <typename T>
+struct TaskResult
+{
+    T value{};
+    void return_value(T v) { value = std::move(v); }
+    T result(void) { return std::move(value); }
+};
+
+template <>
+struct TaskResult<void>
+{
+    void return_void(void) {}
+    void result(void) {}
+};
+
+// Lazily started coroutine. It runs when awaited (or spawned on a Scheduler)
+// and resumes its awaiter when finished.
+template <typename T = void>
+class Task
+{
+public:
+    struct promise_type : TaskResult<T>
+    {
+        std::coroutine_handle<> continuation;
+
+        Task get_return_object(void) { return Task{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+        std::suspend_always initial_suspend(void) noexcept { return {}; }
+
+        struct FinalAwaiter
+        {
+            bool await_ready(void) noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept
+            {
+                auto continuation = h.promise().continuation;
+                return continuation ? continuation : std::noop_coroutine();
+            }
+            void await_resume(void) noexcept {}
+        };
+
+        FinalAwaiter final_suspend(void) noexcept { return {}; }
+        void unhandled_exception(void) { std::terminate(); }
+    };
+
+    Task(Task &&other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    ~Task()
+    {
+        if (handle_)
+            handle_.destroy();
+    }
+
+    bool await_ready(void) const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept
+    {
+        handle_.promise().continuation = awaiter;
+        return handle_;
+    }
+    T await_resume(void) { return handle_.promise().result(); }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> h) : handle_(h) {}
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+// Single threaded event loop driving coroutines. Tasks suspend on timers or
+// on socket readiness, so thousands of concurrent operations share one thread.
+// Timers are absolute deadlines armed on a timerfd, so wake-ups are not rounded
+// to milliseconds, and with no timer pending the loop sleeps until an fd wakes it.
+// Cancellation is cooperative: stop() makes run() return and long running
+// tasks are expected to check stopping() between iterations.
+class Scheduler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct SleepAwaiter
+    {
+        Scheduler &sched;
+        Clock::time_point deadline;
+
+        bool await_ready(void) const noexcept { return deadline <= Clock::now(); }
+        void await_suspend(std::coroutine_handle<> h) { sched.timers_.emplace(deadline, h); }
+        void await_resume(void) const noexcept {}
+    };
+
+    // Resumes with true when fd becomes readable, false on deadline or stop()
+    struct ReadableAwaiter
+    {
+        Scheduler &sched;
+        int fd;
+        Clock::time_point deadline;
+        bool readable{false};
+
+        bool await_ready(void) const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) { sched.fd_waits_.push_back({fd, deadline, h, &readable}); }
+        bool await_resume(void) const noexcept { return readable; }
+    };
+
+    // Starts a task which is owned by the scheduler from now on
+    void spawn(Task<> task);
+
+    // Queues a suspended coroutine to be resumed by run()
+    void post(std::coroutine_handle<> h) { ready_.push_back(h); }
+
+    SleepAwaiter sleep_until(Clock::time_point deadline) { return {*this, deadline}; }
+    SleepAwaiter sleep_for(Clock::duration duration) { return {*this, Clock::now() + duration}; }
+    ReadableAwaiter readable(int fd, Clock::time_point deadline) { return {*this, fd, deadline}; }
+
+    // Runs until every spawned task finished or stop() was called
+    void run(void);
+    ~Scheduler();
+    void stop(void) { stop_ = true; }
+    bool stopping(void) const { return stop_; }
+
+private:
+    struct FdWait
+    {
+        int fd;
+        Clock::time_point deadline;
+        std::coroutine_handle<> handle;
+        bool *readable;
+    };
+
+    struct Detached;
+    static Detached detach(Scheduler &sched, Task<> task);
+
+    std::deque<std::coroutine_handle<>> ready_;
+    std::multimap<Clock::time_point, std::coroutine_handle<>> timers_;
+    std::vector<FdWait> fd_waits_;
+    size_t active_{0};
+    bool stop_{false};
+    int timer_fd_{-1};
+};
+
+// Wakes a task waiting on a scheduler from another thread (eventfd):
+//     co_await sched.readable(notifier.fd(), Scheduler::Clock::time_point::max());
+//     notifier.drain();
+class Notifier
+{
+public:
+    Notifier();
+    ~Notifier();
+    Notifier(const Notifier &) = delete;
+    Notifier &operator=(const Notifier &) = delete;
+
+    void notify(void);
+    void drain(void);
+    int fd(void) const { return fd_; }
+
+private:
+    int fd_;
+};
+
+inline constexpr size_t JITTER_BUCKETS = 16;
+
+// How late the wake-ups of one periodic task were. Written by the scheduler
+// thread, read from anywhere. Bucket 0 counts wake-ups less than 16 us late,
+// bucket i less than 2^(i + 4) us, the last one everything later.
+struct PeriodicStats
+{
+    const char *name;
+    std::atomic<uint64_t> buckets[JITTER_BUCKETS]{};
+    std::atomic<uint64_t> ticks{0};
+    std::atomic<uint64_t> missed{0}; // deadlines skipped because the task was still busy
+    std::atomic<uint64_t> max_late_ns{0};
+    std::atomic<uint64_t> period_ns{0};
+
+    void record(Scheduler::Clock::duration late);
+};
+
+// Deadlines at start + n * period. The time a task spends between ticks does
+// not shift the next one, and a task which overran skips the deadlines it
+// missed (counted in PeriodicStats::missed) instead of catching up in a burst.
+class PeriodicTimer
+{
+public:
+    PeriodicTimer(Scheduler &sched, Scheduler::Clock::duration period, PeriodicStats *stats = nullptr);
+
+    struct TickAwaiter
+    {
+        Scheduler::SleepAwaiter sleep;
+        PeriodicTimer &timer;
+
+        bool await_ready(void) const noexcept { return sleep.await_ready(); }
+        void await_suspend(std::coroutine_handle<> h) { sleep.await_suspend(h); }
+        void await_resume(void) { timer.woke(); }
+    };
+
+    // Suspends until the next deadline
+    TickAwaiter tick(void);
+    // Starts counting periods from now, e.g. after the task was idle
+    void restart(void) { next_ = Scheduler::Clock::now(); }
+    Scheduler::Clock::time_point deadline(void) const { return next_; }
+
+private:
+    void woke(void);
+
+    Scheduler &sched_;
+    Scheduler::Clock::duration period_;
+    Scheduler::Clock::time_point next_;
+    PeriodicStats *stats_;
+};
+
+#endif // SCHEDULER_HPP
@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "args.hpp"
+#include "frame_capture.hpp"
+#include "register_table.hpp"
+#include "settings_push.hpp"
+#include "transport_stats.hpp"
+
+static constexpr uint16_t MERGE_GAP = 3; // unchanged registers worth rewriting to save a request
+
+modbus_t *new_target_context(const std::string &target, uint8_t unit_id)
+{
+    if (target.empty())
+        return nullptr;
+
+    modbus_t *ctx{nullptr};
+    if (target[0] == '/')
+    {
+        ctx = modbus_new_rtu(target.c_str(), 9600, 'N', 8, 1);
+    }
+    else
+    {
+        std::string host = target;
+        int32_t port = 502;
+        auto colon = target.rfind(':');
+        if (colon != std::string::npos)
+        {
+            const char *error;
+            if (parse_arg(std::string_view(target).substr(colon + 1), {"port", Arg::Int, 1, UINT16_MAX}, port, error) == -1)
+            {
+                printf("port of \"%s\": %s\n", target.c_str(), error);
+                return nullptr;
+            }
+            host = target.substr(0, colon);
+        }
+        ctx = modbus_new_tcp(host.c_str(), port);
+    }
+
+    if (!ctx)
+    {
+        fprintf(stderr, "Unable to create context for %s: %s\n", target.c_str(), modbus_strerror(errno));
+        return nullptr;
+    }
+
+    modbus_set_slave(ctx, unit_id);
+#ifdef LIBMODBUS_PRE_312
+    const timeval response_timeout = {2, 0};
+    modbus_set_response_timeout(ctx, &response_timeout);
+#else
+    modbus_set_response_timeout(ctx, 2, 0);
+#endif
+    return ctx;
+}
+
+// Settings only, the unit owns volatile registers and commands must not be replayed
+static bool pushable(uint16_t reg)
+{
+    const auto &desc = holding_register(reg);
+    return desc.access == Access::ReadWrite && !(desc.flags & (RegFlag::Volatile | RegFlag::Command));
+}
+
+static int read_holding(modbus_t *ctx, uint16_t *dest)
+{
+    for (uint16_t addr = 0; addr < e_holding_last_item; addr += MODBUS_MAX_READ_REGISTERS)
+    {
+        uint16_t count = std::min<int>(MODBUS_MAX_READ_REGISTERS, e_holding_last_item - addr);
+        ModbusRequest request{static_cast<uint8_t>(modbus_get_slave(ctx)), Function_code::ReadHolding, addr, count, &dest[addr], 0};
+        g_transport_stats.transactions++;
+        if (captured_transact(ctx, request) == -1)
+        {
+            g_transport_stats.errors++;
+            fprintf(stderr, "Read failed: %s\n", modbus_strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void print_change(uint16_t reg, uint16_t from, uint16_t to)
+{
+    const auto &desc = holding_register(reg);
+    printf("  %-24s %8.*f -> %-8.*f %s\n", desc.alias, desc.precision(), desc.to_engineering(from),
+           desc.precision(), desc.to_engineering(to), desc.unit);
+}
+
+// One FC06 per differing register, for single changes and units without FC16
+static int write_single(modbus_t *ctx, uint16_t first, uint16_t last, const uint16_t *wanted, const uint16_t *current, int &requests)
+{
+    for (uint16_t reg = first; reg <= last; reg++)
+    {
+        if (wanted[reg] == current[reg])
+            continue;
+        requests++;
+        uint16_t value = wanted[reg];
+        ModbusRequest request{static_cast<uint8_t>(modbus_get_slave(ctx)), Function_code::WriteSingle, reg, 1, &value, 0};
+        g_transport_stats.transactions++;
+        if (captured_transact(ctx, request) == -1)
+        {
+            g_transport_stats.errors++;
+            fprintf(stderr, "Write of %s failed: %s\n", holding_register(reg).alias, modbus_strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int push_settings(modbus_t *ctx, const uint16_t *registers)
+{
+    uint16_t wanted[e_holding_last_item];
+    memcpy(wanted, registers, sizeof(wanted));
+
+    bool valid = true;
+    for (uint16_t reg = 0; reg < e_holding_last_item; reg++)
+    {
+        if (pushable(reg) && validate_holding_write(reg, &wanted[reg], 1) == -1)
+            valid = false;
+    }
+    if (!valid)
+    {
+        printf("Nothing pushed, fix the values above first\n");
+        return -1;
+    }
+
+    if (modbus_connect(ctx) == -1)
+    {
+        fprintf(stderr, "Connection failed: %s\n", modbus_strerror(errno));
+        return -1;
+    }
+
+    uint16_t current[e_holding_last_item];
+    if (read_holding(ctx, current) == -1)
+    {
+        modbus_close(ctx);
+        return -1;
+    }
+
+    int changed = 0;
+    int requests = 0;
+    bool write_multiple = true;
+    for (uint16_t reg = 0; reg < e_holding_last_item;)
+    {
+        if (!pushable(reg) || wanted[reg] == current[reg])
+        {
+            reg++;
+            continue;
+        }
+
+        // Extend the run over further changes at most MERGE_GAP registers apart
+        uint16_t first = reg;
+        uint16_t last = reg;
+        for (uint16_t next = reg + 1; next < e_holding_last_item && next - last <= MERGE_GAP + 1 && pushable(next); next++)
+        {
+            if (wanted[next] != current[next])
+                last = next;
+        }
+
+        for (uint16_t i = first; i <= last; i++)
+        {
+            if (wanted[i] != current[i])
+            {
+                print_change(i, current[i], wanted[i]);
+                changed++;
+            }
+        }
+
+        int rc = 0;
+        if (first == last || !write_multiple)
+        {
+            rc = write_single(ctx, first, last, wanted, current, requests);
+        }
+        else
+        {
+            requests++;
+            ModbusRequest request{static_cast<uint8_t>(modbus_get_slave(ctx)), Function_code::WriteMultiple, first, static_cast<uint16_t>(last - first + 1), &wanted[first], 0};
+            g_transport_stats.transactions++;
+            rc = captured_transact(ctx, request);
+            if (rc == -1)
+            {
+                g_transport_stats.errors++;
+                if (errno == EMBXILFUN)
+                {
+                    write_multiple = false;
+                    rc = write_single(ctx, first, last, wanted, current, requests);
+                }
+                else
+                {
+                    fprintf(stderr, "Write of %s..%s failed: %s\n", holding_register(first).alias, holding_register(last).alias, modbus_strerror(errno));
+                }
+            }
+        }
+        if (rc == -1)
+        {
+            modbus_close(ctx);
+            return -1;
+        }
+        reg = last + 1;
+    }
+
+    if (changed == 0)
+    {
+        modbus_close(ctx);
+        printf("Unit already up to date\n");
+        return 0;
+    }
+
+    // The unit may clamp or ignore values on its own, check what it really holds now
+    int rc = read_holding(ctx, current);
+    modbus_close(ctx);
+    if (rc == -1)
+        return -1;
+
+    int mismatches = 0;
+    for (uint16_t reg = 0; reg < e_holding_last_item; reg++)
+    {
+        if (pushable(reg) && wanted[reg] != current[reg])
+        {
+            printf("%s not taken by the unit:\n", holding_register(reg).alias);
+            print_change(reg, wanted[reg], current[reg]);
+            mismatches++;
+        }
+    }
+
+    printf("Pushed %d changed registers in %d write requests%s\n", changed, requests, mismatches ? "" : ", verified");
+    return mismatches ? -1 : changed;
+}
@@ -0,0 +1,21 @@
+#ifndef SETTINGS_PUSH_HPP
+#define SETTINGS_PUSH_HPP
+
+#include <cstdint>
+#include <string>
+
+#include <modbus/modbus.h>
+
+// Context for "host[:port]" (Modbus TCP) or a serial device path (RTU, 9600 8N1),
+// slave and response timeout set. nullptr when the target is not understood.
+modbus_t *new_target_context(const std::string &target, uint8_t unit_id);
+
+// Brings the holding registers of the unit behind the unconnected `ctx` to
+// `registers` (e_holding_last_item values) with as few writes as possible:
+// the unit's block is read first and only differing settings are written,
+// runs separated by a few unchanged registers are merged into one FC16.
+// Volatile and command registers are never written. The result is read back.
+// Returns the number of registers changed, -1 on any error.
+int push_settings(modbus_t *ctx, const uint16_t *registers);
+
+#endif // SETTINGS_PUSH_HPP
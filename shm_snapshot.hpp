@@ -0,0 +1,106 @@
+#ifndef SHM_SNAPSHOT_HPP
+#define SHM_SNAPSHOT_HPP
+
+// Header-only access to the register snapshot remote_cli publishes in POSIX
+// shared memory (remote_cli --shm /name). Readers copy a consistent snapshot
+// without syscalls and without touching the Modbus line:
+//
+//     ShmSnapshotReader reader;
+//     ShmSnapshot snap;
+//     if (reader.open("/remote_cli") == 0 && reader.read(snap))
+//         printf("T4 = %d\n", (int16_t)snap.input[16]);
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+inline constexpr uint32_t SHM_SNAPSHOT_MAGIC = 0x41485553; // "AHUS"
+inline constexpr uint32_t SHM_SNAPSHOT_VERSION = 1;
+inline constexpr uint16_t SHM_MAX_REGISTERS = 128;
+
+struct ShmSnapshot
+{
+    uint64_t sequence;         // incremented on every publish
+    uint64_t input_stamp_ns;   // CLOCK_REALTIME of the last complete input block read, 0 - never
+    uint64_t holding_stamp_ns; // same for the holding block
+    uint16_t input_count;
+    uint16_t holding_count;
+    uint16_t input[SHM_MAX_REGISTERS];
+    uint16_t holding[SHM_MAX_REGISTERS];
+};
+
+struct ShmSnapshotSegment
+{
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint32_t> seqlock; // odd while the writer updates `data`
+    uint32_t reserved;
+    ShmSnapshot data;
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "seqlock must be usable across processes");
+
+class ShmSnapshotReader
+{
+public:
+    ~ShmSnapshotReader() { close(); }
+
+    int open(const char *name)
+    {
+        close();
+        int fd = shm_open(name, O_RDONLY, 0);
+        if (fd < 0)
+            return -1;
+
+        void *addr = mmap(nullptr, sizeof(ShmSnapshotSegment), PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED)
+            return -1;
+
+        segment_ = static_cast<const ShmSnapshotSegment *>(addr);
+        if (segment_->magic != SHM_SNAPSHOT_MAGIC || segment_->version != SHM_SNAPSHOT_VERSION)
+        {
+            close();
+            return -1;
+        }
+        return 0;
+    }
+
+    void close(void)
+    {
+        if (segment_)
+            munmap(const_cast<ShmSnapshotSegment *>(segment_), sizeof(ShmSnapshotSegment));
+        segment_ = nullptr;
+    }
+
+    // Copies a consistent snapshot, false when the writer kept updating it for all attempts
+    bool read(ShmSnapshot &out, int attempts = 1000) const
+    {
+        if (!segment_)
+            return false;
+
+        while (attempts-- > 0)
+        {
+            uint32_t before = segment_->seqlock.load(std::memory_order_acquire);
+            if (before & 1)
+                continue;
+
+            memcpy(&out, &segment_->data, sizeof(out));
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (segment_->seqlock.load(std::memory_order_relaxed) == before)
+                return true;
+        }
+        return false;
+    }
+
+private:
+    const ShmSnapshotSegment *segment_{nullptr};
+};
+
+#endif // SHM_SNAPSHOT_HPP
@@ -0,0 +1,92 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "single_flight.hpp"
+
+SingleFlight::Flight::~Flight()
+{
+    if (done_fd >= 0)
+        ::close(done_fd);
+}
+
+// Called with mutex_ held
+std::shared_ptr<SingleFlight::Flight> SingleFlight::find(uint16_t from, uint16_t to)
+{
+    for (const auto &flight : flights_)
+    {
+        if (flight->from <= from && to <= flight->to)
+            return flight;
+    }
+    return nullptr;
+}
+
+int SingleFlight::run(uint16_t from, uint16_t to, const std::function<int()> &read)
+{
+    std::unique_lock lk(mutex_);
+    if (auto joined = find(from, to)) // keeps it alive after the leader removes it
+    {
+        cv_.wait(lk, [&joined]
+                 { return joined->done.load(); });
+        shared_++;
+        return joined->rc;
+    }
+    lk.unlock();
+
+    auto flight = lead(from, to);
+    int rc = read();
+    finish(flight, rc);
+    return rc;
+}
+
+std::shared_ptr<SingleFlight::Flight> SingleFlight::join(uint16_t from, uint16_t to)
+{
+    std::unique_lock lk(mutex_);
+    auto joined = find(from, to);
+    if (joined)
+        shared_++;
+    return joined;
+}
+
+int SingleFlight::done_fd(Flight &flight)
+{
+    std::unique_lock lk(mutex_);
+    if (flight.done_fd < 0)
+    {
+        flight.done_fd = eventfd(flight.done ? 1 : 0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (flight.done_fd < 0)
+            fprintf(stderr, "eventfd: %s\n", strerror(errno));
+    }
+    return flight.done_fd;
+}
+
+std::shared_ptr<SingleFlight::Flight> SingleFlight::lead(uint16_t from, uint16_t to)
+{
+    auto flight = std::make_shared<Flight>();
+    flight->from = from;
+    flight->to = to;
+
+    std::unique_lock lk(mutex_);
+    flights_.push_back(flight);
+    return flight;
+}
+
+void SingleFlight::finish(const std::shared_ptr<Flight> &flight, int rc)
+{
+    std::unique_lock lk(mutex_);
+    flight->rc = rc;
+    flight->done = true;
+    flights_.remove(flight);
+    issued_++;
+    if (flight->done_fd >= 0)
+    {
+        // never drained, it stays readable for every coroutine waiting on it
+        uint64_t one = 1;
+        if (write(flight->done_fd, &one, sizeof(one)) != sizeof(one))
+            fprintf(stderr, "eventfd: %s\n", strerror(errno));
+    }
+    cv_.notify_all();
+}
@@ -0,0 +1,60 @@
+#ifndef SINGLE_FLIGHT_HPP
+#define SINGLE_FLIGHT_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+
+// Deduplicates concurrent reads of a register range. When a read covering the
+// same or a wider range is already in flight (or queued for the bus), the
+// caller waits for it and shares its result instead of issuing its own.
+//
+// Threads use run(). Coroutines must not block their scheduler, they use
+// join() and lead()/finish() and wait on the flight's done_fd() instead:
+//     auto flight = flights.join(from, to);
+//     if (flight) { while (!flight->done) co_await sched.readable(flights.done_fd(*flight), max); rc = flight->rc; }
+//     else { flight = flights.lead(from, to); rc = co_await read; flights.finish(flight, rc); }
+class SingleFlight
+{
+public:
+    struct Flight
+    {
+        uint16_t from;
+        uint16_t to;
+        std::atomic<bool> done{false};
+        int rc{-1};
+        int done_fd{-1}; // eventfd, created for the first coroutine joining
+
+        ~Flight();
+    };
+
+    // Returns the result of `read`, either run by this caller or by the shared flight
+    int run(uint16_t from, uint16_t to, const std::function<int()> &read);
+
+    // Flight covering [from, to] to share, nullptr when there is none
+    std::shared_ptr<Flight> join(uint16_t from, uint16_t to);
+    // Readable once `flight` is done
+    int done_fd(Flight &flight);
+
+    // Registers a read of [from, to] others can join, the caller reads and finish()es it
+    std::shared_ptr<Flight> lead(uint16_t from, uint16_t to);
+    void finish(const std::shared_ptr<Flight> &flight, int rc);
+
+    uint64_t issued(void) const { return issued_; }
+    uint64_t shared(void) const { return shared_; }
+
+private:
+    std::shared_ptr<Flight> find(uint16_t from, uint16_t to);
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::list<std::shared_ptr<Flight>> flights_;
+    std::atomic<uint64_t> issued_{0};
+    std::atomic<uint64_t> shared_{0};
+};
+
+#endif // SINGLE_FLIGHT_HPP
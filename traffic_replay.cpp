@@ -0,0 +1,383 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+
+#include "modbus_adu.hpp"
+#include "report.hpp"
+#include "traffic_replay.hpp"
+
+static constexpr uint32_t PCAPNG_SECTION_HEADER = 0x0A0D0D0A;
+static constexpr uint32_t PCAPNG_INTERFACE_DESCRIPTION = 0x00000001;
+static constexpr uint32_t PCAPNG_ENHANCED_PACKET = 0x00000006;
+static constexpr uint32_t PCAPNG_BYTE_ORDER_MAGIC = 0x1A2B3C4D;
+static constexpr uint16_t LINKTYPE_ETHERNET = 1;
+static constexpr uint16_t LINKTYPE_RAW = 101;
+static constexpr uint16_t LINKTYPE_USER0 = 147;
+static constexpr uint16_t LINKTYPE_IPV4 = 228;
+static constexpr uint16_t MODBUS_TCP_PORT = 502;
+
+static uint16_t be16(const uint8_t *p) { return (p[0] << 8) | p[1]; }
+
+struct Interface
+{
+    uint16_t linktype;
+    uint64_t ns_per_unit_num; // timestamp unit as a fraction of a nanosecond
+    uint64_t ns_per_unit_den;
+};
+
+// if_tsresol: power of ten, or of two with the top bit set. Microseconds when absent.
+static Interface parse_interface(const uint8_t *body, size_t length)
+{
+    Interface interface{static_cast<uint16_t>(body[0] | (body[1] << 8)), 1000, 1};
+    for (size_t pos = 8; pos + 4 <= length;)
+    {
+        uint16_t code, option_length;
+        memcpy(&code, &body[pos], 2);
+        memcpy(&option_length, &body[pos + 2], 2);
+        if (code == 0 || pos + 4 + option_length > length)
+            break;
+        if (code == 9 && option_length == 1)
+        {
+            uint8_t resolution = body[pos + 4];
+            uint64_t units = 1;
+            for (int i = 0; i < (resolution & 0x7f) && units < (1ull << 62); i++)
+                units *= resolution & 0x80 ? 2 : 10;
+            interface.ns_per_unit_num = 1000000000;
+            interface.ns_per_unit_den = units;
+        }
+        pos += 4 + ((option_length + 3) & ~3u);
+    }
+    return interface;
+}
+
+// Request PDU to item, false for function codes the replay does not issue
+static bool parse_request(const uint8_t *pdu, size_t length, ReplayItem &item)
+{
+    if (length < 5)
+        return false;
+    item.function = pdu[0];
+    item.addr = be16(&pdu[1]);
+    item.values.clear();
+    switch (pdu[0])
+    {
+    case Function_code::ReadHolding:
+    case Function_code::ReadInput:
+        item.count = be16(&pdu[3]);
+        return length == 5 && item.count > 0;
+    case Function_code::WriteSingle:
+        item.count = 1;
+        item.values.push_back(be16(&pdu[3]));
+        return length == 5;
+    case Function_code::WriteMultiple:
+        item.count = be16(&pdu[3]);
+        if (item.count == 0 || length != 6u + 2 * item.count)
+            return false;
+        item.values.resize(item.count);
+        load_registers(item.values.data(), &pdu[6], item.count);
+        return true;
+    default:
+        return false;
+    }
+}
+
+class CaptureReader
+{
+public:
+    CaptureReader(std::vector<ReplayItem> &items, size_t &ignored) : items_(items), ignored_(ignored) {}
+
+    void packet(const Interface &interface, uint64_t stamp_ns, const uint8_t *data, size_t length)
+    {
+        switch (interface.linktype)
+        {
+        case LINKTYPE_ETHERNET:
+        {
+            size_t offset = 12;
+            while (offset + 2 <= length && (be16(&data[offset]) == 0x8100 || be16(&data[offset]) == 0x88A8))
+                offset += 4; // VLAN tags
+            if (offset + 2 <= length && be16(&data[offset]) == 0x0800)
+                ipv4(stamp_ns, &data[offset + 2], length - offset - 2);
+            break;
+        }
+        case LINKTYPE_RAW:
+        case LINKTYPE_IPV4:
+            ipv4(stamp_ns, data, length);
+            break;
+        case LINKTYPE_USER0:
+            rtu(stamp_ns, data, length);
+            break;
+        }
+    }
+
+private:
+    void ipv4(uint64_t stamp_ns, const uint8_t *ip, size_t length)
+    {
+        if (length < 20 || (ip[0] >> 4) != 4 || ip[9] != 6)
+            return;
+        size_t ip_header = (ip[0] & 0x0f) * 4;
+        size_t total = std::min<size_t>(be16(&ip[2]), length);
+        if (total < ip_header + 20)
+            return;
+        const uint8_t *tcp = &ip[ip_header];
+        size_t tcp_header = (tcp[12] >> 4) * 4;
+        if (total < ip_header + tcp_header)
+            return;
+
+        uint16_t source = be16(&tcp[0]);
+        uint16_t destination = be16(&tcp[2]);
+        const uint8_t *payload = &tcp[tcp_header];
+        size_t payload_length = total - ip_header - tcp_header;
+
+        // A segment may carry several ADUs, ADUs split over segments are not reassembled
+        int frame_length;
+        while ((frame_length = mbap_frame_length(payload, payload_length)) > 0)
+        {
+            const uint8_t *pdu = &payload[MBAP_HEADER_LENGTH];
+            size_t pdu_length = frame_length - MBAP_HEADER_LENGTH;
+            uint32_t key = (static_cast<uint32_t>(destination == MODBUS_TCP_PORT ? source : destination) << 16) | mbap_tid(payload);
+            if (destination == MODBUS_TCP_PORT)
+            {
+                int index = request(stamp_ns, pdu, pdu_length);
+                if (index >= 0)
+                    open_tcp_[key] = index;
+            }
+            else if (source == MODBUS_TCP_PORT)
+            {
+                auto it = open_tcp_.find(key);
+                if (it != open_tcp_.end())
+                {
+                    answered(it->second, stamp_ns);
+                    open_tcp_.erase(it);
+                }
+            }
+            payload += frame_length;
+            payload_length -= frame_length;
+        }
+    }
+
+    // The line carries no direction. A frame from the unit with the function of
+    // the pending request is its answer, anything else starts a new request.
+    // Timeouts appear as empty frames in our own captures.
+    void rtu(uint64_t stamp_ns, const uint8_t *frame, size_t length)
+    {
+        if (length == 0)
+        {
+            open_rtu_ = -1;
+            open_rtu_function_ = 0;
+            return;
+        }
+        int pdu_length = rtu_pdu_length(frame, length, frame[0]);
+        if (pdu_length == -1)
+            return;
+
+        if (open_rtu_function_ != 0 && frame[0] == open_rtu_unit_ && (frame[1] & 0x7f) == open_rtu_function_)
+        {
+            if (open_rtu_ >= 0)
+                answered(open_rtu_, stamp_ns);
+            open_rtu_ = -1;
+            open_rtu_function_ = 0;
+            return;
+        }
+        open_rtu_ = request(stamp_ns, &frame[1], pdu_length);
+        open_rtu_unit_ = frame[0];
+        open_rtu_function_ = frame[1];
+    }
+
+    int request(uint64_t stamp_ns, const uint8_t *pdu, size_t length)
+    {
+        ReplayItem item;
+        if (!parse_request(pdu, length, item))
+        {
+            ignored_++;
+            return -1;
+        }
+        if (items_.empty())
+            first_ns_ = stamp_ns;
+        item.offset_ns = stamp_ns >= first_ns_ ? stamp_ns - first_ns_ : 0;
+        stamps_.push_back(stamp_ns);
+        items_.push_back(std::move(item));
+        return static_cast<int>(items_.size() - 1);
+    }
+
+    void answered(int index, uint64_t stamp_ns)
+    {
+        if (items_[index].recorded_ns == -1 && stamp_ns >= stamps_[index])
+            items_[index].recorded_ns = stamp_ns - stamps_[index];
+    }
+
+    std::vector<ReplayItem> &items_;
+    size_t &ignored_;
+    std::vector<uint64_t> stamps_;
+    uint64_t first_ns_{0};
+    std::map<uint32_t, int> open_tcp_; // client port and transaction id -> item
+    int open_rtu_{-1}; // item, -1 for requests not replayed
+    uint8_t open_rtu_unit_{0};
+    uint8_t open_rtu_function_{0}; // 0 - no request pending
+};
+
+int load_replay_capture(const char *path, std::vector<ReplayItem> &items, size_t &ignored)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    items.clear();
+    ignored = 0;
+    CaptureReader reader(items, ignored);
+    std::vector<Interface> interfaces;
+    std::vector<uint8_t> body;
+    bool section{false};
+    uint32_t header[2];
+    while (fread(header, sizeof(header), 1, file) == 1)
+    {
+        if (header[1] < 12 || header[1] % 4 != 0)
+            break;
+        body.resize(header[1] - 8);
+        if (fread(body.data(), 1, body.size(), file) != body.size())
+            break;
+
+        uint32_t magic;
+        switch (header[0])
+        {
+        case PCAPNG_SECTION_HEADER:
+            if (body.size() >= 4)
+                memcpy(&magic, body.data(), 4);
+            if (body.size() < 4 || magic != PCAPNG_BYTE_ORDER_MAGIC)
+            {
+                fprintf(stderr, "%s: not a pcapng file in this machine's byte order\n", path);
+                fclose(file);
+                return -1;
+            }
+            section = true;
+            interfaces.clear();
+            break;
+
+        case PCAPNG_INTERFACE_DESCRIPTION:
+            if (body.size() >= 12)
+                interfaces.push_back(parse_interface(body.data(), body.size() - 4));
+            break;
+
+        case PCAPNG_ENHANCED_PACKET:
+        {
+            uint32_t fields[5]; // interface, stamp high, stamp low, captured, original
+            if (body.size() < 24)
+                break;
+            memcpy(fields, body.data(), sizeof(fields));
+            if (fields[0] >= interfaces.size() || 20 + fields[3] > body.size() - 4)
+                break;
+            const Interface &interface = interfaces[fields[0]];
+            uint64_t stamp = (static_cast<uint64_t>(fields[1]) << 32) | fields[2];
+            uint64_t stamp_ns = static_cast<uint64_t>(static_cast<long double>(stamp) * interface.ns_per_unit_num / interface.ns_per_unit_den);
+            reader.packet(interface, stamp_ns, &body[20], fields[3]);
+            break;
+        }
+        }
+    }
+    fclose(file);
+
+    if (!section)
+    {
+        fprintf(stderr, "%s: not a pcapng file\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+void run_replay(const std::vector<ReplayItem> &items, double speed, const std::function<int(const ReplayItem &)> &issue, ReplayStats &stats)
+{
+    using Clock = std::chrono::steady_clock;
+    stats = {};
+    stats.latency.reserve(items.size());
+
+    const auto start = Clock::now();
+    for (const auto &item : items)
+    {
+        if (speed > 0)
+        {
+            auto due = start + std::chrono::nanoseconds(static_cast<int64_t>(item.offset_ns / speed));
+            auto now = Clock::now();
+            if (now < due)
+                std::this_thread::sleep_until(due);
+            else
+                stats.max_slip_ns = std::max<uint64_t>(stats.max_slip_ns, std::chrono::nanoseconds(now - due).count());
+        }
+
+        auto sent = Clock::now();
+        int rc = issue(item);
+        stats.latency.push_back({item.function, static_cast<uint64_t>(std::chrono::nanoseconds(Clock::now() - sent).count())});
+        stats.issued++;
+        if (rc != 0)
+            stats.failed++;
+        if (item.recorded_ns >= 0)
+            stats.recorded.push_back({item.function, static_cast<uint64_t>(item.recorded_ns)});
+    }
+    stats.wall_ns = std::chrono::nanoseconds(Clock::now() - start).count();
+}
+
+static uint64_t percentile(const std::vector<uint64_t> &sorted, int p)
+{
+    return sorted.empty() ? 0 : sorted[std::min(sorted.size() - 1, sorted.size() * p / 100)];
+}
+
+static std::vector<uint64_t> sorted_for(const std::vector<std::pair<uint8_t, uint64_t>> &samples, int function)
+{
+    std::vector<uint64_t> values;
+    for (const auto &[fc, ns] : samples)
+    {
+        if (function == -1 || fc == function)
+            values.push_back(ns);
+    }
+    std::sort(values.begin(), values.end());
+    return values;
+}
+
+void print_replay_report(const ReplayStats &stats)
+{
+    Report report;
+    report.integer("issued", "Requests issued", stats.issued);
+    report.integer("failed", "Requests failed", stats.failed);
+    report.number("wall_s", "Replay took", stats.wall_ns / 1e9, 3, "s");
+    report.number("throughput", "Throughput", stats.wall_ns ? stats.issued * 1e9 / stats.wall_ns : 0.0, 1, "req/s");
+    report.number("max_slip_ms", "Largest delay behind the capture timing", stats.max_slip_ns / 1e6, 3, "ms");
+
+    static const struct
+    {
+        int function;
+        const char *key;
+        const char *label;
+    } groups[] = {
+        {-1, "all", "All"},
+        {Function_code::ReadHolding, "fc03", "FC03"},
+        {Function_code::ReadInput, "fc04", "FC04"},
+        {Function_code::WriteSingle, "fc06", "FC06"},
+        {Function_code::WriteMultiple, "fc16", "FC16"},
+    };
+    static const int percentiles[] = {50, 90, 99, 100};
+
+    for (const auto &group : groups)
+    {
+        auto replayed = sorted_for(stats.latency, group.function);
+        if (replayed.empty())
+            continue;
+        auto recorded = sorted_for(stats.recorded, group.function);
+
+        std::string key = group.key;
+        std::string label = group.label;
+        report.heading("");
+        report.integer(key + "_count", label + " requests", replayed.size());
+        for (int p : percentiles)
+        {
+            std::string name = p == 100 ? "max" : "p" + std::to_string(p);
+            report.number(key + "_" + name + "_ms", label + " latency " + name, percentile(replayed, p) / 1e6, 3, "ms");
+            if (!recorded.empty())
+                report.number(key + "_" + name + "_recorded_ms", label + " latency " + name + " in the capture", percentile(recorded, p) / 1e6, 3, "ms");
+        }
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef TRAFFIC_REPLAY_HPP
+#define TRAFFIC_REPLAY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// One request found in a capture
+struct ReplayItem
+{
+    uint64_t offset_ns;           // when it was sent, relative to the first request
+    uint8_t function;             // one of Function_code
+    uint16_t addr;
+    uint16_t count;               // registers read or written
+    std::vector<uint16_t> values; // for writes
+    int64_t recorded_ns{-1};      // request to response in the capture, -1 when it was not answered there
+};
+
+// Requests sent to a unit in a pcapng file: "modbus capture dump" output, or a
+// Wireshark capture of Modbus/TCP (Ethernet, raw IPv4) or Modbus RTU (DLT_USER0).
+// Only FC03/04/06/16 are taken, others are counted in `ignored`. Returns -1 when
+// the file cannot be read.
+int load_replay_capture(const char *path, std::vector<ReplayItem> &items, size_t &ignored);
+
+struct ReplayStats
+{
+    size_t issued{0};
+    size_t failed{0};
+    uint64_t wall_ns{0};
+    uint64_t max_slip_ns{0};                  // how far the replay fell behind the requested timing
+    std::vector<std::pair<uint8_t, uint64_t>> latency; // function code, ns per issued request
+    std::vector<std::pair<uint8_t, uint64_t>> recorded;
+};
+
+// Issues `items` through `issue` (0 - success), one at a time.
+// `speed` scales the original timing: 1 - as captured, 10 - ten times faster, 0 - back to back.
+void run_replay(const std::vector<ReplayItem> &items, double speed, const std::function<int(const ReplayItem &)> &issue, ReplayStats &stats);
+
+// Throughput and latency percentiles per function code, replayed next to recorded
+void print_replay_report(const ReplayStats &stats);
+
+#endif // TRAFFIC_REPLAY_HPP
@@ -0,0 +1,16 @@
+#ifndef TRANSPORT_STATS_HPP
+#define TRANSPORT_STATS_HPP
+
+#include <atomic>
+#include <cstdint>
+
+// Counters of modbus transactions issued by this process (all transports)
+struct TransportStats
+{
+    std::atomic<uint64_t> transactions{0};
+    std::atomic<uint64_t> errors{0};
+};
+
+extern TransportStats g_transport_stats;
+
+#endif // TRANSPORT_STATS_HPP
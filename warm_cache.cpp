@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include <unistd.h>
+
+#include "warm_cache.hpp"
+
+static constexpr uint32_t WARM_CACHE_MAGIC = 0x57434832; // "WCH2", the identity follows the registers
+
+struct WarmCacheHeader
+{
+    uint32_t magic;
+    uint32_t count;
+    int64_t stamp;
+};
+
+std::atomic<int> g_holding_freshness{Freshness::Empty};
+WarmCache g_warm_cache;
+
+std::filesystem::path cache_directory(void)
+{
+    std::filesystem::path dir;
+    if (const char *xdg = getenv("XDG_CACHE_HOME"); xdg && *xdg)
+        dir = xdg;
+    else if (const char *home = getenv("HOME"); home && *home)
+        dir = std::filesystem::path(home) / ".cache";
+    else
+        dir = std::filesystem::temp_directory_path();
+
+    dir /= "remote_cli";
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    return dir;
+}
+
+std::filesystem::path cache_file(const std::string &device_key, const char *extension)
+{
+    std::string name = device_key;
+    for (auto &c : name)
+    {
+        if (c == '/' || c == ':')
+            c = '_';
+    }
+    return cache_directory() / (name + extension);
+}
+
+void WarmCache::set_device(const std::string &device_key)
+{
+    path_ = cache_file(device_key, ".holding");
+}
+
+void WarmCache::set_identity(const std::string &identity)
+{
+    std::unique_lock lk(mutex_);
+    identity_ = identity;
+}
+
+int WarmCache::load(uint16_t *registers, size_t count)
+{
+    std::ifstream ifs(path_, std::ios::binary);
+    WarmCacheHeader header{};
+    if (!ifs || !ifs.read(reinterpret_cast<char *>(&header), sizeof(header)))
+        return -1;
+
+    if (header.magic != WARM_CACHE_MAGIC || header.count != count)
+        return -1;
+
+    std::vector<uint16_t> block(count);
+    if (!ifs.read(reinterpret_cast<char *>(block.data()), count * sizeof(uint16_t)))
+        return -1;
+
+    std::string identity{std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>()};
+    std::unique_lock lk(mutex_);
+    if (!identity.empty() && !identity_.empty() && identity != identity_)
+    {
+        fprintf(stderr, "Ignoring the cached settings of another device (%s, expected %s)\n", identity.c_str(), identity_.c_str());
+        return -1;
+    }
+    std::copy(block.begin(), block.end(), registers);
+
+    stamp_ = static_cast<time_t>(header.stamp);
+    return 0;
+}
+
+time_t WarmCache::stamp(void) const
+{
+    std::unique_lock lk(mutex_);
+    return stamp_;
+}
+
+// Written to a temporary file, synced and renamed, a crash never leaves a torn cache behind
+int WarmCache::store(const uint16_t *registers, size_t count)
+{
+    if (path_.empty())
+        return -1;
+
+    // one writer at a time, they share the temporary file
+    std::unique_lock lk(mutex_);
+    std::filesystem::path tmp = path_;
+    tmp += ".tmp";
+    FILE *file = fopen(tmp.c_str(), "wb");
+    if (!file)
+    {
+        fprintf(stderr, "Unable to store the settings cache in %s: %s\n", tmp.c_str(), strerror(errno));
+        return -1;
+    }
+    WarmCacheHeader header{WARM_CACHE_MAGIC, static_cast<uint32_t>(count), static_cast<int64_t>(time(nullptr))};
+    // the data has to be on disk before the rename makes it the current file
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(registers, sizeof(uint16_t), count, file) == count &&
+                   fwrite(identity_.data(), 1, identity_.size(), file) == identity_.size() &&
+                   fflush(file) == 0 && fsync(fileno(file)) == 0;
+    if (fclose(file) != 0 || !written)
+    {
+        fprintf(stderr, "Unable to store the settings cache in %s: %s\n", tmp.c_str(), strerror(errno));
+        return -1;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp, path_, ec);
+    if (ec)
+        return -1;
+    stamp_ = static_cast<time_t>(header.stamp);
+    return 0;
+}
@@ -0,0 +1,59 @@
+#ifndef WARM_CACHE_HPP
+#define WARM_CACHE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <mutex>
+#include <string>
+
+namespace Freshness
+{
+    enum freshness_t
+    {
+        Empty = 0, // nothing known yet
+        Cached,    // loaded from the warm cache file, may be outdated
+        Live,      // read from the device in this session
+        Offline,   // loaded with --offline, edited locally, there is no device
+    };
+}
+
+extern std::atomic<int> g_holding_freshness;
+
+// $XDG_CACHE_HOME/remote_cli (or ~/.cache/remote_cli), created on demand
+std::filesystem::path cache_directory(void);
+
+// Per-device file in cache_directory(), e.g. cache_file("rtu_/dev/ttyUSB0_53", ".holding")
+std::filesystem::path cache_file(const std::string &device_key, const char *extension);
+
+// Last known holding register block of one device, persisted between sessions
+// so the prompt can show settings before the device answers. The block is
+// stored with the FC43 identity of the unit and not loaded for another one.
+class WarmCache
+{
+public:
+    // device_key identifies the unit, e.g. "tcp_192.168.1.10_502_53"
+    void set_device(const std::string &device_key);
+    // Explicit file instead of the per-device one, e.g. a cache copied from another machine
+    void set_path(const std::filesystem::path &path) { path_ = path; }
+    // device_identity() of the unit, empty when unknown (then any block is loaded)
+    void set_identity(const std::string &identity);
+
+    int load(uint16_t *registers, size_t count);
+    int store(const uint16_t *registers, size_t count);
+
+    time_t stamp(void) const;
+    const std::filesystem::path &path(void) const { return path_; }
+
+private:
+    std::filesystem::path path_;
+    time_t stamp_{0};
+    mutable std::mutex mutex_; // store() runs on the refresh thread and the snapshot task
+    std::string identity_;
+};
+
+extern WarmCache g_warm_cache;
+
+#endif // WARM_CACHE_HPP